@@ -0,0 +1,1246 @@
+#include <cmath>
+#include <cstring>
+
+#include <QColor>
+#include <QElapsedTimer>
+
+#include "backgroundmodel.h"
+#include "luminance.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Число единиц в 4-битной маске _mm_movemask_ps
+static const int popcount4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+
+// Оттенок неокрашенных цветов (-1 у QColor) считается нулевым
+static inline void toHsv(QRgb x, int& h, int& s, int& v)
+{
+    QColor(x).getHsv(&h, &s, &v);
+    if (h < 0)
+        h = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// Варианты классификатора: пространство цвета, вид ковариации и подавление теней
+/// задаются параметрами шаблона, выбор делается один раз на вызов classify().
+///
+/// Параметры HSV хранятся в float четверками точек: у точки i параметр r лежит в
+/// parameters[((i / 4) * Stride + r) * 4 + i % 4].
+///
+/// Модель RGB хранится сжатой, тоже четверками точек: 16 байт средних (u8 R0..R3,
+/// G0..G3, B0..B3 и 4 байта выравнивания), затем Stride - 3 строки по четыре half float
+/// обратной матрицы. Четверка полной ковариации занимает 64 байта - одну строку кэша,
+/// 16 байт на точку вместо 36. SSE читает параметр четырех соседних точек одной
+/// загрузкой и распаковывает его на лету
+/////////////////////////////////////////////////////////////////////////////////
+
+static inline qint64 parameterIndex(qint64 i, int stride, int r)
+{
+    return ((i >> 2) * stride + r) * 4 + (i & 3);
+}
+
+static inline int compactGroupSize(int stride)
+{
+    return 16 + 8 * (stride - 3);
+}
+
+// Выравнивание сжатой модели: четверки полной ковариации не пересекают строк кэша
+#define CompactAlignment 64
+
+// Наибольшее и наименьшее нормальное half float, 2^112 - разность смещений порядка
+// half и float: (h & 0x7FFF) << 13 как float, умноженное на нее, дает значение half
+#define HalfMax 65504.f
+#define HalfMinNormal 6.103515625e-05f
+#define HalfToFloatScale 5.192296858534828e+33f
+
+// С округлением к ближайшему. Денормализованных half нет: меньшие числа округляются
+// к нулю или к HalfMinNormal, иначе распаковка давала бы медленные денормализованные float.
+// Большие HalfMax (почти вырожденная ковариация) ограничиваются им
+static quint16 toHalf(float value)
+{
+    quint16 sign = value < 0 ? 0x8000 : 0;
+    float magnitude = std::fabs(value);
+    if (!(magnitude >= 0.5f * HalfMinNormal))
+        return sign;
+    if (magnitude < HalfMinNormal)
+        return sign | 0x0400;
+    if (magnitude >= HalfMax)
+        return sign | 0x7BFF;
+
+    quint32 bits;
+    memcpy(&bits, &magnitude, 4);
+    bits -= 112 << 23;
+    bits += 0x0FFF + ((bits >> 13) & 1);
+    return sign | (quint16)(bits >> 13);
+}
+
+static inline float fromHalf(quint16 h)
+{
+    quint32 bits = ((quint32)(h & 0x8000) << 16) | ((quint32)(h & 0x7FFF) << 13);
+    float value;
+    memcpy(&value, &bits, 4);
+    return value * HalfToFloatScale;
+}
+
+// Параметры одной точки: среднее и Stride - 3 элемента обратной матрицы
+struct FloatStorage
+{
+    static inline void load(const void* parameters, qint64 i, int stride, float mu[3], float* a)
+    {
+        const float* p = (const float*)parameters + parameterIndex(i, stride, 0);
+        for (int c = 0; c < 3; c++)
+            mu[c] = p[4 * c];
+        for (int r = 0; r < stride - 3; r++)
+            a[r] = p[12 + 4 * r];
+    }
+};
+
+struct CompactStorage
+{
+    static inline const uchar* group(const void* parameters, qint64 i, int stride)
+    {
+        return (const uchar*)parameters + (i >> 2) * compactGroupSize(stride);
+    }
+
+    static inline void load(const void* parameters, qint64 i, int stride, float mu[3], float* a)
+    {
+        const uchar* g = group(parameters, i, stride);
+        const quint16* h = (const quint16*)(g + 16);
+        int lane = i & 3;
+        for (int c = 0; c < 3; c++)
+            mu[c] = g[4 * c + lane];
+        for (int r = 0; r < stride - 3; r++)
+            a[r] = fromHalf(h[4 * r + lane]);
+    }
+
+#ifdef __SSE2__
+    // Та же распаковка для четверки точек, g - начало четверки
+    static inline void loadGroup(const uchar* g, int stride, __m128 mu[3], __m128* a)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i signMask = _mm_set1_epi32(0x80000000);
+        const __m128i magnitudeMask = _mm_set1_epi32(0x7FFF0000);
+
+        __m128i m = _mm_loadu_si128((const __m128i*)g);
+        __m128i m01 = _mm_unpacklo_epi8(m, zero);
+        __m128i m2 = _mm_unpackhi_epi8(m, zero);
+        mu[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(m01, zero));
+        mu[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(m01, zero));
+        mu[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(m2, zero));
+
+        // half в старших 16 битах: знак уже на месте, модуль сдвигается к порядку float
+        for (int r = 0; r < stride - 3; r++)
+        {
+            __m128i h = _mm_unpacklo_epi16(zero, _mm_loadl_epi64((const __m128i*)(g + 16 + 8 * r)));
+            __m128i bits = _mm_or_si128(_mm_and_si128(h, signMask), _mm_srli_epi32(_mm_and_si128(h, magnitudeMask), 3));
+            a[r] = _mm_mul_ps(_mm_castsi128_ps(bits), _mm_set1_ps(HalfToFloatScale));
+        }
+    }
+#endif
+};
+
+struct RgbPixel
+{
+    enum { Simd = 1 };
+    typedef CompactStorage Storage;
+    static inline void convert(QRgb x, float c[3])
+    {
+        c[0] = (float)qRed(x);
+        c[1] = (float)qGreen(x);
+        c[2] = (float)qBlue(x);
+    }
+    static inline void components(QRgb x, quint32 c[3])
+    {
+        c[0] = qRed(x);
+        c[1] = qGreen(x);
+        c[2] = qBlue(x);
+    }
+};
+
+// Оттенок до 359 в u8 не помещается, модель HSV остается в float
+struct HsvPixel
+{
+    enum { Simd = 0 };
+    typedef FloatStorage Storage;
+    static inline void convert(QRgb x, float c[3])
+    {
+        int h, s, v;
+        toHsv(x, h, s, v);
+        c[0] = (float)h;
+        c[1] = (float)s;
+        c[2] = (float)v;
+    }
+    static inline void components(QRgb x, quint32 c[3])
+    {
+        int h, s, v;
+        toHsv(x, h, s, v);
+        c[0] = h;
+        c[1] = s;
+        c[2] = v;
+    }
+};
+
+// Квадрат расстояния Махаланобиса по модулям разностей d, как в Gaussian::isBackground.
+// a - часть обратной матрицы точки (или четверки точек).
+// Векторный вариант считает в том же порядке, результаты совпадают
+struct FullForm
+{
+    // a00 a11 a22 2a01 2a02 2a12
+    enum { Stride = 9 };
+    static inline float distance(const float* a, const float d[3])
+    {
+        return d[0] * (a[0] * d[0] + a[3] * d[1] + a[4] * d[2])
+             + d[1] * (a[1] * d[1] + a[5] * d[2])
+             + d[2] *  a[2] * d[2];
+    }
+#ifdef __SSE2__
+    static inline __m128 distance(const __m128* a, const __m128 d[3])
+    {
+        __m128 r0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], d[0]), _mm_mul_ps(a[3], d[1])), _mm_mul_ps(a[4], d[2]));
+        __m128 r1 = _mm_add_ps(_mm_mul_ps(a[1], d[1]), _mm_mul_ps(a[5], d[2]));
+        __m128 r2 = _mm_mul_ps(_mm_mul_ps(d[2], a[2]), d[2]);
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], r0), _mm_mul_ps(d[1], r1)), r2);
+    }
+#endif
+};
+
+struct DiagonalForm
+{
+    // a00 a11 a22
+    enum { Stride = 6 };
+    static inline float distance(const float* a, const float d[3])
+    {
+        return d[0] * d[0] * a[0] + d[1] * d[1] * a[1] + d[2] * d[2] * a[2];
+    }
+#ifdef __SSE2__
+    static inline __m128 distance(const __m128* a, const __m128 d[3])
+    {
+        __m128 r0 = _mm_mul_ps(_mm_mul_ps(d[0], d[0]), a[0]);
+        __m128 r1 = _mm_mul_ps(_mm_mul_ps(d[1], d[1]), a[1]);
+        __m128 r2 = _mm_mul_ps(_mm_mul_ps(d[2], d[2]), a[2]);
+        return _mm_add_ps(_mm_add_ps(r0, r1), r2);
+    }
+#endif
+};
+
+struct IsotropicForm
+{
+    // 1 / средняя дисперсия
+    enum { Stride = 4 };
+    static inline float distance(const float* a, const float d[3])
+    {
+        return (d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) * a[0];
+    }
+#ifdef __SSE2__
+    static inline __m128 distance(const __m128* a, const __m128 d[3])
+    {
+        __m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2]));
+        return _mm_mul_ps(s, a[0]);
+    }
+#endif
+};
+
+// Тень или блик по Хорпрасерту: цвет c почти параллелен среднему mu (угол меньше
+// ShadowChromaticity), а яркость c относительно mu - в [ShadowMinBrightness, HighlightMaxBrightness].
+// Без делений: alpha = (c, mu) / (mu, mu), sin^2 угла = 1 - (c, mu)^2 / ((c, c) (mu, mu))
+static inline bool isShadow(const float c[3], const float mu[3])
+{
+    const float lo = ShadowMinBrightness, hi = HighlightMaxBrightness;
+    const float cos2 = 1.f - ShadowChromaticity * ShadowChromaticity;
+    float cm = c[0] * mu[0] + c[1] * mu[1] + c[2] * mu[2];
+    float cc = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+    float mm = mu[0] * mu[0] + mu[1] * mu[1] + mu[2] * mu[2];
+    return (cm >= lo * mm) & (cm <= hi * mm) & (cm * cm >= cos2 * cc * mm);
+}
+
+template <typename Pixel, typename Form>
+static inline float pixelDistance(QRgb x, const void* parameters, qint64 i, float c[3], float mu[3])
+{
+    float a[Form::Stride - 3], d[3];
+    Pixel::Storage::load(parameters, i, Form::Stride, mu, a);
+    Pixel::convert(x, c);
+    d[0] = std::fabs(c[0] - mu[0]);
+    d[1] = std::fabs(c[1] - mu[1]);
+    d[2] = std::fabs(c[2] - mu[2]);
+    return Form::distance(a, d);
+}
+
+template <typename Pixel, typename Form, bool Shadows>
+static inline uchar classifyPixel(QRgb x, const void* parameters, qint64 i, float threshold)
+{
+    float c[3], mu[3];
+    bool foreground = pixelDistance<Pixel, Form>(x, parameters, i, c, mu) >= threshold;
+    if (Shadows && foreground)
+        foreground = !isShadow(c, mu);
+    return (uchar)foreground;
+}
+
+#ifdef __SSE2__
+// Четыре точки RGB32, начиная с выровненной на 4 точки модели; g - их сжатая четверка.
+// Возвращает квадраты расстояний, c и mu - цвета точек и средние модели
+template <typename Form>
+static inline __m128 groupDistance(const QRgb* pixels, const uchar* g, __m128 c[3], __m128 mu[3])
+{
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+
+    __m128 a[Form::Stride - 3], d[3];
+    CompactStorage::loadGroup(g, Form::Stride, mu, a);
+
+    __m128i x = _mm_loadu_si128((const __m128i*)pixels);
+    c[0] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(x, 16), byteMask));
+    c[1] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(x, 8), byteMask));
+    c[2] = _mm_cvtepi32_ps(_mm_and_si128(x, byteMask));
+    for (int i = 0; i < 3; i++)
+        d[i] = _mm_andnot_ps(signMask, _mm_sub_ps(c[i], mu[i]));
+    return Form::distance(a, d);
+}
+
+// isShadow() для четверки точек: маска из единиц у теней и бликов
+static inline __m128 groupShadow(const __m128 c[3], const __m128 mu[3])
+{
+    const float cos2 = 1.f - ShadowChromaticity * ShadowChromaticity;
+    __m128 cm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], mu[0]), _mm_mul_ps(c[1], mu[1])), _mm_mul_ps(c[2], mu[2]));
+    __m128 cc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], c[0]), _mm_mul_ps(c[1], c[1])), _mm_mul_ps(c[2], c[2]));
+    __m128 mm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mu[0], mu[0]), _mm_mul_ps(mu[1], mu[1])), _mm_mul_ps(mu[2], mu[2]));
+    return _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(cm, _mm_mul_ps(_mm_set1_ps(ShadowMinBrightness), mm)),
+                                 _mm_cmple_ps(cm, _mm_mul_ps(_mm_set1_ps(HighlightMaxBrightness), mm))),
+                      _mm_cmpge_ps(_mm_mul_ps(cm, cm), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(cos2), cc), mm)));
+}
+
+template <typename Form, bool Shadows>
+static inline void classifyGroup(const QRgb* pixels, uchar* mask, const uchar* g, float threshold)
+{
+    __m128 c[3], mu[3];
+    __m128 foreground = _mm_cmpge_ps(groupDistance<Form>(pixels, g, c, mu), _mm_set1_ps(threshold));
+    // Большая часть кадра - фон, там проверка теней не нужна
+    if (Shadows && _mm_movemask_ps(foreground))
+        foreground = _mm_andnot_ps(groupShadow(c, mu), foreground);
+
+    // 4 маски по 32 бита -> 4 байта 0/1
+    __m128i bits = _mm_srli_epi32(_mm_castps_si128(foreground), 31);
+    bits = _mm_packs_epi32(bits, bits);
+    bits = _mm_packus_epi16(bits, bits);
+    quint32 packed = (quint32)_mm_cvtsi128_si32(bits);
+    memcpy(mask, &packed, 4);
+}
+#endif
+
+typedef void (*ClassifyRows)(const QImage& frame, QImage& mask, const QRect& rect,
+                             const void* parameters, int modelWidth, float threshold);
+
+template <typename Pixel, typename Form, bool Shadows>
+static void classifyRows(const QImage& frame, QImage& mask, const QRect& rect,
+                         const void* parameters, int modelWidth, float threshold)
+{
+    int x0 = rect.left(), x1 = rect.right();
+
+    for (int y = rect.top(); y <= rect.bottom(); y++)
+    {
+        const QRgb* imagePixel = (const QRgb*)frame.constScanLine(y);
+        uchar* maskPixel = mask.scanLine(y);
+        qint64 row = (qint64)y * modelWidth;
+        int x = x0;
+
+#ifdef __SSE2__
+        if (Pixel::Simd)
+        {
+            // До начала четверки - по одной точке
+            for (; x <= x1 && ((row + x) & 3); x++)
+                maskPixel[x] = classifyPixel<Pixel, Form, Shadows>(imagePixel[x], parameters, row + x, threshold);
+            for (; x + 3 <= x1; x += 4)
+                classifyGroup<Form, Shadows>(imagePixel + x, maskPixel + x,
+                                             CompactStorage::group(parameters, row + x, Form::Stride), threshold);
+        }
+#endif
+        for (; x <= x1; x++)
+            maskPixel[x] = classifyPixel<Pixel, Form, Shadows>(imagePixel[x], parameters, row + x, threshold);
+    }
+}
+
+typedef void (*DistanceRows)(const QImage& frame, int y, float* distances, const void* parameters, int modelWidth);
+
+// Квадраты расстояний строки y, по тем же четверкам, что и classifyRows.
+// Shadows - у теней и бликов расстояние 0, как у фона
+template <typename Pixel, typename Form, bool Shadows>
+static inline float shadowedDistance(QRgb x, const void* parameters, qint64 i)
+{
+    float c[3], mu[3];
+    float distance = pixelDistance<Pixel, Form>(x, parameters, i, c, mu);
+    return (Shadows && isShadow(c, mu)) ? 0.f : distance;
+}
+
+template <typename Pixel, typename Form, bool Shadows>
+static void distanceRow(const QImage& frame, int y, float* distances, const void* parameters, int modelWidth)
+{
+    const QRgb* imagePixel = (const QRgb*)frame.constScanLine(y);
+    qint64 row = (qint64)y * modelWidth;
+    int x = 0;
+
+#ifdef __SSE2__
+    if (Pixel::Simd)
+    {
+        for (; x < modelWidth && ((row + x) & 3); x++)
+            distances[x] = shadowedDistance<Pixel, Form, Shadows>(imagePixel[x], parameters, row + x);
+        for (; x + 4 <= modelWidth; x += 4)
+        {
+            __m128 cg[3], mug[3];
+            __m128 d = groupDistance<Form>(imagePixel + x, CompactStorage::group(parameters, row + x, Form::Stride), cg, mug);
+            if (Shadows)
+                d = _mm_andnot_ps(groupShadow(cg, mug), d);
+            _mm_storeu_ps(distances + x, d);
+        }
+    }
+#endif
+    for (; x < modelWidth; x++)
+        distances[x] = shadowedDistance<Pixel, Form, Shadows>(imagePixel[x], parameters, row + x);
+}
+
+template <typename Pixel, bool Shadows>
+static DistanceRows selectDistance(CovarianceType covariance)
+{
+    switch (covariance)
+    {
+    case DiagonalCovariance:
+        return distanceRow<Pixel, DiagonalForm, Shadows>;
+    case IsotropicCovariance:
+        return distanceRow<Pixel, IsotropicForm, Shadows>;
+    default:
+        return distanceRow<Pixel, FullForm, Shadows>;
+    }
+}
+
+template <typename Pixel, bool Shadows>
+static ClassifyRows selectForm(CovarianceType covariance)
+{
+    switch (covariance)
+    {
+    case DiagonalCovariance:
+        return classifyRows<Pixel, DiagonalForm, Shadows>;
+    case IsotropicCovariance:
+        return classifyRows<Pixel, IsotropicForm, Shadows>;
+    default:
+        return classifyRows<Pixel, FullForm, Shadows>;
+    }
+}
+
+static int parameterStride(CovarianceType covariance)
+{
+    switch (covariance)
+    {
+    case DiagonalCovariance:
+        return DiagonalForm::Stride;
+    case IsotropicCovariance:
+        return IsotropicForm::Stride;
+    default:
+        return FullForm::Stride;
+    }
+}
+
+// Суммы на точку цветной модели
+#define MomentCount 9
+
+// Строка сумм проходится по всем кадрам пачки, пока она в кэше
+template <typename Pixel>
+static void accumulateRows(const QImage* const* frames, int count, quint32* moments, int width, int height)
+{
+    for (int y = 0; y < height; y++, moments += width * MomentCount)
+        for (int f = 0; f < count; f++)
+        {
+            const QRgb* pixel = (const QRgb*)frames[f]->constScanLine(y);
+            quint32* m = moments;
+            for (int x = 0; x < width; x++, m += MomentCount)
+            {
+            quint32 c[3];
+            Pixel::components(pixel[x], c);
+            m[0] += c[0];
+            m[1] += c[1];
+            m[2] += c[2];
+            m[3] += c[0] * c[0];
+            m[4] += c[1] * c[1];
+            m[5] += c[2] * c[2];
+            m[6] += c[0] * c[1];
+            m[7] += c[0] * c[2];
+            m[8] += c[1] * c[2];
+            }
+        }
+}
+
+// Точек в блоке пакетной обработки finalize
+#define FinalizeBlock 256
+// Матрица ковариации считается вырожденной, если ее определитель меньше этой доли
+// произведения диагональных элементов (у невырожденной отношение в (0, 1])
+#define MinRelativeDet 1e-4f
+
+// Блок точек по столбцам: 0..2 - среднее, 3..8 - ковариация c00 c11 c22 c01 c02 c12,
+// после обращения 3..8 - параметры в порядке FullForm / DiagonalForm / IsotropicForm
+typedef float FinalizeBlockData[FullForm::Stride][FinalizeBlock];
+
+// Центральные моменты точно в целых: n^2 * c_ij = n * s_ij - s_i * s_j
+static void centralMoments(const quint32* m, int count, quint32 frames, FinalizeBlockData& b)
+{
+    qint64 n = frames;
+    float inverseN = 1.f / frames;
+    float inverseN2 = 1.f / ((float)frames * frames);
+    for (int j = 0; j < count; j++, m += MomentCount)
+    {
+        qint64 s0 = m[0], s1 = m[1], s2 = m[2];
+        b[0][j] = s0 * inverseN;
+        b[1][j] = s1 * inverseN;
+        b[2][j] = s2 * inverseN;
+        b[3][j] = (float)(n * m[3] - s0 * s0) * inverseN2;
+        b[4][j] = (float)(n * m[4] - s1 * s1) * inverseN2;
+        b[5][j] = (float)(n * m[5] - s2 * s2) * inverseN2;
+        b[6][j] = (float)(n * m[6] - s0 * s1) * inverseN2;
+        b[7][j] = (float)(n * m[7] - s0 * s2) * inverseN2;
+        b[8][j] = (float)(n * m[8] - s1 * s2) * inverseN2;
+    }
+}
+
+// Обращение полной матрицы через присоединенную, по 4 точки за раз.
+// Вырожденные точки получают диагональную модель. Возвращает их число
+static int invertFull(FinalizeBlockData& b, int count, float sigmamin)
+{
+    int degenerate = 0;
+    int j = 0;
+
+#ifdef __SSE2__
+    const __m128 minimum  = _mm_set1_ps(sigmamin);
+    const __m128 relative = _mm_set1_ps(MinRelativeDet);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 two = _mm_set1_ps(2.f);
+    for (; j + 4 <= count; j += 4)
+    {
+        __m128 s00 = _mm_max_ps(_mm_loadu_ps(b[3] + j), minimum);
+        __m128 s11 = _mm_max_ps(_mm_loadu_ps(b[4] + j), minimum);
+        __m128 s22 = _mm_max_ps(_mm_loadu_ps(b[5] + j), minimum);
+        __m128 s01 = _mm_loadu_ps(b[6] + j);
+        __m128 s02 = _mm_loadu_ps(b[7] + j);
+        __m128 s12 = _mm_loadu_ps(b[8] + j);
+
+        __m128 a00 = _mm_sub_ps(_mm_mul_ps(s11, s22), _mm_mul_ps(s12, s12));
+        __m128 a01 = _mm_sub_ps(_mm_mul_ps(s12, s02), _mm_mul_ps(s01, s22));
+        __m128 a02 = _mm_sub_ps(_mm_mul_ps(s01, s12), _mm_mul_ps(s11, s02));
+        __m128 a11 = _mm_sub_ps(_mm_mul_ps(s00, s22), _mm_mul_ps(s02, s02));
+        __m128 a12 = _mm_sub_ps(_mm_mul_ps(s01, s02), _mm_mul_ps(s00, s12));
+        __m128 a22 = _mm_sub_ps(_mm_mul_ps(s00, s11), _mm_mul_ps(s01, s01));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s00, a00), _mm_mul_ps(s01, a01)), _mm_mul_ps(s02, a02));
+
+        // NaN тоже не проходит сравнение
+        __m128 scale = _mm_mul_ps(_mm_mul_ps(s00, s11), s22);
+        __m128 ok = _mm_cmpgt_ps(det, _mm_mul_ps(relative, scale));
+        degenerate += 4 - popcount4[_mm_movemask_ps(ok)];
+
+        __m128 inverseDet = _mm_div_ps(one, det);
+        __m128 twiceInverseDet = _mm_mul_ps(two, inverseDet);
+        _mm_storeu_ps(b[3] + j, select(ok, _mm_mul_ps(a00, inverseDet), _mm_div_ps(one, s00)));
+        _mm_storeu_ps(b[4] + j, select(ok, _mm_mul_ps(a11, inverseDet), _mm_div_ps(one, s11)));
+        _mm_storeu_ps(b[5] + j, select(ok, _mm_mul_ps(a22, inverseDet), _mm_div_ps(one, s22)));
+        _mm_storeu_ps(b[6] + j, _mm_and_ps(ok, _mm_mul_ps(a01, twiceInverseDet)));
+        _mm_storeu_ps(b[7] + j, _mm_and_ps(ok, _mm_mul_ps(a02, twiceInverseDet)));
+        _mm_storeu_ps(b[8] + j, _mm_and_ps(ok, _mm_mul_ps(a12, twiceInverseDet)));
+    }
+#endif
+
+    // Остаток - те же действия по одной точке
+    for (; j < count; j++)
+    {
+        float s00 = qMax(b[3][j], sigmamin);
+        float s11 = qMax(b[4][j], sigmamin);
+        float s22 = qMax(b[5][j], sigmamin);
+        float s01 = b[6][j], s02 = b[7][j], s12 = b[8][j];
+
+        float a00 = s11 * s22 - s12 * s12;
+        float a01 = s12 * s02 - s01 * s22;
+        float a02 = s01 * s12 - s11 * s02;
+        float a11 = s00 * s22 - s02 * s02;
+        float a12 = s01 * s02 - s00 * s12;
+        float a22 = s00 * s11 - s01 * s01;
+        float det = (s00 * a00 + s01 * a01) + s02 * a02;
+
+        float scale = (s00 * s11) * s22;
+        if (det > MinRelativeDet * scale)
+        {
+            float inverseDet = 1.f / det;
+            float twiceInverseDet = 2.f * inverseDet;
+            b[3][j] = a00 * inverseDet;
+            b[4][j] = a11 * inverseDet;
+            b[5][j] = a22 * inverseDet;
+            b[6][j] = a01 * twiceInverseDet;
+            b[7][j] = a02 * twiceInverseDet;
+            b[8][j] = a12 * twiceInverseDet;
+        }
+        else
+        {
+            degenerate++;
+            b[3][j] = 1.f / s00;
+            b[4][j] = 1.f / s11;
+            b[5][j] = 1.f / s22;
+            b[6][j] = b[7][j] = b[8][j] = 0;
+        }
+    }
+    return degenerate;
+}
+
+static void invertDiagonal(FinalizeBlockData& b, int count, float sigmamin, CovarianceType covariance)
+{
+    for (int j = 0; j < count; j++)
+    {
+        float s00 = qMax(b[3][j], sigmamin);
+        float s11 = qMax(b[4][j], sigmamin);
+        float s22 = qMax(b[5][j], sigmamin);
+        if (covariance == IsotropicCovariance)
+            b[3][j] = 3.f / (s00 + s11 + s22);
+        else
+        {
+            b[3][j] = 1.f / s00;
+            b[4][j] = 1.f / s11;
+            b[5][j] = 1.f / s22;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// \brief BackgroundModel::BackgroundModel
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+BackgroundModel::BackgroundModel() :
+    modelWidth(0), modelHeight(0), covariance(FullCovariance), space(RgbSpace), sigmamin(5), shadows(false), kFactor(k), threshold((float)(k * k * k) * (k * k * k)), frameCount(0),
+    finalizeTime(0), degenerateCount(0)
+{
+}
+
+BackgroundModel::~BackgroundModel()
+{
+    clear();
+}
+
+void BackgroundModel::create(int width, int height, bool gray_, float sigmamin_,
+                             CovarianceType covariance_, ColorSpace space_)
+{
+    clear();
+    modelWidth = width;
+    modelHeight= height;
+    covariance = covariance_;
+    space = space_;
+    sigmamin = sigmamin_;
+
+    int n = width * height;
+    if (gray_)
+        gray.fill(GaussianGray(sigmamin), n);
+    else
+        moments.fill(0, n * MomentCount);
+}
+
+void BackgroundModel::clear()
+{
+    gray.clear();
+    moments.clear();
+    parameters.clear();
+    compactParameters.clear();
+    frameCount = 0;
+    degenerateCount = 0;
+    modelWidth = modelHeight = 0;
+}
+
+void BackgroundModel::addFrame(const QImage &frame)
+{
+    const QImage* frames[1] = { &frame };
+    addFrames(frames, 1);
+}
+
+void BackgroundModel::addFrames(const QImage * const *frames, int count)
+{
+    if (isGray())
+    {
+        for (int f = 0; f < count; f++)
+            for (int y = 0, j = 0; y < modelHeight; y++)
+            {
+                const uchar* pixel = frames[f]->constScanLine(y);
+                for (int x = 0; x < modelWidth; x++, j++)
+                    gray[j].addItem(pixel[x]);
+            }
+    }
+    else
+    {
+        count = qMin(count, MaxLearningFrames - (int)frameCount);
+        if (count <= 0)
+            return;
+        if (space == HsvSpace)
+            accumulateRows<HsvPixel>(frames, count, moments.data(), modelWidth, modelHeight);
+        else
+            accumulateRows<RgbPixel>(frames, count, moments.data(), modelWidth, modelHeight);
+        frameCount += count;
+    }
+}
+
+void BackgroundModel::merge(const BackgroundModel &other, int part, int parts)
+{
+    int first = modelHeight * part / parts;
+    int last  = modelHeight * (part + 1) / parts;
+
+    if (isGray())
+    {
+        for (int j = first * modelWidth; j < last * modelWidth; j++)
+            gray[j].merge(other.gray.at(j));
+    }
+    else
+    {
+        // Суммы целые, поэтому результат не зависит от порядка слияния
+        quint32* m = moments.data() + first * modelWidth * MomentCount;
+        const quint32* o = other.moments.constData() + first * modelWidth * MomentCount;
+        int n = (last - first) * modelWidth * MomentCount;
+        for (int i = 0; i < n; i++)
+            m[i] += o[i];
+        if (part == 0)
+            frameCount += other.frameCount;
+    }
+}
+
+void BackgroundModel::finalize()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int j = 0; j < gray.size(); j++)
+        gray[j].finalize();
+
+    parameters.clear();
+    compactParameters.clear();
+    degenerateCount = 0;
+    if (!moments.isEmpty() && frameCount > 0)
+    {
+        // Блоками: моменты -> ковариации по столбцам -> обращение -> параметры точек подряд
+        int stride = parameterStride(covariance);
+        int n = modelWidth * modelHeight;
+        int groupSize = compactGroupSize(stride);
+        if (space == HsvSpace)
+            parameters.resize((n + 3) / 4 * 4 * stride);
+        else
+            compactParameters.fill(0, (n + 3) / 4 * groupSize + CompactAlignment - 1);
+
+        FinalizeBlockData block;
+        for (int first = 0; first < n; first += FinalizeBlock)
+        {
+            int count = qMin(FinalizeBlock, n - first);
+            centralMoments(moments.constData() + first * MomentCount, count, frameCount, block);
+            if (covariance == FullCovariance)
+                degenerateCount += invertFull(block, count, sigmamin);
+            else
+                invertDiagonal(block, count, sigmamin, covariance);
+
+            // first кратно 4: блок занимает целые четверки
+            if (space == HsvSpace)
+            {
+                float* p = parameters.data();
+                for (int j = 0; j < count; j++)
+                    for (int r = 0; r < stride; r++)
+                        p[parameterIndex(first + j, stride, r)] = block[r][j];
+            }
+            else
+            {
+                uchar* g = compactGroups() + (qint64)first / 4 * groupSize;
+                for (int j = 0; j < count; j += 4, g += groupSize)
+                    for (int lane = 0; lane < 4 && j + lane < count; lane++)
+                    {
+                        quint16* h = (quint16*)(g + 16);
+                        for (int c = 0; c < 3; c++)
+                            g[4 * c + lane] = (uchar)qBound(0, qRound(block[c][j + lane]), 255);
+                        for (int r = 0; r < stride - 3; r++)
+                            h[4 * r + lane] = toHalf(block[3 + r][j + lane]);
+                    }
+            }
+        }
+    }
+
+    finalizeTime = timer.nsecsElapsed();
+}
+
+bool BackgroundModel::acceptsFrame(const QImage &frame) const
+{
+    if (frame.width() < modelWidth || frame.height() < modelHeight)
+        return false;
+    return isGray() ? isGrayscale(frame) : frame.depth() == 32;
+}
+
+void BackgroundModel::classify(const QImage &frame, QImage &mask) const
+{
+    classify(frame, mask, QRect(0, 0, modelWidth, modelHeight));
+}
+
+void BackgroundModel::classify(const QImage &frame, QImage &mask, const QRect &rect) const
+{
+    if (!acceptsFrame(frame))
+        return;
+
+    int x0 = rect.left(), x1 = rect.right();
+
+    if (isGray())
+    {
+        for (int y = rect.top(); y <= rect.bottom(); y++)
+        {
+            const uchar* imagePixel = frame.constScanLine(y);
+            uchar* maskPixel = mask.scanLine(y);
+            const GaussianGray* model = gray.constData() + y * modelWidth;
+            for (int x = x0; x <= x1; x++)
+                maskPixel[x] = (uchar)(model[x].distance(imagePixel[x]) >= threshold);
+        }
+    }
+    else if (hasParameters())
+    {
+        // Тени определяются по цвету RGB, в HSV стадия не применяется
+        ClassifyRows classifyRect;
+        if (space == HsvSpace)
+            classifyRect = selectForm<HsvPixel, false>(covariance);
+        else if (shadows)
+            classifyRect = selectForm<RgbPixel, true>(covariance);
+        else
+            classifyRect = selectForm<RgbPixel, false>(covariance);
+        classifyRect(frame, mask, rect, classifierParameters(), modelWidth, threshold);
+    }
+}
+
+void BackgroundModel::distances(const QImage &frame, QVector<float> &result) const
+{
+    if (!acceptsFrame(frame))
+        return;
+
+    result.resize(modelWidth * modelHeight);
+    for (int y = 0; y < modelHeight; y++)
+        distanceRow(frame, y, result.data() + y * modelWidth);
+}
+
+void BackgroundModel::distances(const QImage &frame, DistanceMap &map) const
+{
+    if (!acceptsFrame(frame))
+        return;
+
+    // Строка расстояний остается в кэше до квантования
+    QVector<float> row(modelWidth);
+    for (int y = 0; y < modelHeight; y++)
+    {
+        distanceRow(frame, y, row.data());
+        map.setRow(y, row.constData());
+    }
+}
+
+void BackgroundModel::distanceRow(const QImage &frame, int y, float *result) const
+{
+    if (isGray())
+    {
+        const uchar* imagePixel = frame.constScanLine(y);
+        const GaussianGray* model = gray.constData() + y * modelWidth;
+        for (int x = 0; x < modelWidth; x++)
+            result[x] = model[x].distance(imagePixel[x]);
+    }
+    else if (hasParameters())
+    {
+        // Тени - как в classify(): только RGB
+        DistanceRows rowDistances;
+        if (space == HsvSpace)
+            rowDistances = selectDistance<HsvPixel, false>(covariance);
+        else if (shadows)
+            rowDistances = selectDistance<RgbPixel, true>(covariance);
+        else
+            rowDistances = selectDistance<RgbPixel, false>(covariance);
+        rowDistances(frame, y, result, classifierParameters(), modelWidth);
+    }
+}
+
+bool BackgroundModel::hasParameters() const
+{
+    return !parameters.isEmpty() || !compactParameters.isEmpty();
+}
+
+uchar* BackgroundModel::compactGroups()
+{
+    quintptr data = (quintptr)compactParameters.data();
+    return (uchar*)((data + CompactAlignment - 1) & ~(quintptr)(CompactAlignment - 1));
+}
+
+const void* BackgroundModel::classifierParameters() const
+{
+    if (space == HsvSpace)
+        return parameters.constData();
+    quintptr data = (quintptr)compactParameters.constData();
+    return (const void*)((data + CompactAlignment - 1) & ~(quintptr)(CompactAlignment - 1));
+}
+
+void BackgroundModel::setThresholdK(float k_)
+{
+    kFactor = k_;
+    threshold = (k_ * k_ * k_) * (k_ * k_ * k_);
+}
+
+void BackgroundModel::setSigmaMin(float sigmamin_)
+{
+    sigmamin = sigmamin_;
+    for (int j = 0; j < gray.size(); j++)
+        gray[j].sigmamin = sigmamin_;
+}
+
+void BackgroundModel::meanLuminance(QImage &luma) const
+{
+    if (isGray())
+    {
+        luma = QImage(modelWidth, modelHeight, QImage::Format_Indexed8);
+        luma.setColorTable(grayColorTable());
+        for (int y = 0, i = 0; y < modelHeight; y++)
+        {
+            uchar* pixel = luma.scanLine(y);
+            for (int x = 0; x < modelWidth; x++, i++)
+                pixel[x] = qBound(0, qRound(gray[i].mu), 255);
+        }
+    }
+    else if (hasParameters())
+    {
+        QImage background(modelWidth, modelHeight, QImage::Format_RGB32);
+        int stride = parameterStride(covariance);
+        const void* p = classifierParameters();
+        for (int y = 0, i = 0; y < modelHeight; y++)
+        {
+            QRgb* pixel = (QRgb*)background.scanLine(y);
+            for (int x = 0; x < modelWidth; x++, i++)
+            {
+                float mu[3], a[FullForm::Stride - 3];
+                if (space == HsvSpace)
+                    FloatStorage::load(p, i, stride, mu, a);
+                else
+                    CompactStorage::load(p, i, stride, mu, a);
+                pixel[x] = qRgb(qBound(0, (int)mu[0], 255),
+                                qBound(0, (int)mu[1], 255),
+                                qBound(0, (int)mu[2], 255));
+            }
+        }
+        luminance(background, luma);
+    }
+}
+
+void BackgroundModel::save(QDataStream &stream) const
+{
+    stream << (qint32)modelWidth << (qint32)modelHeight << (quint8)isGray()
+           << (quint8)covariance << (quint8)space << sigmamin;
+    if (isGray())
+    {
+        foreach (const GaussianGray& pixel, gray)
+            stream << pixel.count << pixel.sum << pixel.sum2;
+    }
+    else
+    {
+        stream << frameCount;
+        stream.writeRawData((const char*)moments.constData(), moments.size() * sizeof(quint32));
+    }
+}
+
+bool BackgroundModel::load(QDataStream &stream)
+{
+    qint32 width, height;
+    quint8 grayModel, covariance_, space_;
+    float sigmamin_;
+    stream >> width >> height >> grayModel >> covariance_ >> space_ >> sigmamin_;
+    if (stream.status() != QDataStream::Ok || width < 0 || height < 0 || width > MaxModelSide || height > MaxModelSide
+            || covariance_ > IsotropicCovariance || space_ > HsvSpace)
+        return false;
+
+    // Поврежденный или обрезанный файл не должен приводить к выделению памяти под несуществующие суммы
+    qint64 pixels = (qint64)width * height;
+    qint64 needed = grayModel ? pixels * (sizeof(quint32) + 2 * sizeof(quint64))
+                              : sizeof(quint32) + pixels * MomentCount * sizeof(quint32);
+    if (!stream.device() || stream.device()->bytesAvailable() < needed)
+        return false;
+
+    create(width, height, grayModel != 0, sigmamin_, (CovarianceType)covariance_, (ColorSpace)space_);
+    if (isGray())
+    {
+        for (int j = 0; j < gray.size(); j++)
+            stream >> gray[j].count >> gray[j].sum >> gray[j].sum2;
+    }
+    else
+    {
+        int bytes = moments.size() * sizeof(quint32);
+        stream >> frameCount;
+        if (stream.readRawData((char*)moments.data(), bytes) != bytes)
+        {
+            clear();
+            return false;
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// \brief Gaussian::Gaussian
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+Gaussian::Gaussian(float _sirmamin, bool fullMatrix, bool hsv) :
+    usingRealTime(false), usingFullMastrix(fullMatrix), usingHsv(hsv)
+{
+    sigmamin = _sirmamin;
+    isNotFinalized = true;
+}
+
+void Gaussian::addItem(QRgb x_)
+{
+    RgbColor x;
+    if (usingHsv)
+    {
+        int h, s, v;
+        toHsv(x_, h, s, v);
+
+        x.R = h;
+        x.G = s;
+        x.B = v;
+    }
+    else
+    {
+        x.B = x_ & 0xFF;
+        x_ >>= 8;
+        x.G = x_ & 0xFF;
+        x_ >>= 8;
+        x.R = x_ & 0xFF;
+    }
+    points << x;
+    isNotFinalized = true;
+}
+/*
+void Gaussian::addItemMix(QRgb x_)
+{
+    // Реализация для смешивания
+    RgbColor x;
+    if (usingHsv)
+    {
+        QColor hsv(x_);
+
+        x.R = hsv.hsvHue();
+        x.G = hsv.hsvSaturation();
+        x.B = hsv.value();
+    }
+    else
+    {
+        x.B = x_ & 0xFF;
+        x_ >>= 8;
+        x.G = x_ & 0xFF;
+        x_ >>= 8;
+        x.R = x_ & 0xFF;
+    }
+
+    if (!usingRealTime)
+    {
+        usingRealTime = true;
+        mu.R = x.R;
+        mu.G = x.G;
+        mu.B = x.B;
+
+        memset(&sigma, 0, sizeof(sigma));
+        memset(&inver, 0, sizeof(inver));
+
+
+    }
+
+
+
+}*/
+
+float Gaussian::p(uchar x)
+{
+    /*float expPower = (float)x - mu;
+    expPower *= expPower * sigma_2;
+    expPower = (float)exp((double)expPower);
+
+    static float coef = 1. / sqrt(2* M_PI);
+
+    return coef * expPower * sigma_sqrt_1;*/
+    return 0;
+}
+
+bool Gaussian::isBackground(QRgb x_)
+{
+    if (isNotFinalized)
+        finalize();
+
+    if (isNotFinalized)
+    {
+        return -1;
+    }
+
+    RgbColor x;
+    if (usingHsv)
+    {
+        QColor hsv(x_);
+        x.R = hsv.hslHue();
+        x.G = hsv.hslSaturation();
+        x.B = hsv.value();
+    }
+    else
+    {
+        x.B = x_ & 0xFF;
+        x_ >>= 8;
+        x.G = x_ & 0xFF;
+        x_ >>= 8;
+        x.R = x_ & 0xFF;
+    }
+
+    float x_mu[3];
+    x_mu[0] = ((float)x.R - mu.Rf);
+    if (x_mu[0] < 0)
+        x_mu[0] = -x_mu[0];
+
+    x_mu[1] = ((float)x.G - mu.Gf);
+    if (x_mu[1] < 0)
+        x_mu[1] = -x_mu[1];
+
+    x_mu[2] = ((float)x.B - mu.Bf);
+    if (x_mu[2] < 0)
+        x_mu[2] = -x_mu[2];
+
+    double expPower;
+    if (usingFullMastrix)
+    {
+        expPower = x_mu[0] * (inver[0][0] * x_mu[0] + inver[0][1] * x_mu[1] + inver[0][2] * x_mu[2])
+                 + x_mu[1] * (inver[1][0] * x_mu[0] + inver[1][1] * x_mu[1] + inver[1][2] * x_mu[2])
+                 + x_mu[2] * (inver[2][0] * x_mu[0] + inver[2][1] * x_mu[1] + inver[2][2] * x_mu[2]);
+                    //(x - mu) * inv * (x - mu) * 0.5;
+        if (expPower < 0)
+            expPower = -expPower;
+
+        expPower = sqrt(expPower);
+    }
+    else
+    {
+        expPower = x_mu[0] + x_mu[1] + x_mu[2];
+        expPower /= detSqrt;
+    }
+    return (expPower < k * k * k) ? true : false;
+}
+
+void Gaussian::finalize()
+{
+    memset(&mu, 0, sizeof(mu));
+    memset(&sigma, 0, sizeof(sigma));
+
+    int size = points.size();
+
+    foreach (RgbColor iter, points) {
+        mu.Rf += iter.R;
+        mu.Gf += iter.G;
+        mu.Bf += iter.B;
+    }
+    mu.Rf /= size; mu.Gf /= size; mu.Bf /= size;
+
+    if (usingFullMastrix)
+    {
+        foreach (RgbColor iter, points) {
+            sigma[0][0] += (iter.R - mu.Rf) * (iter.R - mu.Rf);
+            sigma[0][1] += (iter.R - mu.Rf) * (iter.G - mu.Gf);
+            sigma[0][2] += (iter.R - mu.Rf) * (iter.B - mu.Bf);
+
+            sigma[1][1] += (iter.G - mu.Gf) * (iter.G - mu.Gf);
+            sigma[1][2] += (iter.G - mu.Gf) * (iter.B - mu.Bf);
+
+            sigma[2][2] += (iter.B - mu.Bf) * (iter.B - mu.Bf);
+        }
+        sigma[0][0] /= size; sigma[0][1] /= size; sigma[0][2] /= size;
+                             sigma[1][1] /= size; sigma[1][2] /= size;
+                                                  sigma[2][2] /= size;
+
+        sigma[1][0] = sigma[0][1];
+        sigma[2][0] = sigma[0][2]; sigma[2][1] = sigma[1][2];
+    }
+    else
+    {
+        foreach (RgbColor iter, points) {
+            sigma[0][0] += (iter.R - mu.Rf) * (iter.R - mu.Rf);
+            sigma[1][1] += (iter.G - mu.Gf) * (iter.G - mu.Gf);
+            sigma[2][2] += (iter.B - mu.Bf) * (iter.B - mu.Bf);
+        }
+        sigma[0][0] /= size; sigma[1][1] /= size; sigma[2][2] /= size;
+    }
+
+    if (sigma[0][0] < sigmamin)
+        sigma[0][0] = sigmamin;
+    if (sigma[1][1] < sigmamin)
+        sigma[1][1] = sigmamin;
+    if (sigma[2][2] < sigmamin)
+        sigma[2][2] = sigmamin;
+
+    if (usingFullMastrix)
+    {
+        inver[0][0] = sigma[1][1] * sigma[2][2] - sigma[1][2] * sigma[2][1];
+        inver[1][0] = sigma[1][2] * sigma[2][0] - sigma[1][0] * sigma[2][2];
+        inver[2][0] = sigma[1][0] * sigma[2][1] - sigma[1][1] * sigma[2][0];
+
+        inver[0][1] = inver[1][0];
+        inver[1][1] = sigma[0][0] * sigma[2][2] - sigma[0][2] * sigma[2][0];
+        inver[2][1] = sigma[0][1] * sigma[2][0] - sigma[0][0] * sigma[2][1];
+
+        inver[0][2] = inver[2][0];
+        inver[1][2] = inver[2][1];
+        inver[2][2] = sigma[0][0] * sigma[1][1] - sigma[0][1] * sigma[1][0];
+
+        det = sigma[0][0] * inver[0][0] + sigma[0][1] * inver[0][1]
+            + sigma[0][2] * inver[0][2];
+
+        if (det < 0)
+            detSqrt = sqrt(-det);
+        else
+            detSqrt = sqrt(det);
+
+        inver[0][0] /= det;        inver[0][1] /= det;        inver[0][2] /= det;
+        inver[1][0] = inver[0][1]; inver[1][1] /= det;        inver[1][2] /= det;
+        inver[2][0] = inver[0][2]; inver[2][1] = inver[1][2]; inver[2][2] /= det;
+    }
+    else
+    {
+        inver[0][0] = 1. / sigma[0][0]; inver[1][1] = 1. / sigma[1][1]; inver[2][2] = 1. / sigma[2][2];
+
+        det = sigma[0][0] + sigma[1][1] + sigma[2][2];
+        detSqrt = sqrt(det);
+    }
+
+    isNotFinalized = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// \brief GaussianGray::GaussianGray
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+GaussianGray::GaussianGray(float _sigmamin) :
+    mu(0), sigma(0), inver(0), sigmamin(_sigmamin), count(0), sum(0), sum2(0)
+{
+}
+
+void GaussianGray::addItem(uchar x)
+{
+    count++;
+    sum  += x;
+    sum2 += x * x;
+}
+
+void GaussianGray::finalize()
+{
+    if (count == 0)
+        return;
+
+    // Суммы целые, поэтому точность не теряется на длинных последовательностях
+    mu = (float)((double)sum / count);
+    sigma = (float)((double)sum2 / count - (double)mu * mu);
+    if (sigma < sigmamin)
+        sigma = sigmamin;
+    inver = 1.f / sigma;
+}
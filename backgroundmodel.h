@@ -0,0 +1,217 @@
+#ifndef BACKGROUNDMODEL_H
+#define BACKGROUNDMODEL_H
+// Попиксельная модель фона: нормальное распределение цвета или яркости
+// в каждой точке кадра, обученное по кадрам без объектов.
+
+#include <QDataStream>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QVector>
+
+#include "distancemap.h"
+
+#define k 3
+#define rho 0.01
+// Суммы цветной модели 32-битные: квадрат оттенка HSV (до 359^2) не переполняет их
+// на таком числе кадров
+#define MaxLearningFrames 32768
+// Наибольшая сторона кадра модели, читаемой из файла
+#define MaxModelSide 16384
+
+// Подавление теней и бликов: яркость относительно фона и наибольший синус угла
+// между цветом точки и средним цветом фона
+#define ShadowMinBrightness 0.4f
+#define HighlightMaxBrightness 1.25f
+#define ShadowChromaticity 0.1f
+
+// Вид матрицы ковариации цветной модели
+enum CovarianceType { FullCovariance, DiagonalCovariance, IsotropicCovariance };
+// Пространство, в котором строится цветная модель
+enum ColorSpace { RgbSpace, HsvSpace };
+
+struct RgbColor
+{
+    unsigned int R, G, B;
+};
+
+struct RgbColorF
+{
+    float Rf, Gf, Bf;
+};
+
+class Gaussian
+{
+private:
+    float sigma[3][3];
+    float inver[3][3];
+    float sigma_k;
+    QList<RgbColor> points;
+
+    bool isNotFinalized;
+    bool usingRealTime;
+    bool usingFullMastrix;
+    bool usingHsv;
+
+public:
+    float sigmamin;
+
+    RgbColorF mu;
+    float det;
+    float detSqrt;
+    float det3Rt;
+
+    Gaussian(float _sirmamin = 5, bool fullMatrix = true, bool hsv = false);
+
+    void finalize();
+    void addItem(QRgb x_);
+    //void addItemMix(QRgb x_);
+
+    float p(uchar x);
+    bool isBackground(QRgb x_);
+};
+
+// Модель фона по одной яркости: в 4 раза меньше данных на точку, чем у Gaussian,
+// вместо списка точек копятся суммы
+class GaussianGray
+{
+public:
+    float mu;
+    float sigma;
+    float inver;
+    float sigmamin;
+
+    GaussianGray(float _sigmamin = 5);
+
+    void addItem(uchar x);
+    void finalize();
+
+    // Тот же критерий, что у Gaussian: расстояние Махаланобиса меньше k^3
+    inline bool isBackground(uchar x) const
+    {
+        return distance(x) < (float)(k * k * k) * (k * k * k);
+    }
+    // Квадрат расстояния Махаланобиса
+    inline float distance(uchar x) const
+    {
+        float d = (float)x - mu;
+        return d * d * inver;
+    }
+
+    void merge(const GaussianGray& other)
+    {
+        count += other.count;
+        sum  += other.sum;
+        sum2 += other.sum2;
+    }
+
+private:
+    friend class BackgroundModel;
+
+    quint32 count;
+    quint64 sum;
+    quint64 sum2;
+};
+
+// Модель всего кадра. Цветная или по яркости (GaussianGray) - определяется форматом
+// кадров, на которых она создана. Цветная модель копит целые суммы компонент и их
+// попарных произведений, поэтому модели по разным частям кадров можно сложить
+class BackgroundModel
+{
+public:
+    BackgroundModel();
+    ~BackgroundModel();
+
+    void create(int width, int height, bool gray, float sigmamin,
+                CovarianceType covariance = FullCovariance, ColorSpace space = RgbSpace);
+    void clear();
+
+    bool isEmpty() const { return modelWidth == 0; }
+    bool isGray() const  { return !gray.isEmpty(); }
+    int width() const  { return modelWidth; }
+    int height() const { return modelHeight; }
+
+    // Не больше MaxLearningFrames кадров на модель
+    void addFrame(const QImage& frame);
+    // То же для нескольких кадров сразу - суммы читаются из памяти один раз на пачку
+    void addFrames(const QImage* const* frames, int count);
+    // Добавляет суммы other (того же размера и вида) в строках части part из parts.
+    // Разные части можно сливать параллельно, число кадров переносит часть 0
+    void merge(const BackgroundModel& other, int part = 0, int parts = 1);
+    // Вырожденные матрицы ковариации заменяются диагональными
+    void finalize();
+    // Время последнего finalize(), нс, и число точек с вырожденной ковариацией
+    qint64 lastFinalizeTime() const { return finalizeTime; }
+    int degeneratePixels() const { return degenerateCount; }
+
+    CovarianceType covarianceType() const { return covariance; }
+    ColorSpace colorSpace() const { return space; }
+
+    // Порог: точка - фон, если расстояние Махаланобиса меньше k^3 (по умолчанию k из макроса)
+    void setThresholdK(float k_);
+    float thresholdK() const { return kFactor; }
+    // Новый sigmamin применяется при следующем finalize(); суммы обучения сохраняются
+    void setSigmaMin(float sigmamin_);
+    float sigmaMin() const { return sigmamin; }
+
+    // Тени и блики фона (тот же цвет, другая яркость) не считаются передним планом.
+    // Только цветная модель в RGB
+    void setShadowSuppression(bool enabled) { shadows = enabled; }
+    bool shadowSuppression() const { return shadows; }
+
+    // Кадр вида модели не меньше ее размера: для серой - Indexed8 с серой палитрой, для цветной -
+    // 32 бита на точку. Другие кадры classify() и distances() не читают
+    bool acceptsFrame(const QImage& frame) const;
+
+    // mask - Indexed8 размера модели: 0 - фон, 1 - передний план. Только после finalize()
+    void classify(const QImage& frame, QImage& mask) const;
+    // Только точки внутри rect, остальная маска не меняется
+    void classify(const QImage& frame, QImage& mask, const QRect& rect) const;
+    // Квадраты расстояний Махаланобиса всех точек кадра, по строкам. При подавлении теней у теней
+    // и бликов расстояние 0: маска по любому порогу совпадает с classify()
+    void distances(const QImage& frame, QVector<float>& result) const;
+    // То же, квантованное в map (созданную заранее размера модели)
+    void distances(const QImage& frame, DistanceMap& map) const;
+
+    // Средние значения модели в виде яркости
+    void meanLuminance(QImage& luma) const;
+
+    // Суммы обучения и вид модели. load() создает модель заново, после него нужен finalize().
+    // Суммы пишутся в порядке байт машины: файл для продолжения работы здесь же, не для обмена
+    void save(QDataStream& stream) const;
+    bool load(QDataStream& stream);
+
+private:
+    Q_DISABLE_COPY(BackgroundModel)
+
+    void distanceRow(const QImage& frame, int y, float* result) const;
+    bool hasParameters() const;
+    // Начало выровненных четверок сжатой модели
+    uchar* compactGroups();
+    const void* classifierParameters() const;
+
+    int modelWidth, modelHeight;
+    CovarianceType covariance;
+    ColorSpace space;
+    float sigmamin;
+    bool shadows;
+    float kFactor;
+    // Квадрат порога расстояния: (k^3)^2
+    float threshold;
+    QVector<GaussianGray> gray;
+
+    // Цветная модель при обучении: на точку s0 s1 s2, s00 s11 s22, s01 s02 s12
+    quint32 frameCount;
+    QVector<quint32> moments;
+
+    qint64 finalizeTime;
+    int degenerateCount;
+
+    // Параметры цветной модели для классификации: среднее и нужная часть обратной
+    // матрицы ковариации, четверками точек. HSV - в float (см. parameterIndex),
+    // RGB - сжатые: среднее u8, обратная матрица в half float (см. CompactStorage)
+    QVector<float> parameters;
+    QVector<uchar> compactParameters;
+};
+
+#endif // BACKGROUNDMODEL_H
@@ -0,0 +1,419 @@
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include "batch.h"
+#include "checkpoint.h"
+#include "framesource.h"
+#include "maskarchive.h"
+#include "recognizer.h"
+#include "session.h"
+
+static const char* const statusNames[] = { "pending", "done", "skipped", "failed" };
+
+// Текстовое поле CSV в кавычках, кавычки внутри удваиваются
+static QString quoted(const QString& text)
+{
+    return "\"" + QString(text).replace("\"", "\"\"") + "\"";
+}
+
+BatchSequence::BatchSequence() :
+    learnFirst(0), learnLast(0), status(Pending), frames(0), resumedFrom(0), learnTime(0), recognizeTime(0), tracks(0),
+    worker(-1)
+{
+}
+
+// Поток пакета: берет последовательности, пока они есть
+class BatchTask : public QRunnable
+{
+public:
+    BatchTask(BatchScheduler* scheduler_, int worker_) :
+        scheduler(scheduler_), worker(worker_)
+    {
+    }
+
+    void run()
+    {
+        for (int i = scheduler->take(worker); i >= 0; i = scheduler->take(worker))
+        {
+            BatchSequence* sequence = scheduler->entries.at(i);
+            sequence->worker = worker;
+            scheduler->process(*sequence);
+        }
+    }
+
+private:
+    BatchScheduler* scheduler;
+    int worker;
+};
+
+BatchScheduler::BatchScheduler() :
+    steals(0), recording(false), wallTime(0)
+{
+}
+
+BatchScheduler::~BatchScheduler()
+{
+    qDeleteAll(locks);
+}
+
+bool BatchScheduler::loadManifest(const QString &fileName, QString &error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = "Не удалось открыть манифест " + fileName;
+        return false;
+    }
+
+    QDir base = QFileInfo(fileName).absoluteDir();
+    QTextStream stream(&file);
+    items.clear();
+    for (int line = 1; !stream.atEnd(); line++)
+    {
+        QString text = stream.readLine().trimmed();
+        if (text.isEmpty() || text.startsWith('#'))
+            continue;
+
+        QStringList fields = text.split(';');
+        bool firstOk = false, lastOk = false;
+        BatchSequence sequence;
+        if (fields.size() == 4)
+        {
+            sequence.input = base.absoluteFilePath(fields.at(0).trimmed());
+            sequence.learnFirst = fields.at(1).trimmed().toInt(&firstOk);
+            sequence.learnLast = fields.at(2).trimmed().toInt(&lastOk);
+            sequence.output = base.absoluteFilePath(fields.at(3).trimmed());
+        }
+        if (!firstOk || !lastOk || sequence.learnFirst < 0 || sequence.learnLast < sequence.learnFirst)
+        {
+            error = QString("Ошибка в строке %1 манифеста").arg(line);
+            return false;
+        }
+        items << sequence;
+    }
+    return true;
+}
+
+int BatchScheduler::take(int worker)
+{
+    {
+        QMutexLocker locker(locks.at(worker));
+        if (!queues.at(worker).isEmpty())
+            return queues[worker].takeFirst();
+    }
+
+    // Своя очередь пуста - забираем из конца самой длинной чужой: там самые короткие последовательности
+    for (;;)
+    {
+        int victim = -1, longest = 0;
+        for (int i = 0; i < queues.size(); i++)
+        {
+            if (i == worker)
+                continue;
+            QMutexLocker locker(locks.at(i));
+            if (queues.at(i).size() > longest)
+            {
+                longest = queues.at(i).size();
+                victim = i;
+            }
+        }
+        if (victim < 0)
+            return -1;
+
+        QMutexLocker locker(locks.at(victim));
+        if (queues.at(victim).isEmpty())
+            continue;   // очередь опустела, пока выбирали
+        QMutexLocker statsLocker(&statsLock);
+        steals++;
+        return queues[victim].takeLast();
+    }
+}
+
+void BatchScheduler::run(int threads)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    threads = qMax(1, qMin(threads, items.size()));
+    qDeleteAll(locks);
+    locks.clear();
+    queues.clear();
+    queues.resize(threads);
+    for (int i = 0; i < threads; i++)
+        locks << new QMutex;
+    steals = 0;
+
+    // Указатели берутся до запуска потоков: неконстантный доступ к items из потоков мог бы отделить список
+    entries.clear();
+    for (int i = 0; i < items.size(); i++)
+        entries << &items[i];
+
+    // Оценка длины - размер входа; большие последовательности раздаются первыми
+    QList<QPair<qint64, int> > order;
+    for (int i = 0; i < items.size(); i++)
+    {
+        QFileInfo info(items.at(i).input);
+        qint64 size = info.isDir() ? FrameSource::imageCount(info.filePath()) : info.size();
+        order << qMakePair(-size, i);
+    }
+    qSort(order);
+    for (int i = 0; i < order.size(); i++)
+        queues[i % threads] << order.at(i).second;
+
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(threads);
+    for (int worker = 0; worker < threads; worker++)
+        threadPool.start(new BatchTask(this, worker));
+    threadPool.waitForDone();
+
+    wallTime = timer.elapsed();
+}
+
+void BatchScheduler::process(BatchSequence &sequence)
+{
+    QString doneName = sequence.output + ".done";
+    if (QFile::exists(doneName))
+    {
+        sequence.status = BatchSequence::Skipped;
+        sequence.message = "уже обработана";
+        return;
+    }
+
+    sequence.status = BatchSequence::Failed;
+    FrameSource source;
+    if (!source.open(sequence.input))
+    {
+        sequence.message = "не удалось открыть вход";
+        return;
+    }
+
+    // Прерванная последовательность продолжается с контрольной точки, модель не обучается заново
+    QElapsedTimer timer;
+    timer.start();
+    Recognizer recognizer;
+    recognizer.settings = settings;
+    Checkpoint checkpoint(sequence.output);
+    QImage frame;
+    if (!checkpoint.loadModel(recognizer))
+    {
+        // Обучение: модель по кадрам learnFirst..learnLast, все в этом потоке
+        if (!learnSequence(source, sequence.input, sequence.learnFirst, sequence.learnLast, recognizer, sequence.message))
+            return;
+        if (!checkpoint.saveModel(recognizer))
+            qWarning() << "checkpoint model not written:" << sequence.output;
+    }
+    sequence.learnTime = timer.restart();
+
+    int width = recognizer.width(), height = recognizer.height();
+    recognizer.begin(width, height);
+    int cursor = 0;
+    if (!checkpoint.restore(recognizer, cursor))
+        cursor = 0;
+
+    // Маски кадров до контрольной точки уже в архиве, остальные дописываются
+    QString archiveName = sequence.output + ".masks";
+    MaskArchiveWriter archive;
+    if (cursor > 0 && !archive.start(archiveName, width, height, cursor))
+    {
+        // Архив короче контрольной точки - последовательность начинается сначала
+        recognizer.begin(width, height);
+        checkpoint = Checkpoint(sequence.output);
+        cursor = 0;
+    }
+    if (cursor == 0 && !archive.start(archiveName, width, height))
+    {
+        sequence.message = "не удалось создать архив масок";
+        return;
+    }
+    sequence.resumedFrom = cursor;
+    if (source.skip(cursor) != cursor)
+    {
+        sequence.message = "вход короче контрольной точки";
+        return;
+    }
+
+    // Сеанс - только прохода с первого кадра: сопровождение из контрольной точки повтор не восстановит
+    Session session;
+    bool record = recording && cursor == 0;
+    if (recording && !record)
+        qWarning() << "session not recorded, resumed from frame" << cursor << ":" << sequence.output;
+
+    QImage* mask = recognizer.pool().acquire(QImage::Format_Indexed8, Recognizer::maskColorTable());
+    int frames = cursor;
+    while (source.readFrame(frame))
+    {
+        if (frame.width() != width || frame.height() != height)
+        {
+            sequence.message = QString("размер кадра %1 не совпадает с обучающими").arg(frames);
+            break;
+        }
+        recognizer.classifyFrame(frame, mask);
+        recognizer.track(frames++, *mask);
+        if (record)
+            session.maskHashes << Session::maskHash(*mask);
+        if (!archive.append(*mask))
+        {
+            sequence.message = "не удалось записать архив масок";
+            break;
+        }
+
+        // Контрольная точка - только когда ее кадры уже в архиве
+        if (frames % CheckpointInterval == 0 && (!archive.flush() || !checkpoint.save(recognizer, frames)))
+            qWarning() << "checkpoint not written:" << sequence.output << "frame" << frames;
+    }
+    recognizer.pool().release(mask);
+    if (!archive.finish() && sequence.message.isEmpty())
+        sequence.message = "не удалось записать архив масок";
+    sequence.recognizeTime = timer.elapsed();
+    sequence.frames = frames - cursor;
+    sequence.tracks = recognizer.tracks().size();
+    if (!sequence.message.isEmpty())
+        return;
+
+    if (!recognizer.tracks().exportCsv(sequence.output + ".tracks.csv"))
+    {
+        sequence.message = "не удалось записать траектории";
+        return;
+    }
+    if (record)
+    {
+        session.input = sequence.input;
+        session.learnFirst = sequence.learnFirst;
+        session.learnLast = sequence.learnLast;
+        session.width = width;
+        session.height = height;
+        session.settings = recognizer.settings;
+        session.profile = recognizer.profile();
+        if (!session.save(sequence.output + ".session"))
+            qWarning() << "session not written:" << sequence.output;
+    }
+
+    // Отметка пишется последней и целиком: прерванная последовательность ее не получит
+    QSaveFile done(doneName);
+    bool written = done.open(QIODevice::WriteOnly | QIODevice::Text);
+    if (written)
+    {
+        QTextStream stream(&done);
+        stream << "frames=" << frames << "\nresumed_from=" << cursor << "\nlearn_ms=" << sequence.learnTime
+               << "\nrecognize_ms=" << sequence.recognizeTime << "\n";
+        stream.flush();
+        written = stream.status() == QTextStream::Ok && done.commit();
+    }
+    if (!written)
+    {
+        sequence.message = "не удалось записать отметку";
+        return;
+    }
+
+    checkpoint.remove();
+    sequence.status = BatchSequence::Done;
+}
+
+int BatchScheduler::failures() const
+{
+    int count = 0;
+    foreach (const BatchSequence& sequence, items)
+        if (sequence.status == BatchSequence::Failed)
+            count++;
+    return count;
+}
+
+bool BatchScheduler::writeSummary(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "input,status,frames,resumed_from,learn_ms,recognize_ms,fps,track_points,worker,message\n";
+    foreach (const BatchSequence& sequence, items)
+    {
+        double fps = sequence.recognizeTime ? 1000. * sequence.frames / sequence.recognizeTime : 0;
+        stream << quoted(sequence.input) << ',' << statusNames[sequence.status] << ',' << sequence.frames << ','
+               << sequence.resumedFrom << ',' << sequence.learnTime << ',' << sequence.recognizeTime << ','
+               << QString::number(fps, 'f', 1) << ',' << sequence.tracks << ',' << sequence.worker << ','
+               << quoted(sequence.message) << '\n';
+    }
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+void BatchScheduler::report() const
+{
+    int counts[4] = { 0, 0, 0, 0 };
+    qint64 frames = 0;
+    foreach (const BatchSequence& sequence, items)
+    {
+        counts[sequence.status]++;
+        frames += sequence.frames;
+    }
+
+    qDebug() << items.size() << "sequences:" << counts[BatchSequence::Done] << "done," << counts[BatchSequence::Skipped]
+             << "skipped," << counts[BatchSequence::Failed] << "failed;" << frames << "frames in" << wallTime << "ms,"
+             << (wallTime ? 1000. * frames / wallTime : 0.) << "frames per second," << steals << "steals";
+    foreach (const BatchSequence& sequence, items)
+        if (sequence.status == BatchSequence::Failed)
+            qWarning() << sequence.input << ":" << sequence.message;
+}
+
+int runBatch(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    QString manifest, summary, settingsName;
+    int jobs = QThread::idealThreadCount();
+    bool record = arguments.contains("--record");
+    for (int i = 1; i + 1 < arguments.size(); i++)
+    {
+        if (arguments.at(i) == "--batch")
+            manifest = arguments.at(++i);
+        else if (arguments.at(i) == "--jobs")
+            jobs = arguments.at(++i).toInt();
+        else if (arguments.at(i) == "--summary")
+            summary = arguments.at(++i);
+        else if (arguments.at(i) == "--settings")
+            settingsName = arguments.at(++i);
+    }
+    if (manifest.isEmpty() || jobs < 1)
+    {
+        fprintf(stderr, "usage: pathAnalyzer --batch manifest [--jobs N] [--summary summary.csv] [--settings file] [--record]\n");
+        return 2;
+    }
+    if (summary.isEmpty())
+        summary = QFileInfo(manifest).absoluteDir().absoluteFilePath("summary.csv");
+
+    BatchScheduler scheduler;
+    QString error;
+    RecognizerSettings settings;
+    if (!scheduler.loadManifest(manifest, error)
+            || (!settingsName.isEmpty() && !Session::loadSettings(settingsName, settings, error)))
+    {
+        fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 2;
+    }
+    scheduler.setSettings(settings);
+
+    scheduler.setRecording(record);
+    scheduler.run(jobs);
+    scheduler.report();
+    if (!scheduler.writeSummary(summary))
+    {
+        fprintf(stderr, "cannot write %s\n", summary.toLocal8Bit().constData());
+        return 1;
+    }
+    return scheduler.failures() ? 1 : 0;
+}
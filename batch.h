@@ -0,0 +1,98 @@
+#ifndef BATCH_H
+#define BATCH_H
+// Пакетная обработка без окна: последовательности из манифеста обучаются и
+// распознаются несколькими потоками, у каждого потока свой Recognizer.
+// Готовая последовательность отмечается файлом рядом с результатом и при
+// повторном запуске пропускается. Итог - таблица по последовательностям.
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "recognizer.h"
+
+// Манифест - текст, по последовательности в строке, поля через ';':
+//   вход;первый кадр обучения;последний кадр обучения;префикс результата
+// Вход - видео, каталог изображений (по именам) или список файлов *.list (framesource.h). Кадры нумеруются от 0,
+// обучение на кадрах first..last включительно, распознаются все кадры.
+// Результат: префикс.tracks.csv, архив масок префикс.masks (maskarchive.h) и отметка префикс.done; пока последовательность не готова,
+// рядом лежат файлы контрольной точки (checkpoint.h). Пустые строки и
+// строки с '#' в начале пропускаются, относительные пути - от каталога манифеста.
+// С --record рядом пишется и сеанс префикс.session для повтора и замера (session.h)
+
+struct BatchSequence
+{
+    BatchSequence();
+
+    enum Status { Pending, Done, Skipped, Failed };
+
+    QString input;
+    int learnFirst, learnLast;
+    QString output;
+
+    Status status;
+    QString message;
+    // Кадров распознано в этом запуске; resumedFrom - с какого кадра продолжен (контрольная точка)
+    int frames;
+    int resumedFrom;
+    // мс
+    qint64 learnTime, recognizeTime;
+    int tracks;
+    // Поток, который обработал последовательность
+    int worker;
+};
+
+class BatchScheduler
+{
+public:
+    BatchScheduler();
+    ~BatchScheduler();
+
+    bool loadManifest(const QString& fileName, QString& error);
+    // Записывать сеанс каждой последовательности, распознанной с первого кадра
+    void setRecording(bool enabled) { recording = enabled; }
+    // Параметры распознавания всех последовательностей (по умолчанию - RecognizerSettings())
+    void setSettings(const RecognizerSettings& value) { settings = value; }
+
+    // Обрабатывает все последовательности threads потоками и возвращается по завершении.
+    // Сначала последовательности раздаются по очередям потоков, самые большие первыми;
+    // поток с пустой очередью берет последовательность из конца самой длинной чужой
+    void run(int threads);
+
+    const QList<BatchSequence>& sequences() const { return items; }
+    int failures() const;
+
+    // Таблица CSV по последовательностям
+    bool writeSummary(const QString& fileName) const;
+    // Итоги в отладочный вывод: время, кадров в секунду, отказы
+    void report() const;
+
+private:
+    Q_DISABLE_COPY(BatchScheduler)
+    friend class BatchTask;
+
+    // Следующая последовательность потока worker, -1 - работа кончилась
+    int take(int worker);
+    void process(BatchSequence& sequence);
+
+    QList<BatchSequence> items;
+    // Элементы items для потоков, заполняется в run() до их запуска
+    QVector<BatchSequence*> entries;
+    // Очереди номеров последовательностей по потокам, у каждой свой мьютекс
+    QVector<QList<int> > queues;
+    QList<QMutex*> locks;
+    QMutex statsLock;
+    int steals;
+    bool recording;
+    RecognizerSettings settings;
+    qint64 wallTime;
+};
+
+// Пакетный режим из командной строки:
+//   pathAnalyzer --batch манифест [--jobs N] [--summary итог.csv] [--settings параметры] [--record]
+// Файл параметров - строки ключ=значение, как в записанном сеансе (Session::loadSettings)
+// Код возврата 0, если все последовательности обработаны
+int runBatch(int argc, char* argv[]);
+
+#endif // BATCH_H
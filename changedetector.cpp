@@ -0,0 +1,111 @@
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "changedetector.h"
+
+quint32 sumAbsDiff(const uchar *a, const uchar *b, int count)
+{
+    quint32 sum = 0;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                              _mm_loadu_si128((const __m128i*)(b + i))));
+    sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; i < count; i++)
+        sum += qAbs((int)a[i] - (int)b[i]);
+    return sum;
+}
+
+ChangeDetector::ChangeDetector() :
+    total(0), skipped(0)
+{
+}
+
+void ChangeDetector::reset()
+{
+    reference = QImage();
+    changed.resize(0);
+    total = skipped = 0;
+}
+
+int ChangeDetector::update(const QImage &frame, int threshold)
+{
+    int width = frame.width();
+    int height= frame.height();
+    int bytesPerPixel = frame.depth() / 8;
+    int tilesX = (width + TileSize - 1) / TileSize;
+    int tilesY = (height + TileSize - 1) / TileSize;
+
+    changed.resize(0);
+
+    if (reference.width() != width || reference.height() != height || reference.format() != frame.format())
+    {
+        // Первый кадр: опора - копия кадра, изменено все
+        reference = frame.copy();
+        for (int ty = 0; ty < tilesY; ty++)
+            changed << QRect(0, ty * TileSize, width, qMin(TileSize, height - ty * TileSize));
+        total += tilesX * tilesY;
+        return tilesX * tilesY;
+    }
+
+    sums.resize(tilesX);
+    int changedTiles = 0;
+
+    for (int ty = 0; ty < tilesY; ty++)
+    {
+        int y0 = ty * TileSize;
+        int rows = qMin(TileSize, height - y0);
+
+        memset(sums.data(), 0, tilesX * sizeof(quint32));
+        for (int y = y0; y < y0 + rows; y++)
+        {
+            const uchar* a = frame.constScanLine(y);
+            const uchar* b = reference.constScanLine(y);
+            for (int tx = 0; tx < tilesX; tx++)
+            {
+                int x0 = tx * TileSize;
+                int columns = qMin(TileSize, width - x0);
+                sums[tx] += sumAbsDiff(a + x0 * bytesPerPixel, b + x0 * bytesPerPixel, columns * bytesPerPixel);
+            }
+        }
+
+        // Подряд идущие изменившиеся блоки - один прямоугольник
+        int runStart = -1;
+        for (int tx = 0; tx <= tilesX; tx++)
+        {
+            bool isChanged = false;
+            if (tx < tilesX)
+            {
+                int columns = qMin(TileSize, width - tx * TileSize);
+                isChanged = sums[tx] > (quint32)(threshold * columns * rows);
+            }
+
+            if (isChanged)
+            {
+                changedTiles++;
+                if (runStart < 0)
+                    runStart = tx;
+            }
+            else if (runStart >= 0)
+            {
+                int x0 = runStart * TileSize;
+                int x1 = qMin(tx * TileSize, width);
+                changed << QRect(x0, y0, x1 - x0, rows);
+                for (int y = y0; y < y0 + rows; y++)
+                    memcpy(reference.scanLine(y) + x0 * bytesPerPixel, frame.constScanLine(y) + x0 * bytesPerPixel,
+                           (x1 - x0) * bytesPerPixel);
+                runStart = -1;
+            }
+        }
+    }
+
+    total += tilesX * tilesY;
+    skipped += tilesX * tilesY - changedTiles;
+    return changedTiles;
+}
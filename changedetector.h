@@ -0,0 +1,46 @@
+#ifndef CHANGEDETECTOR_H
+#define CHANGEDETECTOR_H
+// Поиск изменившихся блоков кадра. Блок сравнивается (SAD - сумма модулей разностей)
+// с тем, каким он был при последней классификации, а не с предыдущим кадром:
+// так медленные изменения накапливаются и все равно замечаются.
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#define TileSize 16
+
+class ChangeDetector
+{
+public:
+    ChangeDetector();
+
+    // Забыть опорный кадр: следующий кадр изменен целиком
+    void reset();
+
+    // threshold - средняя разность на точку (сумма по каналам), при которой блок считается
+    // изменившимся. Изменившиеся блоки запоминаются как новая опора.
+    // Возвращает число изменившихся блоков
+    int update(const QImage& frame, int threshold);
+
+    // Изменившиеся блоки последнего update(), соседние в строке объединены
+    const QVector<QRect>& changedRects() const { return changed; }
+
+    // Статистика с последнего reset()
+    qint64 tilesTotal() const   { return total; }
+    qint64 tilesSkipped() const { return skipped; }
+    double skippedFraction() const { return total ? (double)skipped / total : 0.; }
+
+private:
+    QImage reference;
+    QVector<quint32> sums;
+    QVector<QRect> changed;
+
+    qint64 total;
+    qint64 skipped;
+};
+
+// Сумма модулей разностей count байт
+quint32 sumAbsDiff(const uchar* a, const uchar* b, int count);
+
+#endif // CHANGEDETECTOR_H
@@ -0,0 +1,156 @@
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+
+#include "checkpoint.h"
+
+// "PCKM", "PCKS"
+static const quint32 ModelFileMagic = 0x4D4B4350;
+static const quint32 StateFileMagic = 0x534B4350;
+static const quint32 CheckpointVersion = 1;
+// Точка траектории в префикс.points: кадр, номер, x, y, прямоугольник (4 x qint16), площадь
+static const int PointBytes = 4 + 4 + 4 + 4 + 4 * 2 + 4;
+
+static void setupStream(QDataStream& stream)
+{
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+}
+
+Checkpoint::Checkpoint(const QString &prefix_) :
+    prefix(prefix_), savedPoints(0)
+{
+}
+
+bool Checkpoint::saveModel(const Recognizer &recognizer) const
+{
+    // Модель пишется один раз, но тоже целиком: недописанная не прочитается, старая остается до commit()
+    QSaveFile file(modelName());
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    setupStream(stream);
+    stream << ModelFileMagic << CheckpointVersion;
+    recognizer.saveModel(stream);
+    if (stream.status() != QDataStream::Ok)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool Checkpoint::loadModel(Recognizer &recognizer) const
+{
+    QFile file(modelName());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    setupStream(stream);
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != ModelFileMagic || version != CheckpointVersion)
+        return false;
+    return recognizer.loadModel(stream);
+}
+
+bool Checkpoint::save(const Recognizer &recognizer, int cursor)
+{
+    // Сначала новые точки в конец .points
+    const TrackStore& store = recognizer.tracks();
+    if (store.size() > savedPoints || savedPoints == 0)
+    {
+        QFile points(pointsName());
+        QIODevice::OpenMode mode = savedPoints ? QIODevice::WriteOnly | QIODevice::Append
+                                               : QIODevice::WriteOnly | QIODevice::Truncate;
+        if (!points.open(mode))
+            return false;
+
+        QDataStream stream(&points);
+        setupStream(stream);
+        for (int i = savedPoints; i < store.size(); i++)
+        {
+            TrackPoint point = store.at(i);
+            stream << (qint32)point.frame << (qint32)point.id << point.x << point.y
+                   << (qint16)point.box.left() << (qint16)point.box.top()
+                   << (qint16)point.box.right() << (qint16)point.box.bottom() << (qint32)point.area;
+        }
+        if (stream.status() != QDataStream::Ok || !points.flush())
+            return false;
+        savedPoints = store.size();
+    }
+
+    // Затем состояние целиком: до commit() на диске остается предыдущее
+    QSaveFile file(stateName());
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    setupStream(stream);
+    stream << StateFileMagic << CheckpointVersion << (qint32)recognizer.width() << (qint32)recognizer.height()
+           << (qint32)cursor << (qint32)savedPoints;
+    recognizer.saveTracking(stream);
+    if (stream.status() != QDataStream::Ok)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool Checkpoint::restore(Recognizer &recognizer, int &cursor)
+{
+    savedPoints = 0;
+    cursor = 0;
+
+    QFile file(stateName());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    setupStream(stream);
+    quint32 magic, version;
+    qint32 width, height, savedCursor, pointCount;
+    stream >> magic >> version >> width >> height >> savedCursor >> pointCount;
+    if (stream.status() != QDataStream::Ok || magic != StateFileMagic || version != CheckpointVersion
+            || width != recognizer.width() || height != recognizer.height() || savedCursor < 0 || pointCount < 0)
+        return false;
+
+    // Точки до сохраненного числа, хвост после сбоя обрезается
+    QFile points(pointsName());
+    if (!points.open(QIODevice::ReadWrite) || points.size() < (qint64)pointCount * PointBytes)
+        return false;
+
+    TrackStore store;
+    store.reserve(pointCount);
+    QDataStream pointStream(&points);
+    setupStream(pointStream);
+    for (int i = 0; i < pointCount; i++)
+    {
+        qint32 frame, id, area;
+        float x, y;
+        qint16 left, top, right, bottom;
+        pointStream >> frame >> id >> x >> y >> left >> top >> right >> bottom >> area;
+        QRect box;
+        box.setCoords(left, top, right, bottom);
+        store.append(frame, id, x, y, box, area);
+    }
+    if (pointStream.status() != QDataStream::Ok || !points.resize((qint64)pointCount * PointBytes))
+        return false;
+
+    if (!recognizer.restoreTracking(stream, store))
+        return false;
+
+    cursor = savedCursor;
+    savedPoints = pointCount;
+    return true;
+}
+
+void Checkpoint::remove() const
+{
+    QFile::remove(modelName());
+    QFile::remove(pointsName());
+    QFile::remove(stateName());
+}
@@ -0,0 +1,47 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+// Контрольные точки долгого распознавания: прерванный проход продолжается с последней
+// сохраненной точки, а не с начала. Файлы рядом с результатом, по префиксу:
+//   префикс.model  - обученная модель, пишется один раз (во время распознавания не меняется);
+//   префикс.points - точки траекторий, только дописываются;
+//   префикс.state  - номер следующего кадра, фильтры сопровождения и число точек в
+//                    префикс.points; пишется целиком через QSaveFile.
+// Точки пишутся раньше состояния, поэтому в .points их не меньше, чем записано в .state;
+// лишние (после сбоя между записями) отбрасываются при продолжении.
+// Голосование масок и опорные блоки не сохраняются - после продолжения они набираются заново
+
+#include <QString>
+
+#include "recognizer.h"
+
+// Кадров между контрольными точками
+#define CheckpointInterval 500
+
+class Checkpoint
+{
+public:
+    explicit Checkpoint(const QString& prefix);
+
+    bool saveModel(const Recognizer& recognizer) const;
+    // false - модели нет или файл поврежден, тогда модель обучается заново
+    bool loadModel(Recognizer& recognizer) const;
+
+    // Состояние после кадров 0..cursor-1. Пишутся только точки, добавленные с прошлого save()
+    bool save(const Recognizer& recognizer, int cursor);
+    // После recognizer.begin(). cursor - кадр, с которого продолжать; false - начинать сначала
+    bool restore(Recognizer& recognizer, int& cursor);
+
+    // Удаляет все файлы точки, когда результат готов
+    void remove() const;
+
+private:
+    QString modelName() const  { return prefix + ".model"; }
+    QString pointsName() const { return prefix + ".points"; }
+    QString stateName() const  { return prefix + ".state"; }
+
+    QString prefix;
+    // Точек траекторий уже в префикс.points
+    int savedPoints;
+};
+
+#endif // CHECKPOINT_H
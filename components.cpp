@@ -1,13 +1,49 @@
+#include <cstring>
+
 #include <QImage>
 #include <QColor>
+#include <QRect>
 
 #include "components.h"
 
 QImage* selectComponents(const QImage* origin, int& colorNumber)
 {
-    QImage bitmap(origin->createMaskFromColor(0xFF000000, Qt::MaskOutColor).convertToFormat(QImage::Format_RGB32));
+    QImage bitmap;
+    QImage* componentsMap = new QImage;
+    selectComponents(origin, colorNumber, bitmap, *componentsMap);
+    return componentsMap;
+}
+
+void selectComponents(const QImage* origin, int& colorNumber, QImage& bitmap, QImage& componentsMap_)
+{
+    int imageWidth = origin->width();
+    int imageHeight= origin->height();
+
+    if (bitmap.width() != imageWidth || bitmap.height() != imageHeight || bitmap.format() != QImage::Format_RGB32)
+        bitmap = QImage(imageWidth, imageHeight, QImage::Format_RGB32);
+    if (componentsMap_.width() != imageWidth || componentsMap_.height() != imageHeight
+            || componentsMap_.format() != QImage::Format_RGB32)
+        componentsMap_ = QImage(imageWidth, imageHeight, QImage::Format_RGB32);
 
-    QImage* componentsMap = new QImage(bitmap.width(), bitmap.height(), QImage::Format_RGB32);
+    // Все, что не черное - объект
+    QVector<QRgb> colorTable = origin->colorTable();
+    for (int y = 0; y < imageHeight; y++)
+    {
+        QRgb* pixel = (QRgb*)bitmap.scanLine(y);
+        if (origin->format() == QImage::Format_Indexed8)
+        {
+            const uchar* index = origin->constScanLine(y);
+            for (int x = 0; x < imageWidth; x++)
+                pixel[x] = (colorTable.at(index[x]) == 0xFF000000) ? 0xFF000000 : 0xFFFFFFFF;
+        }
+        else
+        {
+            for (int x = 0; x < imageWidth; x++)
+                pixel[x] = (origin->pixel(x, y) == 0xFF000000) ? 0xFF000000 : 0xFFFFFFFF;
+        }
+    }
+
+    QImage* componentsMap = &componentsMap_;
     componentsMap->fill(QColor(0, 0, 0, 0));
 
     QRgb currColor = 0xFF000000;
@@ -179,8 +215,6 @@ curveNum = curveNum1;
 
     for (int i = 0; i < colorNumber; i++)
         componentsActive << true;
-
-    return componentsMap;
 }
 
 
@@ -194,20 +228,19 @@ void replaceColor(QImage *image, const QRgb colorToReplace, const QRgb newColor)
 }
 
 
-xy* crop(QImage &object)
+bool crop(const QImage &object, xy res[2])
 {
     int imageWidth = object.width();
     int imageHeight= object.height();
 
-    xy* res = new xy[2];
     res[0].x = imageWidth + 1;
     res[0].y = imageHeight+ 1;
-    res[1].x = 0;
-    res[1].y = 0;
-
-    uchar* pixel = object.bits();
+    res[1].x = -1;
+    res[1].y = -1;
 
     for (int y = 0; y < imageHeight; y++)
+    {
+        const uchar* pixel = object.constScanLine(y);
         for (int x = 0; x < imageWidth; x++, pixel++)
         {
             if (*pixel)
@@ -225,12 +258,211 @@ xy* crop(QImage &object)
                     res[1].x = x;
             }
         }
+    }
+
+    return res[1].x >= 0;
+}
+
+static int findRoot(QVector<int>& parents, int label)
+{
+    int root = label;
+    while (parents[root] != root)
+        root = parents[root];
+    // Сжатие пути
+    while (parents[label] != root)
+    {
+        int next = parents[label];
+        parents[label] = root;
+        label = next;
+    }
+    return root;
+}
+
+static void unite(QVector<int>& parents, int a, int b)
+{
+    a = findRoot(parents, a);
+    b = findRoot(parents, b);
+    // Корнем всегда становится меньшая метка
+    if (a < b)
+        parents[b] = a;
+    else if (b < a)
+        parents[a] = b;
+}
+
+// Разметка связных областей (8-связность). После нее parents[метка] = -(номер области + 1).
+// Возвращает число областей
+static int labelComponents(const QImage &mask, QVector<int> &labels, QVector<int> &parents)
+{
+    int imageWidth = mask.width();
+    int imageHeight= mask.height();
+
+    labels.resize(imageWidth * imageHeight);
+    parents.resize(0);
+    parents << 0;
+
+    // Первый проход: предварительные метки и их объединения
+    for (int y = 0; y < imageHeight; y++)
+    {
+        const uchar* pixel = mask.constScanLine(y);
+        int* label = labels.data() + y * imageWidth;
+        const int* upper = y > 0 ? label - imageWidth : label;
+        for (int x = 0; x < imageWidth; x++)
+        {
+            if (!pixel[x])
+            {
+                // Маска почти вся пустая: пустые восьмерки точек размечаются сразу
+                quint64 chunk = 1;
+                if (x + 8 <= imageWidth)
+                    memcpy(&chunk, pixel + x, 8);
+                if (chunk == 0)
+                {
+                    memset(label + x, 0, 8 * sizeof(int));
+                    x += 7;
+                }
+                else
+                    label[x] = 0;
+                continue;
+            }
+
+            int current = 0;
+            int neighbours[4] = { x > 0 ? label[x - 1] : 0,
+                                  (y > 0 && x > 0) ? upper[x - 1] : 0,
+                                  y > 0 ? upper[x] : 0,
+                                  (y > 0 && x + 1 < imageWidth) ? upper[x + 1] : 0 };
+            for (int i = 0; i < 4; i++)
+            {
+                if (!neighbours[i])
+                    continue;
+                if (!current)
+                    current = neighbours[i];
+                else if (neighbours[i] != current)
+                    unite(parents, current, neighbours[i]);
+            }
+
+            if (!current)
+            {
+                current = parents.size();
+                parents << current;
+            }
+            label[x] = current;
+        }
+    }
 
-    if (res->x == -1)
+    // Корень множества - его наименьшая метка, поэтому он обрабатывается раньше остальных
+    int count = 0;
+    for (int i = 1; i < parents.size(); i++)
+        parents[i] = findRoot(parents, i);
+    for (int i = 1; i < parents.size(); i++)
     {
-        delete [] res;
-        return 0;
+        if (parents[i] == i)
+            parents[i] = -(++count);
+        else
+            parents[i] = parents[parents[i]];
     }
+    return count;
+}
+
+void componentBoxes(const QImage &mask, QVector<QRect> &boxes, QVector<int> &labels, QVector<int> &parents)
+{
+    int imageWidth = mask.width();
+    int imageHeight= mask.height();
 
-    return res;
+    boxes.fill(QRect(), labelComponents(mask, labels, parents));
+
+    // Второй проход: описанные прямоугольники, пустые восьмерки точек пропускаются по маске
+    for (int y = 0; y < imageHeight; y++)
+    {
+        const uchar* pixel = mask.constScanLine(y);
+        const int* label = labels.constData() + y * imageWidth;
+        for (int x = 0; x < imageWidth; x++)
+        {
+            if (x + 8 <= imageWidth)
+            {
+                quint64 chunk;
+                memcpy(&chunk, pixel + x, 8);
+                if (chunk == 0)
+                {
+                    x += 7;
+                    continue;
+                }
+            }
+            if (!label[x])
+                continue;
+
+            QRect& box = boxes[-parents[label[x]] - 1];
+            if (box.isNull())
+                box.setCoords(x, y, x, y);
+            else
+            {
+                if (x < box.left())
+                    box.setLeft(x);
+                if (x > box.right())
+                    box.setRight(x);
+                box.setBottom(y);
+            }
+        }
+    }
+}
+
+void findBlobs(const QImage &mask, QVector<Blob> &blobs, QVector<int> &labels, QVector<int> &parents, int minArea)
+{
+    int imageWidth = mask.width();
+    int imageHeight= mask.height();
+
+    int count = labelComponents(mask, labels, parents);
+    blobs.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        blobs[i].box = QRect();
+        blobs[i].moments.clear();
+    }
+
+    // Моменты копятся по отрезкам одной метки в строке, в 64-битных суммах
+    for (int y = 0; y < imageHeight; y++)
+    {
+        const int* label = labels.constData() + y * imageWidth;
+        int x = 0;
+        while (x < imageWidth)
+        {
+            if (!label[x])
+            {
+                x++;
+                continue;
+            }
+
+            int runStart = x;
+            int root = parents[label[x]];
+            while (x < imageWidth && label[x] && parents[label[x]] == root)
+                x++;
+            int runEnd = x - 1;
+
+            Blob& blob = blobs[-root - 1];
+            if (blob.box.isNull())
+                blob.box.setCoords(runStart, y, runEnd, y);
+            else
+            {
+                if (runStart < blob.box.left())
+                    blob.box.setLeft(runStart);
+                if (runEnd > blob.box.right())
+                    blob.box.setRight(runEnd);
+                blob.box.setBottom(y);
+            }
+            blob.moments.addRun(runStart, runEnd, y);
+        }
+    }
+
+    // Мелкие области - шум, остальные сдвигаются к началу без выделения памяти
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const Moments& moments = blobs[i].moments;
+        if (moments.area < minArea || moments.area == 0)
+            continue;
+        Blob blob = blobs[i];
+        blob.area = (int)moments.area;
+        blob.x = moments.x();
+        blob.y = moments.y();
+        blobs[kept++] = blob;
+    }
+    blobs.resize(kept);
 }
@@ -1,13 +1,41 @@
 #ifndef COMPONENTS_H
 #define COMPONENTS_H
 
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#include "moments.h"
+
 struct xy
 {
     int x, y;
 };
+Q_DECLARE_TYPEINFO(xy, Q_PRIMITIVE_TYPE);
 
 void replaceColor(QImage *image, const QRgb colorToReplace, const QRgb newColor);
+// bitmap и componentsMap - буферы результата (например, из FramePool), заполняются здесь
+void selectComponents(const QImage* origin, int& colorNumber, QImage& bitmap, QImage& componentsMap);
 QImage* selectComponents(const QImage* origin, int& colorNumber);
-xy *crop(QImage &object);
+// Прямоугольник, описанный вокруг ненулевых точек маски: box[0] - левый верхний угол,
+// box[1] - правый нижний. false, если маска пустая
+bool crop(const QImage &object, xy box[2]);
+// Описанные прямоугольники связных областей маски (8-связность).
+// labels и parents - рабочие буферы, между кадрами переиспользуются без выделений
+void componentBoxes(const QImage& mask, QVector<QRect>& boxes, QVector<int>& labels, QVector<int>& parents);
+
+// Связная область маски
+struct Blob
+{
+    QRect box;
+    int area;
+    double x, y;    // центр масс
+    // Моменты до второго порядка: ориентация и размеры для сопровождения и рисования
+    Moments moments;
+};
+Q_DECLARE_TYPEINFO(Blob, Q_MOVABLE_TYPE);
+
+// Области площадью не меньше minArea, в порядке верхней левой точки
+void findBlobs(const QImage& mask, QVector<Blob>& blobs, QVector<int>& labels, QVector<int>& parents, int minArea = 0);
 
 #endif // COMPONENTS_H
@@ -0,0 +1,129 @@
+#include <cmath>
+
+#include "distancemap.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+DistanceMap::DistanceMap() :
+    mapWidth(0), mapHeight(0), mapDepth(8)
+{
+}
+
+void DistanceMap::create(int width, int height, int depth)
+{
+    mapWidth = width;
+    mapHeight = height;
+    mapDepth = (depth == 16) ? 16 : 8;
+    levels.resize(width * height * (mapDepth / 8));
+}
+
+void DistanceMap::clear()
+{
+    mapWidth = mapHeight = 0;
+    levels.clear();
+}
+
+int DistanceMap::maxLevel() const
+{
+    return (mapDepth == 16) ? 0xFFFF : 0xFF;
+}
+
+void DistanceMap::setRow(int y, const float *squaredDistances)
+{
+    const float scale = (mapDepth == 16) ? DistanceScale16 : DistanceScale8;
+    const float top = (float)maxLevel();
+    int x = 0;
+
+    if (mapDepth == 16)
+    {
+        quint16* row = (quint16*)levels.data() + y * mapWidth;
+#ifdef __SSE2__
+        // Упаковка со знаком: уровни сдвигаются на 0x8000 и обратно
+        const __m128 s = _mm_set1_ps(scale), t = _mm_set1_ps(top);
+        const __m128i bias = _mm_set1_epi32(0x8000), flip = _mm_set1_epi16((short)0x8000);
+        for (; x + 8 <= mapWidth; x += 8)
+        {
+            __m128 d0 = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(_mm_loadu_ps(squaredDistances + x)), s), t);
+            __m128 d1 = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(_mm_loadu_ps(squaredDistances + x + 4)), s), t);
+            __m128i l0 = _mm_sub_epi32(_mm_cvttps_epi32(d0), bias);
+            __m128i l1 = _mm_sub_epi32(_mm_cvttps_epi32(d1), bias);
+            _mm_storeu_si128((__m128i*)(row + x), _mm_xor_si128(_mm_packs_epi32(l0, l1), flip));
+        }
+#endif
+        for (; x < mapWidth; x++)
+            row[x] = (quint16)qMin(std::sqrt(squaredDistances[x]) * scale, top);
+    }
+    else
+    {
+        uchar* row = (uchar*)levels.data() + y * mapWidth;
+#ifdef __SSE2__
+        const __m128 s = _mm_set1_ps(scale), t = _mm_set1_ps(top);
+        for (; x + 8 <= mapWidth; x += 8)
+        {
+            __m128 d0 = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(_mm_loadu_ps(squaredDistances + x)), s), t);
+            __m128 d1 = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(_mm_loadu_ps(squaredDistances + x + 4)), s), t);
+            __m128i l = _mm_packs_epi32(_mm_cvttps_epi32(d0), _mm_cvttps_epi32(d1));
+            _mm_storel_epi64((__m128i*)(row + x), _mm_packus_epi16(l, l));
+        }
+#endif
+        for (; x < mapWidth; x++)
+            row[x] = (uchar)qMin(std::sqrt(squaredDistances[x]) * scale, top);
+    }
+}
+
+int DistanceMap::level(int x, int y) const
+{
+    int i = y * mapWidth + x;
+    if (mapDepth == 16)
+        return ((const quint16*)levels.constData())[i];
+    return (uchar)levels.at(i);
+}
+
+int DistanceMap::levelOf(float k_) const
+{
+    const float scale = (mapDepth == 16) ? DistanceScale16 : DistanceScale8;
+    double bound = std::ceil((double)k_ * k_ * k_ * scale);
+    return (int)qBound(0.0, bound, (double)maxLevel());
+}
+
+void DistanceMap::threshold(int level, QImage &mask) const
+{
+    for (int y = 0; y < mapHeight; y++)
+    {
+        uchar* maskPixel = mask.scanLine(y);
+        int x = 0;
+
+        if (mapDepth == 16)
+        {
+            const quint16* row = (const quint16*)levels.constData() + y * mapWidth;
+#ifdef __SSE2__
+            // Сравнения без знака в SSE2 нет: level - уровень с насыщением равно 0, если уровень не меньше
+            const __m128i l = _mm_set1_epi16((short)level), zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+            for (; x + 16 <= mapWidth; x += 16)
+            {
+                __m128i f0 = _mm_cmpeq_epi16(_mm_subs_epu16(l, _mm_loadu_si128((const __m128i*)(row + x))), zero);
+                __m128i f1 = _mm_cmpeq_epi16(_mm_subs_epu16(l, _mm_loadu_si128((const __m128i*)(row + x + 8))), zero);
+                _mm_storeu_si128((__m128i*)(maskPixel + x), _mm_and_si128(_mm_packs_epi16(f0, f1), one));
+            }
+#endif
+            for (; x < mapWidth; x++)
+                maskPixel[x] = (uchar)(row[x] >= level);
+        }
+        else
+        {
+            const uchar* row = (const uchar*)levels.constData() + y * mapWidth;
+#ifdef __SSE2__
+            const __m128i l = _mm_set1_epi8((char)level), one = _mm_set1_epi8(1);
+            for (; x + 16 <= mapWidth; x += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+                _mm_storeu_si128((__m128i*)(maskPixel + x), _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, l), v), one));
+            }
+#endif
+            for (; x < mapWidth; x++)
+                maskPixel[x] = (uchar)(row[x] >= level);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef DISTANCEMAP_H
+#define DISTANCEMAP_H
+// Квантованные расстояния Махаланобиса точек кадра до модели фона, 8 или 16 бит на точку.
+// По карте маска строится заново при любом пороге k без повторного вычисления модели.
+
+#include <QByteArray>
+#include <QImage>
+#include <QMetaType>
+
+// Уровней на единицу расстояния: 8 бит - расстояния до 255 (k до 6.3) с шагом 1,
+// 16 бит - до 1024 (k до 10) с шагом 1/64. Большие расстояния - наибольший уровень
+#define DistanceScale8 1
+#define DistanceScale16 64
+
+class DistanceMap
+{
+public:
+    DistanceMap();
+
+    // depth - 8 или 16
+    void create(int width, int height, int depth);
+    void clear();
+
+    bool isEmpty() const { return mapWidth == 0; }
+    int width() const  { return mapWidth; }
+    int height() const { return mapHeight; }
+    int depth() const  { return mapDepth; }
+    int byteCount() const { return levels.size(); }
+    int maxLevel() const;
+
+    // Строка y из квадратов расстояний: уровень = min(расстояние * scale, maxLevel())
+    void setRow(int y, const float* squaredDistances);
+    // Уровень точки x строки y
+    int level(int x, int y) const;
+
+    // Наименьший уровень переднего плана при пороге k^3. Порог, не попадающий
+    // на уровень, округляется вверх, меньше чем на шаг
+    int levelOf(float k) const;
+    // mask - Indexed8 размера карты: 1 - уровень не меньше level, 0 - меньше
+    void threshold(int level, QImage& mask) const;
+    void threshold(float k, QImage& mask) const { threshold(levelOf(k), mask); }
+
+private:
+    int mapWidth, mapHeight, mapDepth;
+    // Строки подряд, без выравнивания
+    QByteArray levels;
+};
+
+Q_DECLARE_METATYPE(DistanceMap)
+
+#endif // DISTANCEMAP_H
@@ -0,0 +1,126 @@
+#include "framepool.h"
+
+#ifdef COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+// Счетчик свой у каждого потока, чтобы кодеры и GUI не мешали замерам
+static thread_local qint64 allocationCounter = 0;
+
+void* operator new(size_t size)
+{
+    allocationCounter++;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+#endif
+
+FramePool::FramePool() :
+    poolWidth(0), poolHeight(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    foreach (QImage* iter, allImages)
+    {
+        delete iter;
+    }
+}
+
+void FramePool::reset(int width, int height)
+{
+    if (width == poolWidth && height == poolHeight)
+        return;
+
+    poolWidth  = width;
+    poolHeight = height;
+
+    foreach (QImage* iter, freeImages)
+    {
+        allImages.removeOne(iter);
+        delete iter;
+    }
+    freeImages.clear();
+}
+
+void FramePool::reserve(QImage::Format format, int count)
+{
+    int available = 0;
+    foreach (QImage* iter, freeImages)
+        if (iter->format() == format)
+            available++;
+
+    for (; available < count; available++)
+    {
+        QImage* image = new QImage(poolWidth, poolHeight, format);
+        allImages << image;
+        freeImages << image;
+    }
+}
+
+QImage* FramePool::acquire(QImage::Format format, const QVector<QRgb> &colorTable)
+{
+    QImage* image = 0;
+    for (int i = 0; i < freeImages.size(); i++)
+    {
+        // Буфер, который еще держит кодер или список результатов, пропускаем
+        if (freeImages[i]->format() == format && freeImages[i]->isDetached())
+        {
+            image = freeImages[i];
+            freeImages.removeAt(i);
+            break;
+        }
+    }
+
+    if (!image)
+    {
+        image = new QImage(poolWidth, poolHeight, format);
+        allImages << image;
+    }
+
+    if (!colorTable.isEmpty())
+        image->setColorTable(colorTable);
+
+    return image;
+}
+
+void FramePool::release(QImage *image)
+{
+    if (!image)
+        return;
+
+    if (image->width() != poolWidth || image->height() != poolHeight || !allImages.contains(image))
+    {
+        allImages.removeOne(image);
+        delete image;
+        return;
+    }
+
+    freeImages << image;
+}
+
+qint64 FramePool::heapAllocations()
+{
+#ifdef COUNT_ALLOCATIONS
+    return allocationCounter;
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+// Пул кадровых буферов.
+// Размер задается по первому кадру, все стадии берут временные изображения
+// отсюда и возвращают обратно, чтобы в установившемся режиме не было выделений памяти.
+
+#include <QImage>
+#include <QList>
+#include <QVector>
+
+class FramePool
+{
+public:
+    FramePool();
+    ~FramePool();
+
+    // Геометрия кадра. Свободные буферы другого размера освобождаются
+    void reset(int width, int height);
+
+    // Заранее создает count свободных буферов, чтобы выделение не попало в цикл по кадрам
+    void reserve(QImage::Format format, int count);
+
+    // Буфер не разделяется с другими QImage (isDetached), поэтому запись в него не копирует данные.
+    // Содержимое не очищается
+    QImage* acquire(QImage::Format format, const QVector<QRgb>& colorTable = QVector<QRgb>());
+    // Чужие буферы и буферы старого размера удаляются
+    void release(QImage* image);
+
+    int width() const  { return poolWidth; }
+    int height() const { return poolHeight; }
+
+    // Количество выделений памяти в куче текущим потоком.
+    // Считается только при сборке с CONFIG+=countalloc (и в tests/allocations), иначе -1
+    static qint64 heapAllocations();
+
+private:
+    int poolWidth, poolHeight;
+
+    QList<QImage*> freeImages;
+    QList<QImage*> allImages;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,179 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include "framesource.h"
+#include "luminance.h"
+
+FrameSource::FrameSource() :
+    index(0), list(false), readingVideo(false), grayscale(false)
+{
+}
+
+bool FrameSource::open(const QString &input)
+{
+    index = 0;
+    files.clear();
+    list = false;
+    readingVideo = false;
+    reader.close();
+
+    QFileInfo info(input);
+    if (info.isDir())
+    {
+        QDir dir(input);
+        files = dir.entryList(QString(SequenceImageFilters).split(' '), QDir::Files, QDir::Name);
+        for (int i = 0; i < files.size(); i++)
+            files[i] = dir.absoluteFilePath(files.at(i));
+        return !files.isEmpty();
+    }
+
+    if (info.suffix().compare(FrameListSuffix, Qt::CaseInsensitive) == 0)
+    {
+        QFile file(input);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return false;
+
+        // Относительные имена - от каталога списка
+        QDir base = info.absoluteDir();
+        QTextStream stream(&file);
+        stream.setCodec("UTF-8");
+        while (!stream.atEnd())
+        {
+            QString name = stream.readLine().trimmed();
+            if (!name.isEmpty())
+                files << base.absoluteFilePath(name);
+        }
+        list = true;
+        return !files.isEmpty();
+    }
+    return reader.open(input);
+}
+
+bool FrameSource::readFrame(QImage &frame)
+{
+    if (!nextFrame(frame))
+        return false;
+
+    if (grayscale && !isGrayscale(frame))
+    {
+        QImage luma;
+        luminance(frame, luma);
+        frame = luma;
+    }
+    return true;
+}
+
+bool FrameSource::nextFrame(QImage &frame)
+{
+    if (files.isEmpty())
+        return reader.readFrame(frame);
+
+    for (;;)
+    {
+        // Видео из списка читается до конца, затем следующий файл
+        if (readingVideo)
+        {
+            if (reader.readFrame(frame))
+                return true;
+            reader.close();
+            readingVideo = false;
+        }
+        if (index >= files.size())
+            return false;
+
+        const QString& name = files.at(index++);
+        if (list && VideoReader::isVideoFile(name))
+        {
+            readingVideo = reader.open(name);
+            continue;
+        }
+        if (frame.load(name))
+        {
+            frame = frame.convertToFormat(QImage::Format_RGB32);
+            return true;
+        }
+        // Нечитаемый файл списка пропускается, как при открытии в окне
+        if (!list)
+            return false;
+    }
+}
+
+int FrameSource::skip(int count)
+{
+    // В каталоге кадр - файл; в списке файл может быть видео или не читаться
+    if (!files.isEmpty() && !list)
+    {
+        int skipped = qMin(count, files.size() - index);
+        index += skipped;
+        return skipped;
+    }
+
+    QImage frame;
+    int skipped = 0;
+    while (skipped < count && nextFrame(frame))
+        skipped++;
+    return skipped;
+}
+
+int FrameSource::imageCount(const QString &input)
+{
+    return QDir(input).entryList(QString(SequenceImageFilters).split(' '), QDir::Files).size();
+}
+
+bool FrameSource::writeList(const QString &fileName, const QStringList &files)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    foreach (const QString& name, files)
+        stream << QFileInfo(name).absoluteFilePath() << '\n';
+
+    stream.flush();
+    if (stream.status() != QTextStream::Ok)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool learnSequence(FrameSource &source, const QString &input, int first, int last,
+                   Recognizer &recognizer, QString &error)
+{
+    QImage frame;
+    int learned = 0;
+    for (int i = 0; i <= last && source.readFrame(frame); i++)
+    {
+        if (i < first)
+            continue;
+        if (learned == 0)
+            recognizer.beginLearning(frame);
+        else if (frame.width() != recognizer.width() || frame.height() != recognizer.height())
+        {
+            error = QString("размер кадра %1 не совпадает с первым").arg(i);
+            return false;
+        }
+        recognizer.learnFrame(frame);
+        learned++;
+    }
+    if (learned == 0)
+    {
+        error = "нет кадров обучения";
+        return false;
+    }
+    recognizer.endLearning();
+
+    // Распознавание идет заново с начала
+    if (!source.open(input))
+    {
+        error = "не удалось открыть вход";
+        return false;
+    }
+    return true;
+}
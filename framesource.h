@@ -0,0 +1,54 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+// Кадры последовательности без окна: видео, каталог изображений (по именам) или список
+// файлов *.list - по изображению или видео на строку, как их открывает окно.
+// Общий вход пакетного режима и повтора записанного сеанса.
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+#include "recognizer.h"
+#include "videostream.h"
+
+// Изображения каталога-последовательности
+#define SequenceImageFilters "*.png *.xpm *.jpg *.jpeg *.bmp"
+// Расширение списка файлов
+#define FrameListSuffix "list"
+
+// Кадры по порядку, RGB32 (или яркость, см. setGrayscale). open() начинает сначала
+class FrameSource
+{
+public:
+    FrameSource();
+
+    bool open(const QString& input);
+    bool readFrame(QImage& frame);
+    // Пропускает count кадров, возвращает, сколько пропущено. Видео декодируется подряд
+    int skip(int count);
+    // Кадры переводятся в яркость (Indexed8), как при загрузке в сером режиме окна
+    void setGrayscale(bool gray) { grayscale = gray; }
+
+    // Изображений в каталоге; у видео - 0
+    static int imageCount(const QString& input);
+    // Список для open(): абсолютные имена, по одному на строку
+    static bool writeList(const QString& fileName, const QStringList& files);
+
+private:
+    bool nextFrame(QImage& frame);
+
+    VideoReader reader;
+    QStringList files;
+    int index;
+    // Вход - список: видео в нем читаются через reader, нечитаемые файлы пропускаются
+    bool list;
+    bool readingVideo;
+    bool grayscale;
+};
+
+// Обучение recognizer на кадрах first..last входа, все в вызывающем потоке.
+// После него source открыт заново с начала. false - ошибка в error
+bool learnSequence(FrameSource& source, const QString& input, int first, int last,
+                   Recognizer& recognizer, QString& error);
+
+#endif // FRAMESOURCE_H
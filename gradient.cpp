@@ -0,0 +1,219 @@
+#include "gradient.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static void prepare(QImage& image, int width, int height)
+{
+    if (image.width() != width || image.height() != height || image.format() != QImage::Format_Indexed8)
+        image = QImage(width, height, QImage::Format_Indexed8);
+    image.setColorTable(grayColorTable());
+}
+
+static inline int avg(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+// Суммы по столбцам и строкам ядра Собеля считаются усреднениями (как _mm_avg_epu8),
+// поэтому весь расчет укладывается в байты: результат ~ (|Gx| + |Gy|) / 8
+static inline uchar sobel(const uchar* y1, const uchar* y2, const uchar* y3, int x)
+{
+    int left  = avg(avg(y1[x - 1], y3[x - 1]), y2[x - 1]);
+    int right = avg(avg(y1[x + 1], y3[x + 1]), y2[x + 1]);
+    int top   = avg(avg(y1[x - 1], y1[x + 1]), y1[x]);
+    int bottom= avg(avg(y3[x - 1], y3[x + 1]), y3[x]);
+    return (uchar)avg(qAbs(right - left), qAbs(bottom - top));
+}
+
+#ifdef __SSE2__
+static inline __m128i absDiff(__m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+#endif
+
+void gradientMagnitude(const uchar *src, int srcStride, uchar *dst, int dstStride, int width, int height)
+{
+    if (width < 3 || height < 3)
+    {
+        for (int y = 0; y < height; y++)
+            memset(dst + y * dstStride, 0, width);
+        return;
+    }
+
+    memset(dst, 0, width);
+    memset(dst + (height - 1) * dstStride, 0, width);
+
+    for (int y = 1; y < height - 1; y++)
+    {
+        const uchar* y1 = src + (y - 1) * srcStride;
+        const uchar* y2 = y1 + srcStride;
+        const uchar* y3 = y2 + srcStride;
+        uchar* pixel = dst + y * dstStride;
+
+        pixel[0] = 0;
+        int x = 1;
+
+#ifdef __SSE2__
+        // 16 точек за проход
+        for (; x + 16 < width; x += 16)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(y1 + x - 1));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(y1 + x));
+            __m128i a2 = _mm_loadu_si128((const __m128i*)(y1 + x + 1));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(y2 + x - 1));
+            __m128i b2 = _mm_loadu_si128((const __m128i*)(y2 + x + 1));
+            __m128i c0 = _mm_loadu_si128((const __m128i*)(y3 + x - 1));
+            __m128i c1 = _mm_loadu_si128((const __m128i*)(y3 + x));
+            __m128i c2 = _mm_loadu_si128((const __m128i*)(y3 + x + 1));
+
+            __m128i left  = _mm_avg_epu8(_mm_avg_epu8(a0, c0), b0);
+            __m128i right = _mm_avg_epu8(_mm_avg_epu8(a2, c2), b2);
+            __m128i top   = _mm_avg_epu8(_mm_avg_epu8(a0, a2), a1);
+            __m128i bottom= _mm_avg_epu8(_mm_avg_epu8(c0, c2), c1);
+
+            _mm_storeu_si128((__m128i*)(pixel + x),
+                             _mm_avg_epu8(absDiff(right, left), absDiff(bottom, top)));
+        }
+#endif
+
+        for (; x < width - 1; x++)
+            pixel[x] = sobel(y1, y2, y3, x);
+
+        pixel[width - 1] = 0;
+    }
+}
+
+void gradientMagnitude(const QImage &luma, QImage &gradient)
+{
+    prepare(gradient, luma.width(), luma.height());
+    gradientMagnitude(luma.constBits(), luma.bytesPerLine(), gradient.bits(), gradient.bytesPerLine(),
+                      luma.width(), luma.height());
+}
+
+void gradientMask(const QImage &gradient, QImage &edges, int threshold)
+{
+    int width = gradient.width();
+    int height= gradient.height();
+
+    if (edges.width() != width || edges.height() != height || edges.format() != QImage::Format_Indexed8)
+        edges = QImage(width, height, QImage::Format_Indexed8);
+    QVector<QRgb> maskColorTable;
+    maskColorTable << 0xFF000000;
+    maskColorTable << 0xFFFFFFFF;
+    edges.setColorTable(maskColorTable);
+
+    for (int y = 0; y < height; y++)
+    {
+        const uchar* magnitude = gradient.constScanLine(y);
+        uchar* pixel = edges.scanLine(y);
+        for (int x = 0; x < width; x++)
+            pixel[x] = (magnitude[x] > threshold) ? 1 : 0;
+    }
+}
+
+// Изменение текстуры (|a - b| > threshold) упаковывается по биту на точку:
+// бит j слова i - точка 32 i + j. Дальнейшее расширение идет над словами
+static void textureChange(const uchar* a, const uchar* b, quint32* bits, int width, int threshold)
+{
+    memset(bits, 0, ((width + 31) / 32) * sizeof(quint32));
+
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i thr  = _mm_set1_epi8((char)threshold);
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+        // diff <= threshold  <=>  diff - threshold == 0 (с насыщением)
+        __m128i small = _mm_cmpeq_epi8(_mm_subs_epu8(absDiff(va, vb), thr), zero);
+        quint32 changed = (~_mm_movemask_epi8(small)) & 0xFFFF;
+        bits[x >> 5] |= changed << (x & 31);
+    }
+#endif
+    for (; x < width; x++)
+        if (qAbs((int)a[x] - (int)b[x]) > threshold)
+            bits[x >> 5] |= 1u << (x & 31);
+}
+
+// Расширение строки бит: бит p результата - OR бит p - radius .. p + radius, radius < 32
+static void dilateBits(const quint32* src, quint32* dst, int words, int radius)
+{
+    for (int i = 0; i < words; i++)
+    {
+        quint64 prev = (i > 0) ? src[i - 1] : 0;
+        quint64 cur  = src[i];
+        quint64 next = (i + 1 < words) ? src[i + 1] : 0;
+
+        quint64 right = (next << 32) | cur;  // точки правее
+        quint64 left  = (cur << 32) | prev;  // точки левее
+
+        quint64 v = cur;
+        for (int d = 1; d <= radius; d++)
+            v |= (right >> d) | (left >> (32 - d));
+        dst[i] = (quint32)v;
+    }
+}
+
+void refineByEdges(QImage *mask, const QImage &gradient, const QImage &backgroundGradient,
+                   int threshold, int radius, QImage &scratch1, QImage &scratch2)
+{
+    int width = mask->width();
+    int height= mask->height();
+    int words = (width + 31) / 32;
+
+    prepare(scratch1, width, height);
+    prepare(scratch2, width, height);
+
+    radius = qBound(0, radius, 31);
+
+    // Строки бит (width / 8 байт) помещаются в строки буферов
+    quint32* rowBits = (quint32*)scratch2.scanLine(0);
+    quint32* nearBits= (quint32*)scratch2.scanLine(qMin(1, height - 1));
+
+    // Изменение текстуры относительно фона, сразу расширенное по строке
+    for (int y = 0; y < height; y++)
+    {
+        textureChange(gradient.constScanLine(y), backgroundGradient.constScanLine(y), rowBits, width, threshold);
+        dilateBits(rowBits, (quint32*)scratch1.scanLine(y), words, radius);
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        // Расширение по столбцу
+        memset(nearBits, 0, words * sizeof(quint32));
+        for (int ty = qMax(y - radius, 0); ty <= qMin(y + radius, height - 1); ty++)
+        {
+            const quint32* line = (const quint32*)scratch1.constScanLine(ty);
+            for (int i = 0; i < words; i++)
+                nearBits[i] |= line[i];
+        }
+
+        // Пересечение с маской
+        uchar* pixel = mask->scanLine(y);
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i bitPattern = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                                (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+        for (; x + 16 <= width; x += 16)
+        {
+            quint32 near = (nearBits[x >> 5] >> (x & 31)) & 0xFFFF;
+            // 16 бит -> 16 байт 0x00 / 0xFF
+            __m128i expanded = _mm_set_epi64x((long long)((near >> 8) * 0x0101010101010101ULL),
+                                              (long long)((near & 0xFF) * 0x0101010101010101ULL));
+            expanded = _mm_cmpeq_epi8(_mm_and_si128(expanded, bitPattern), bitPattern);
+
+            _mm_storeu_si128((__m128i*)(pixel + x),
+                             _mm_and_si128(_mm_loadu_si128((const __m128i*)(pixel + x)), expanded));
+        }
+#endif
+        for (; x < width; x++)
+            if (!((nearBits[x >> 5] >> (x & 31)) & 1))
+                pixel[x] = 0;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+// Градиент яркости и уточнение маски по границам.
+// Одноканальные изображения - Indexed8 с серой палитрой.
+
+#include <QImage>
+
+#include "luminance.h"
+
+// Модуль градиента Собеля ~(|Gx| + |Gy|) / 8 (суммы ядра считаются усреднениями), значения 0..255. Крайние строки и столбцы - 0
+void gradientMagnitude(const QImage& luma, QImage& gradient);
+void gradientMagnitude(const uchar* src, int srcStride, uchar* dst, int dstStride, int width, int height);
+
+// Порог модуля градиента: 1 - граница, 0 - нет
+void gradientMask(const QImage& gradient, QImage& edges, int threshold);
+
+// Оставляет в маске только точки не дальше radius от изменения текстуры
+// |gradient - backgroundGradient| > threshold. Тени и блики текстуру фона сохраняют,
+// поэтому большей частью отбрасываются. scratch1, scratch2 - временные буферы того же размера
+void refineByEdges(QImage* mask, const QImage& gradient, const QImage& backgroundGradient,
+                   int threshold, int radius, QImage& scratch1, QImage& scratch2);
+
+#endif // GRADIENT_H
@@ -0,0 +1,84 @@
+#include "luminance.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static QVector<QRgb> createGrayColorTable()
+{
+    QVector<QRgb> grayTable;
+    grayTable.reserve(256);
+    for (unsigned int i = 0; i < 256; i++)
+        grayTable << (0xFF000000 | (i << 16) | (i << 8) | i);
+    return grayTable;
+}
+
+const QVector<QRgb>& grayColorTable()
+{
+    static const QVector<QRgb> grayTable = createGrayColorTable();
+    return grayTable;
+}
+
+bool isGrayscale(const QImage &image)
+{
+    return image.format() == QImage::Format_Indexed8 && image.colorCount() == 256;
+}
+
+void luminance(const QRgb *src, uchar *dst, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    // 16 точек за проход: каналы раскладываются в 16-битные слова,
+    // сумма 77 R + 150 G + 29 B < 65536 помещается в беззнаковое слово
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i coefR = _mm_set1_epi16(77);
+    const __m128i coefG = _mm_set1_epi16(150);
+    const __m128i coefB = _mm_set1_epi16(29);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i y16[2];
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)(src + i + 8 * h));
+            __m128i v1 = _mm_loadu_si128((const __m128i*)(src + i + 8 * h + 4));
+
+            __m128i B = _mm_packs_epi32(_mm_and_si128(v0, byteMask),
+                                        _mm_and_si128(v1, byteMask));
+            __m128i G = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v0, 8), byteMask),
+                                        _mm_and_si128(_mm_srli_epi32(v1, 8), byteMask));
+            __m128i R = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v0, 16), byteMask),
+                                        _mm_and_si128(_mm_srli_epi32(v1, 16), byteMask));
+
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(R, coefR), _mm_mullo_epi16(G, coefG)),
+                                        _mm_mullo_epi16(B, coefB));
+            y16[h] = _mm_srli_epi16(sum, 8);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(y16[0], y16[1]));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = (77 * qRed(src[i]) + 150 * qGreen(src[i]) + 29 * qBlue(src[i])) >> 8;
+}
+
+void luminance(const QImage &frame, QImage &luma)
+{
+    int width = frame.width();
+    int height= frame.height();
+
+    if (luma.width() != width || luma.height() != height || luma.format() != QImage::Format_Indexed8)
+        luma = QImage(width, height, QImage::Format_Indexed8);
+    luma.setColorTable(grayColorTable());
+
+    if (isGrayscale(frame))
+    {
+        for (int y = 0; y < height; y++)
+            memcpy(luma.scanLine(y), frame.constScanLine(y), width);
+        return;
+    }
+
+    for (int y = 0; y < height; y++)
+        luminance((const QRgb*)frame.constScanLine(y), luma.scanLine(y), width);
+}
@@ -0,0 +1,18 @@
+#ifndef LUMINANCE_H
+#define LUMINANCE_H
+// Перевод в яркость (Y8).
+// Одноканальное изображение - Indexed8 с серой палитрой: его можно сразу
+// показывать, классифицировать и передавать в gradientMagnitude без копий.
+
+#include <QImage>
+#include <QVector>
+
+// Y = (77 R + 150 G + 29 B) / 256
+void luminance(const QRgb* src, uchar* dst, int count);
+void luminance(const QImage& frame, QImage& luma);
+
+// Общая серая палитра: присваивание ее изображению не выделяет память
+const QVector<QRgb>& grayColorTable();
+bool isGrayscale(const QImage& image);
+
+#endif // LUMINANCE_H
@@ -1,8 +1,20 @@
 #include "mainwindow.h"
+#include "batch.h"
+#include "session.h"
 #include <QApplication>
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
+    // Пакетный режим, повтор сеанса работают без окна
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--batch") == 0)
+            return runBatch(argc, argv);
+        if (strcmp(argv[i], "--replay") == 0)
+            return runReplay(argc, argv);
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -1,38 +1,81 @@
+#include <algorithm>
 #include <cmath>
 
+#include <QApplication>
+#include <QDir>
+#include <QFile>
 #include <QFileDialog>
 #include <QProgressDialog>
-#include <QDateTime>
-#include <QTest>
 #include <QMessageBox>
-#include <QPainter>
-#include <QQueue>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
-#include "components.h"
+#include "framesource.h"
+#include "videostream.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    progressDialog(0),
+    playIndex(0),
+    loadsPending(0),
+    openedGray(false),
+    learnedFirst(-1),
+    learnedLast(-1)
 {
     ui->setupUi(this);
 
+    worker = new Worker(&recognizer, this);
+    thumbnails = new ThumbnailLoader(this);
+    maskArchiveName = QDir::temp().filePath(QString("pathAnalyzer-%1.masks").arg(QCoreApplication::applicationPid()));
+
     connect(ui->buttonLoad,     SIGNAL(clicked()), this, SLOT(openImages()));
     connect(ui->buttonClear,    SIGNAL(clicked()), this, SLOT(clearImageList()));
     connect(ui->buttonPlay,     SIGNAL(clicked()), this, SLOT(play()));
     connect(ui->buttonLearn,    SIGNAL(clicked()), this, SLOT(learn()));
     connect(ui->buttonRecognize,SIGNAL(clicked()), this, SLOT(recognize()));
+    connect(ui->buttonVideo,    SIGNAL(clicked()), this, SLOT(recognizeVideo()));
+    connect(ui->buttonTracks,   SIGNAL(clicked()), this, SLOT(exportTracks()));
+    connect(ui->buttonSession,  SIGNAL(clicked()), this, SLOT(saveSession()));
+    connect(ui->buttonSweep,    SIGNAL(clicked()), this, SLOT(sweep()));
 
     connect(ui->listItem,       SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(itemClicked(QListWidgetItem*)));
 
     connect(ui->spinSigmaMax,   SIGNAL(valueChanged(double)), this, SLOT(spinSigmaMinChanged(double)));
-
-    sigmamin = 5;
+    connect(ui->checkEdges,     SIGNAL(toggled(bool)), this, SLOT(checkEdgesToggled(bool)));
+    connect(ui->spinEdge,       SIGNAL(valueChanged(int)), this, SLOT(spinEdgeChanged(int)));
+    connect(ui->checkGray,      SIGNAL(toggled(bool)), this, SLOT(checkGrayToggled(bool)));
+    connect(ui->spinTiles,      SIGNAL(valueChanged(int)), this, SLOT(spinTilesChanged(int)));
+    connect(ui->comboScale,     SIGNAL(currentIndexChanged(int)), this, SLOT(comboScaleChanged(int)));
+    connect(ui->comboCovariance,SIGNAL(currentIndexChanged(int)), this, SLOT(comboCovarianceChanged(int)));
+    connect(ui->checkHsv,       SIGNAL(toggled(bool)), this, SLOT(checkHsvToggled(bool)));
+    connect(ui->checkShadows,   SIGNAL(toggled(bool)), this, SLOT(checkShadowsToggled(bool)));
+    connect(ui->spinK,          SIGNAL(valueChanged(double)), this, SLOT(spinKChanged(double)));
+    connect(ui->spinRadius,     SIGNAL(valueChanged(int)), this, SLOT(spinRadiusChanged(int)));
+    connect(ui->comboDistances, SIGNAL(currentIndexChanged(int)), this, SLOT(comboDistancesChanged(int)));
+    connect(ui->spinHysteresis, SIGNAL(valueChanged(double)), this, SLOT(spinHysteresisChanged(double)));
+    connect(ui->spinVote,       SIGNAL(valueChanged(int)), this, SLOT(spinVoteChanged(int)));
+    connect(ui->checkReconstruct, SIGNAL(toggled(bool)), this, SLOT(checkReconstructToggled(bool)));
+    connect(ui->checkHoles,     SIGNAL(toggled(bool)), this, SLOT(checkHolesToggled(bool)));
+
+    connect(&playTimer,         SIGNAL(timeout()), this, SLOT(playNext()));
+
+    connect(worker, SIGNAL(progress(int,int)), this, SLOT(jobProgress(int,int)));
+    connect(worker, SIGNAL(frameRecognized(int,QImage,xy)), this, SLOT(frameRecognized(int,QImage,xy)));
+    connect(worker, SIGNAL(distancesComputed(int,DistanceMap)), this, SLOT(distancesComputed(int,DistanceMap)));
+    connect(worker, SIGNAL(failed(QString)), this, SLOT(jobFailed(QString)));
+    connect(worker, SIGNAL(finished()), this, SLOT(jobFinished()));
+    connect(thumbnails, SIGNAL(frameLoaded(int,int,QImage,QImage)), this, SLOT(frameLoaded(int,int,QImage,QImage)));
+    connect(thumbnails, SIGNAL(videoLoaded(int,int)), this, SLOT(videoLoaded(int,int)));
+
+    useGray = false;
 }
 
 MainWindow::~MainWindow()
 {
+    // Кадры и recognizer нужны потоку до его завершения
+    worker->cancel();
+    worker->wait();
     clearLists();
     delete ui;
 }
@@ -41,103 +84,285 @@ void MainWindow::openImages()
 {
     QFileDialog dialog(this);
     dialog.setFileMode(QFileDialog::ExistingFiles);
-    dialog.setNameFilter(tr("Images (*.png *.xpm *.jpg *.jpeg *.bmp)"));
+    dialog.setNameFilters(QStringList() << tr("Images (*.png *.xpm *.jpg *.jpeg *.bmp)")
+                                        << tr("Video (*.y4m *.avi *.mp4 *.mkv *.mov *.mjpg *.mjpeg)"));
     dialog.setViewMode(QFileDialog::List);
+    if (!dialog.exec())
+        return;
 
-    QProgressDialog progress("Открытие файлов", "Остановить", 0, 1, this);
-    progress.setWindowTitle("Открытие последовательности изображений");
-    progress.setWindowModality(Qt::WindowModal);
+    QStringList fileNames = dialog.selectedFiles();
+    if (openedFiles.isEmpty())
+        openedGray = useGray;
+    openedFiles += fileNames;
+
+    // Файлы читаются в потоках ThumbnailLoader; пока они читаются, задачи не запускаются,
+    // а "Очистить" прерывает чтение
+    loadQueue += fileNames;
+    setBusy(true);
+    ui->buttonClear->setEnabled(true);
+    continueLoading();
+}
 
-    QStringList fileNames;
-    if (dialog.exec())
+void MainWindow::continueLoading()
+{
+    // Изображения до ближайшего видео сразу становятся строками списка. Номера кадров после
+    // видео известны, только когда оно прочитано: очередь продолжается по videoLoaded
+    while (!loadQueue.isEmpty())
     {
-        fileNames = dialog.selectedFiles();
-        progress.setMaximum(fileNames.size());
-        imageList.reserve(fileNames.size());
-        QString iter;
-        int i = 0;
-        foreach (iter, fileNames)
+        QString fileName = loadQueue.takeFirst();
+        loadsPending++;
+        if (VideoReader::isVideoFile(fileName))
         {
-            if (i % 10 == 0)
-                progress.setValue(i);
-            QImage* image = new QImage;
-            if (image->load(iter))
-            {
-                //convertToGrayscale(*image);
-                *image = image->convertToFormat(QImage::Format_RGB32);
-                if (i == 0)
-                    pixelCount = image->byteCount() / 4;
-
-                QListWidgetItem *newItem = new QListWidgetItem;
-                newItem->setText(QString("frame %1").arg(i));
-                imageList << image;
-                newItem->setIcon(QIcon(QPixmap::fromImage(image->scaled(100, 100))));
-                ui->listItem->insertItem(i++, newItem);
-            }
-
-            if (progress.wasCanceled())
-                break;
+            thumbnails->flush();
+            thumbnails->loadVideo(imageList.size(), fileName, useGray);
+            return;
         }
+        insertFrame();
+        thumbnails->loadImage(imageList.size() - 1, fileName, useGray);
+    }
+    thumbnails->flush();
+
+    if (loadsPending == 0)
+        finishLoading();
+}
+
+void MainWindow::insertFrame()
+{
+    QListWidgetItem *newItem = new QListWidgetItem;
+    newItem->setText(QString("frame %1").arg(imageList.size()));
+    imageList << 0;
+    ui->listItem->addItem(newItem);
+}
+
+void MainWindow::frameLoaded(int generation, int index, const QImage &image, const QImage &thumbnail)
+{
+    // Кадр списка, очищенного после запроса
+    if (generation != thumbnails->currentGeneration())
+        return;
+
+    // Строка изображения уже есть, строки видео добавляются по мере чтения
+    bool video = index == imageList.size();
+    if (video)
+        insertFrame();
+    if (!image.isNull())
+    {
+        imageList[index] = new QImage(image);
+        ui->listItem->item(index)->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+    }
+
+    if (!video && --loadsPending == 0 && loadQueue.isEmpty())
+        finishLoading();
+}
+
+void MainWindow::videoLoaded(int generation, int frames)
+{
+    Q_UNUSED(frames);
+    if (generation != thumbnails->currentGeneration())
+        return;
+
+    loadsPending--;
+    continueLoading();
+}
+
+void MainWindow::finishLoading()
+{
+    // Непрочитанные изображения убираются, как будто их не выбирали
+    for (int i = imageList.size() - 1; i >= 0; i--)
+    {
+        if (imageList.at(i))
+            continue;
+        imageList.removeAt(i);
+        delete ui->listItem->takeItem(i);
     }
+    for (int i = 0; i < ui->listItem->count(); i++)
+        ui->listItem->item(i)->setText(QString("frame %1").arg(i));
+
+    setBusy(false);
 }
 
 void MainWindow::clearImageList()
 {
+    stopPlaying();
+    setBusy(false);
     ui->listItem->clear();
     clearLists();
 }
 
 void MainWindow::play()
 {
-    playImages(imageList);
+    if (playTimer.isActive())
+        stopPlaying();
+    else
+        playImages();
 }
 
 void MainWindow::recognize()
 {
-    substractBackground();
-    getCentresOfMass();
-    applyBorders();
-    foreach (QImage* iter, imageList)
+    if (!recognizer.hasModel() || imageList.isEmpty())
+    {
+        QMessageBox(QMessageBox::Critical, "Ошибка распознавания", "Фон не обучен").exec();
+        return;
+    }
+
+    clearMasks();
+    foreach (QImage* iter, imagesWithMasks)
     {
         delete iter;
     }
-    imageList.clear();
-    imageList = imagesWithMasks;
     imagesWithMasks.clear();
-    playImages(imageList);
+    centresOfMass.clear();
+    distanceMaps.clear();
+
+    imagesWithMasks.reserve(imageList.size());
+    centresOfMass.reserve(imageList.size());
+
+    startJob("Распознавание");
+    worker->recognize(imageList, maskArchiveName);
 }
 
 void MainWindow::itemClicked(QListWidgetItem *item)
 {
     int index = ui->listItem->row(item);
 
-    ui->imageView->setPixmap(QPixmap::fromImage(*(imageList.at(index))));
+    // С Ctrl - маска кадра из архива последнего распознавания
+    QImage mask;
+    if ((QApplication::keyboardModifiers() & Qt::ControlModifier) && maskArchive.read(index, mask))
+    {
+        ui->imageView->setPixmap(QPixmap::fromImage(mask));
+        return;
+    }
+
+    // Кадр, который еще читается, не показывается
+    if (imageList.at(index))
+        ui->imageView->setPixmap(QPixmap::fromImage(*(imageList.at(index))));
 }
 
 void MainWindow::spinSigmaMinChanged(double newValue)
 {
-    sigmamin = (float)newValue;
+    settings.sigmamin = (float)newValue;
 }
 
-void MainWindow::playImages(QList<QImage*>& pixmap)
+void MainWindow::checkEdgesToggled(bool checked)
 {
-    QProgressDialog progress("воспроизведение", "Остановить", 0, pixmap.size(), this);
-    //progress.setWindowModality(Qt::WindowModal);
-    progress.setValue(0);
-    progress.open();
-    int i = 0;
-    qint64 now = QDateTime::currentMSecsSinceEpoch();
-    qint64 waitTime;
-    foreach (QImage *iter, pixmap)
+    settings.useEdges = checked;
+}
+
+void MainWindow::spinEdgeChanged(int newValue)
+{
+    settings.edgeThreshold = newValue;
+}
+
+void MainWindow::checkGrayToggled(bool checked)
+{
+    useGray = checked;
+}
+
+void MainWindow::spinTilesChanged(int newValue)
+{
+    settings.tileThreshold = newValue;
+}
+
+void MainWindow::comboScaleChanged(int index)
+{
+    // 1:1, 1:2, 1:4
+    settings.pyramidScale = 1 << index;
+}
+
+void MainWindow::comboCovarianceChanged(int index)
+{
+    // Полная, диагональная, изотропная - в порядке CovarianceType
+    settings.covariance = (CovarianceType)index;
+}
+
+void MainWindow::checkHsvToggled(bool checked)
+{
+    settings.colorSpace = checked ? HsvSpace : RgbSpace;
+}
+
+void MainWindow::checkShadowsToggled(bool checked)
+{
+    settings.suppressShadows = checked;
+}
+
+void MainWindow::spinKChanged(double newValue)
+{
+    settings.thresholdK = (float)newValue;
+    showThreshold();
+}
+
+void MainWindow::spinRadiusChanged(int newValue)
+{
+    settings.openingRadius = newValue;
+}
+
+void MainWindow::comboDistancesChanged(int index)
+{
+    // Нет, 8 бит, 16 бит
+    settings.distanceDepth = index * 8;
+}
+
+void MainWindow::spinHysteresisChanged(double newValue)
+{
+    settings.hysteresisK = (float)newValue;
+}
+
+void MainWindow::spinVoteChanged(int newValue)
+{
+    settings.voteFrames = newValue;
+}
+
+void MainWindow::checkReconstructToggled(bool checked)
+{
+    settings.reconstruct = checked;
+}
+
+void MainWindow::checkHolesToggled(bool checked)
+{
+    settings.fillHoles = checked;
+}
+
+void MainWindow::showThreshold()
+{
+    // Маска выбранного кадра по сохраненным расстояниям, без размыкания и уточнения
+    if (distanceMaps.isEmpty() || worker->isRunning())
+        return;
+
+    stopPlaying();
+    int index = ui->listItem->currentRow();
+    if (index < 0 || index >= distanceMaps.size() || distanceMaps.at(index).isEmpty())
+        return;
+    const DistanceMap& map = distanceMaps.at(index);
+    QImage mask(map.width(), map.height(), QImage::Format_Indexed8);
+    mask.setColorTable(Recognizer::maskColorTable());
+    map.threshold(settings.thresholdK, mask);
+    ui->imageView->setPixmap(QPixmap::fromImage(mask));
+}
+
+void MainWindow::playImages()
+{
+    // Кадры показывает таймер, окно при этом не блокируется
+    playIndex = 0;
+    playTimer.start(fps);
+    ui->buttonPlay->setText("Stop");
+}
+
+void MainWindow::stopPlaying()
+{
+    playTimer.stop();
+    ui->buttonPlay->setText("Play");
+}
+
+void MainWindow::playNext()
+{
+    if (playIndex >= imageList.size())
     {
-        now += fps;
-        progress.setValue(i++);
-        ui->imageView->setPixmap(QPixmap::fromImage(*iter));
-        if (progress.wasCanceled())
-            break;
-        waitTime = now - QDateTime::currentMSecsSinceEpoch();
-        QTest::qWait((waitTime > fps) ? 0 : waitTime);
+        stopPlaying();
+        return;
     }
+
+    const QImage* image = imageList.at(playIndex++);
+    if (image)
+        ui->imageView->setPixmap(QPixmap::fromImage(*image));
 }
 
 void MainWindow::learn()
@@ -150,106 +375,265 @@ void MainWindow::learn()
         return;
     }
 
-    fillBackg(pixelCount);
-
-    QProgressDialog progress("Обучение", "Остановить", 0, images, this);
-    progress.setWindowTitle("Обучение фоновыми изображениями");
-    progress.setWindowModality(Qt::WindowModal);
-
-    int i = 0;
+    // По порядку списка: обучение берет первые MaxLearningFrames кадров
+    QList<int> rows;
     foreach (QListWidgetItem *iter, selection)
     {
-        progress.setValue(i++);
+        rows << ui->listItem->row(iter);
+    }
+    std::sort(rows.begin(), rows.end());
+    QList<QImage*> frames;
+    frames.reserve(images);
+    foreach (int row, rows)
+    {
+        frames << imageList.at(row);
+    }
 
-        QImage* image = imageList.at(ui->listItem->row(iter));
+    // Сеанс воспроизводит только обучение по отрезку кадров
+    bool contiguous = rows.last() - rows.first() + 1 == rows.size();
+    learnedFirst = contiguous ? rows.first() : -1;
+    learnedLast = contiguous ? rows.first() + qMin(rows.size(), MaxLearningFrames) - 1 : -1;
 
-        // Добавление точек
-        QRgb* pixel = (QRgb*)image->bits();
-        for (int j = 0; j < pixelCount; j++, pixel++)
-            backg[j]->addItem(*pixel);
+    startJob("Обучение фоновыми изображениями");
+    worker->learn(frames);
+}
 
-        if (progress.wasCanceled())
-            break;
+void MainWindow::recognizeVideo()
+{
+    if (!recognizer.hasModel())
+    {
+        QMessageBox(QMessageBox::Critical, "Ошибка распознавания", "Фон не обучен").exec();
+        return;
     }
-    for (int j = 0; j < pixelCount; j++)
-        backg[j]->finalize();
 
-    QMessageBox(QMessageBox::Information, "Обучение", "Обучение завершено").exec();
+    QString inName = QFileDialog::getOpenFileName(this, "Видео для распознавания", QString(),
+                                                  tr("Video (*.y4m *.avi *.mp4 *.mkv *.mov *.mjpg *.mjpeg)"));
+    if (inName.isEmpty())
+        return;
+
+    QString outName = QFileDialog::getSaveFileName(this, "Сохранение результата", QString(),
+                                                   tr("Video (*.y4m *.avi *.mp4 *.mkv)"));
+    if (outName.isEmpty())
+        return;
+
+    startJob("Распознавание видео");
+    worker->recognizeVideo(inName, outName);
 }
 
-void MainWindow::substractBackground()
+void MainWindow::exportTracks()
 {
-    if (backg.size() == 0)
+    if (recognizer.tracks().size() == 0)
     {
+        QMessageBox(QMessageBox::Critical, "Ошибка сохранения", "Траекторий нет, сначала выполните распознавание").exec();
         return;
     }
 
-    QImage* firstFrame = imageList.first();
+    QString selectedFilter;
+    QString fileName = QFileDialog::getSaveFileName(this, "Сохранение траекторий", QString(),
+                                                    tr("CSV (*.csv);;Binary (*.bin)"), &selectedFilter);
+    if (fileName.isEmpty())
+        return;
 
-    QVector<QRgb> maskColorTable;
-    maskColorTable << 0xFF000000;
-    maskColorTable << 0xFFFFFFFF;
+    bool binary = fileName.endsWith(".bin", Qt::CaseInsensitive) ||
+                  (!fileName.endsWith(".csv", Qt::CaseInsensitive) && selectedFilter.startsWith("Binary"));
+    bool saved = binary ? recognizer.tracks().exportBinary(fileName) : recognizer.tracks().exportCsv(fileName);
+    if (!saved)
+        QMessageBox(QMessageBox::Critical, "Ошибка сохранения", "Не удалось записать файл").exec();
+}
 
-    int width = firstFrame->width();
-    int height= firstFrame->height();
+void MainWindow::saveSession()
+{
+    if (session.width == 0 || maskArchive.frameCount() < 2)
+    {
+        QMessageBox(QMessageBox::Critical, "Ошибка сохранения", "Сеанса нет, сначала выполните распознавание").exec();
+        return;
+    }
+    if (session.learnFirst < 0)
+    {
+        QMessageBox(QMessageBox::Critical, "Ошибка сохранения",
+                    "Обучение шло по несмежным кадрам, повтор его не воспроизведет").exec();
+        return;
+    }
 
-    QImage* mask = new QImage(width, height, QImage::Format_Indexed8);
-    mask->setColorTable(maskColorTable);
-    mask->fill(0);
+    QString fileName = QFileDialog::getSaveFileName(this, "Сохранение сеанса", QString(), tr("Session (*.session)"));
+    if (fileName.isEmpty())
+        return;
 
-    foreach (QImage* iter, masks) {
-        delete iter;
+    // Вход повтора - список открытых файлов рядом с сеансом: сеанс.list
+    session.input = fileName + "." FrameListSuffix;
+    session.maskHashes.clear();
+    QImage mask;
+    for (int i = session.firstFrame; i < maskArchive.frameCount(); i++)
+    {
+        if (!maskArchive.read(i, mask))
+        {
+            QMessageBox(QMessageBox::Critical, "Ошибка сохранения", "Не удалось прочитать архив масок").exec();
+            return;
+        }
+        session.maskHashes << Session::maskHash(mask);
     }
-    masks.clear();
-    masks.reserve(imageList.size());
-
-    QProgressDialog progress("Вычитание фона", "Остановить", 0, imageList.size(), this);
-    progress.setWindowTitle("Распознование");
-    progress.setWindowModality(Qt::WindowModal);
-    progress.setValue(0);
 
-    int prog = 1;
-    QList<QImage*>::iterator image = imageList.begin();
-    image++;
+    if (!FrameSource::writeList(session.input, openedFiles) || !session.save(fileName))
+        QMessageBox(QMessageBox::Critical, "Ошибка сохранения", "Не удалось записать файл").exec();
+}
 
-    masks << mask;
+void MainWindow::sweep()
+{
+    if (!recognizer.hasModel() || imageList.isEmpty())
+    {
+        QMessageBox(QMessageBox::Critical, "Ошибка подбора", "Фон не обучен").exec();
+        return;
+    }
 
-    QImage* blackDisk = disk(4, 0xFF000000);
-    QImage* whiteDisk = disk(4, 0xFFFFFFFF);
+    // Разметка - по маске на каждый загруженный кадр, в порядке имен файлов
+    QStringList truthNames = QFileDialog::getOpenFileNames(this, "Разметка кадров (объект - светлые точки)", QString(),
+                                                           tr("Images (*.png *.xpm *.jpg *.jpeg *.bmp)"));
+    if (truthNames.isEmpty())
+        return;
+    truthNames.sort();
+    if (truthNames.size() != imageList.size())
+    {
+        QMessageBox(QMessageBox::Critical, "Ошибка подбора", "Число масок разметки не совпадает с числом кадров").exec();
+        return;
+    }
 
-    for (; image != imageList.end(); image++)
+    QList<QImage> truths;
+    foreach (const QString& name, truthNames)
     {
-        if (prog++ % 10 == 0)
+        QImage truth;
+        if (!truth.load(name))
         {
-            progress.setValue(prog);
+            QMessageBox(QMessageBox::Critical, "Ошибка подбора", "Не удалось открыть " + name).exec();
+            return;
         }
+        truths << truth;
+    }
 
-        mask = new QImage(width, height, QImage::Format_Indexed8);
-        mask->setColorTable(maskColorTable);
+    QString outName = QFileDialog::getSaveFileName(this, "Сохранение результатов подбора", QString(), tr("CSV (*.csv)"));
+    if (outName.isEmpty())
+        return;
 
-        QRgb* imagePixel = (QRgb*)(*image)->bits();
-        uchar* maskPixel = mask->bits();
+    startJob("Подбор параметров");
+    worker->sweep(imageList, truths, outName);
+}
 
-        for (int i = 0; i < pixelCount; i++, imagePixel++, maskPixel++)
-        {
-            *maskPixel = (backg[i]->isBackground(*imagePixel)) ? 0 : 1;
-        }
+void MainWindow::startJob(const QString &title)
+{
+    // Настройки меняются только между задачами
+    recognizer.settings = settings;
+    setBusy(true);
+
+    progressDialog = new QProgressDialog(title, "Остановить", 0, 0, this);
+    progressDialog->setWindowTitle(title);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+    connect(progressDialog, SIGNAL(canceled()), worker, SLOT(cancel()), Qt::DirectConnection);
+    progressDialog->show();
+}
 
-        // Размыкание
-        dilation(mask, *blackDisk, 0xFF000000, 0xFFFFFFFF);
-        dilation(mask, *whiteDisk, 0xFFFFFFFF, 0xFF000000);
+void MainWindow::setBusy(bool busy)
+{
+    // Пока идет задача, список кадров и модель не меняются. Просмотр и воспроизведение доступны
+    ui->buttonLoad->setEnabled(!busy);
+    ui->buttonClear->setEnabled(!busy);
+    ui->buttonLearn->setEnabled(!busy);
+    ui->buttonRecognize->setEnabled(!busy);
+    ui->buttonVideo->setEnabled(!busy);
+    ui->buttonTracks->setEnabled(!busy);
+    ui->buttonSweep->setEnabled(!busy);
+}
 
-        //ui->imageView->setPixmap(QPixmap::fromImage(*mask));
-        //QMessageBox(QMessageBox::NoIcon, "Отладка", QString("%1 %2").arg(j).arg(d_max)).exec();
+void MainWindow::jobProgress(int done, int total)
+{
+    if (!progressDialog)
+        return;
 
-        masks << mask;
+    progressDialog->setMaximum(total);
+    progressDialog->setValue(total ? done : 0);
+}
 
-        if (progress.wasCanceled())
-            break;
+void MainWindow::frameRecognized(int index, const QImage &overlay, xy centre)
+{
+    Q_UNUSED(index);
+
+    // Кадры приходят по порядку. Последний готовый кадр сразу виден
+    imagesWithMasks << new QImage(overlay);
+    centresOfMass << centre;
+
+    if (!playTimer.isActive())
+        ui->imageView->setPixmap(QPixmap::fromImage(overlay));
+}
+
+void MainWindow::distancesComputed(int index, const DistanceMap &map)
+{
+    if (index < 0)
+        return;
+    if (index >= distanceMaps.size())
+        distanceMaps.resize(index + 1);
+    distanceMaps[index] = map;
+}
+
+void MainWindow::jobFailed(const QString &message)
+{
+    QMessageBox(QMessageBox::Critical, "Ошибка распознавания", message).exec();
+}
+
+void MainWindow::jobFinished()
+{
+    if (progressDialog)
+    {
+        progressDialog->close();
+        progressDialog = 0;
     }
+    setBusy(false);
+
+    switch (worker->task())
+    {
+    case Worker::Learn:
+        if (!worker->isCanceled())
+            QMessageBox(QMessageBox::Information, "Обучение", "Обучение завершено").exec();
+        break;
 
-    delete blackDisk;
-    delete whiteDisk;
+    case Worker::Recognize:
+    {
+        // Распознанные кадры заменяют исходные, при отмене остальные кадры остаются как были.
+        // В архиве - маски распознанных кадров
+        maskArchive.open(maskArchiveName);
+        recordSession();
+        stopPlaying();
+        thumbnails->cancel();
+        for (int i = 0; i < imagesWithMasks.size() && i < imageList.size(); i++)
+        {
+            delete imageList[i];
+            imageList[i] = imagesWithMasks[i];
+        }
+        imagesWithMasks.clear();
+        playImages();
+        break;
+    }
+
+    case Worker::RecognizeVideo:
+        break;
+
+    case Worker::Sweep:
+    {
+        // Лучшую конфигурацию можно сразу перенести в настройки. Отмененный подбор прошел не всю сетку
+        const SweepResult& best = worker->sweepBest();
+        if (worker->isCanceled() || best.frames == 0)
+            break;
+        QString text = QString("Лучшая по F1 конфигурация: sigmamin %1, k %2, радиус %3\n"
+                               "Точность %4, полнота %5, F1 %6\n\nПрименить эти параметры?")
+                .arg(best.sigmamin).arg(best.kValue).arg(best.radius)
+                .arg(best.precision(), 0, 'f', 3).arg(best.recall(), 0, 'f', 3).arg(best.f1(), 0, 'f', 3);
+        if (QMessageBox(QMessageBox::Question, "Подбор параметров", text, QMessageBox::Yes | QMessageBox::No).exec()
+                == QMessageBox::Yes)
+        {
+            ui->spinSigmaMax->setValue(best.sigmamin);
+            ui->spinK->setValue(best.kValue);
+            ui->spinRadius->setValue(best.radius);
+        }
+        break;
+    }
+    }
 }
 
 void MainWindow::substractBackground2()
@@ -367,286 +751,50 @@ void MainWindow::applyMasks()
         delete iter;
     }
     imagesWithMasks.clear();
-    imagesWithMasks.reserve(masks.size());
+    imagesWithMasks.reserve(maskArchive.frameCount());
 
-    for (int i = 0; i < masks.size(); i++)
+    QImage mask;
+    for (int i = 0; i < maskArchive.frameCount() && i < imageList.size() && maskArchive.read(i, mask); i++)
     {
         QImage* image = new QImage(*imageList[i]);
-        image->setAlphaChannel(*(masks[i]));
+        image->setAlphaChannel(mask);
         imagesWithMasks << image;
     }
 }
 
-QList<QImage*>* MainWindow::createBorders()
+void MainWindow::recordSession()
 {
-    QList<QImage*>* borders = new QList<QImage*>;
-    borders->reserve(masks.size());
-
-    QImage* temp;
-    QImage* firstFrame = masks[0];
-    int imageWidth = firstFrame->width();
-    int imageHeight= firstFrame->height();
-
-    QVector<QRgb> borderColorMask;
-    borderColorMask << 0x00000000;
-    borderColorMask << 0xFFFF0000;
-
-    foreach (QImage* iter, masks)
-    {
-        temp = new QImage(imageWidth, imageHeight, QImage::Format_Indexed8);
-        temp->setColorTable(borderColorMask);
-        temp->fill(0);
-
-        if (xy* croped = crop(*iter))
-        {
-            uchar* pixel1 = temp->scanLine(croped[0].y) + croped[0].x;
-            uchar* pixel2 = temp->scanLine(croped[1].y) + croped[0].x;
-
-            for (int x = croped[0].x; x <= croped[1].x; x++, pixel1++, pixel2++)
-            {
-                *pixel1 = 1; *pixel2 = 1;
-            }
-
-            pixel1 = temp->scanLine(croped[0].y) + croped[0].x;
-            pixel2 = temp->scanLine(croped[0].y) + croped[1].x;
-
-            for (int y = croped[0].y; y <= croped[1].y; y++, pixel1 += imageWidth, pixel2 += imageWidth)
-            {
-                *pixel1 = 1; *pixel2 = 1;
-            }
-
-            delete [] croped;
-        }
-
-        *borders << temp;
+    // Первый кадр окно не распознает: сеанс - со второго, строка профиля первого отбрасывается
+    session = Session();
+    session.learnFirst = learnedFirst;
+    session.learnLast = learnedLast;
+    session.firstFrame = 1;
+    session.width = maskArchive.width();
+    session.height = maskArchive.height();
+    session.gray = openedGray;
+    session.settings = recognizer.settings;
+
+    const StageProfile& profile = recognizer.profile();
+    qint64 times[StageCount];
+    for (int f = session.firstFrame; f < profile.frameCount(); f++)
+    {
+        for (int s = 0; s < StageCount; s++)
+            times[s] = profile.at(f, (Stage)s);
+        session.profile.appendFrame(times);
     }
-    return borders;
 }
 
-void MainWindow::applyBorders()
+void MainWindow::clearMasks()
 {
-    QList <xy> centres;
-    centres.reserve(QueueLength);
-
-    foreach (QImage* iter, imagesWithMasks)
-    {
-        delete iter;
-    }
-    imagesWithMasks.clear();
-    imagesWithMasks.reserve(masks.size());
-
-    QList<QImage*> *borders = createBorders();
-
-    QPen trajPen(QColor(Qt::red));
-
-    for (int i = 0; i < borders->size(); i++)
-    {
-        QImage* iter = borders->at(i);
-        QImage* image = new QImage(*imageList[i]);
-        xy centre = centresOfMass[i];
-
-        if (centre.x > 0)
-        {
-            if (centres.size() == QueueLength)
-            {
-                centres.removeFirst();
-            }
-            centres << centre;
-        }
-
-        QPainter paint;
-        paint.begin(image);
-        paint.drawImage(0, 0, *iter);
-
-        // Рисование траекторий
-        paint.setPen(trajPen);
-        if (centres.size() > 1)
-            for (QList<xy>::iterator iter = centres.begin() + 1, iter1 = centres.begin();
-                 iter != centres.end(); iter++, iter1++)
-            {
-                paint.drawLine(iter1->x, iter1->y, iter->x, iter->y);
-                paint.drawRect(iter->x - 2, iter->y - 2, 4, 4);
-            }
-
-        paint.end();
-
-        imagesWithMasks << image;
-
-        delete iter;
-    }
-    borders->clear();
-    delete borders;
-}
-
-void MainWindow::getCentresOfMass()
-{
-    centresOfMass.clear();
-    centresOfMass.reserve(masks.size());
-
-    QImage* firstFrame = masks[0];
-
-    int imageWidth = firstFrame->width();
-    int imageHeight= firstFrame->height();
-
-    foreach (QImage* iter, masks)
-    {
-        xy center;
-        center.x = 0;
-        center.y = 0;
-
-        uchar* pixel = iter->bits();
-        int count = 0;
-        for (int y = 0; y < imageHeight; y++)
-            for (int x = 0; x < imageWidth; x++, pixel++)
-            {
-                if (*pixel)
-                {
-                    count++;
-                    center.x += x;
-                    center.y += y;
-                }
-            }
-
-        if (count)
-        {
-            center.x /= count;
-            center.y /= count;
-        }
-        else
-        {
-            center.x = -1;
-            center.y = -1;
-        }
-
-        centresOfMass << center;
-    }
-}
-
-void MainWindow::fillBackg(int n)
-{
-    clearBackg();
-    backg.reserve(n);
-    for (int i = 0; i < n; i++)
-        backg << new Gaussian(sigmamin);
-}
-
-void MainWindow::clearBackg()
-{
-    foreach (Gaussian* iter, backg) {
-        delete iter;
-    }
-    backg.clear();
-}
-
-QImage* MainWindow::maskGradient(QImage *origin)
-{
-    // Результат
-    int imageWidth = origin->width();
-    int imageHeight= origin->height();
-    QImage* mask = new QImage(imageWidth, imageHeight, QImage::Format_Indexed8);
-    QVector<QRgb> maskColorTable;
-    maskColorTable << 0xFF000000;
-    maskColorTable << 0xFFFFFFFF;
-    mask->setColorTable(maskColorTable);
-
-    //////////////////////////////////////////////////////////////
-    /// Вычисление градиента
-    ///
-    {
-    /// Первая строчка
-    uchar* pixel = mask->bits();
-    uchar* y1;
-    uchar* y2 = origin->bits();
-    uchar* y3 = origin->scanLine(1);
-
-    // Левый верхний угол
-    int gradient = abs(-(*y2 + *(y2 + 1)) + (*y3 + *(y3 + 1)))
-                 + abs(-(*y2 + *y3) + *(y2 + 1) + *(y3 + 1));
-    *pixel = (gradient > 0) ? 1 : 0;
-    pixel++; y2++; y3++;
-    // Элементы первой строки, кроме крайних
-    for (int x = 1; x < imageWidth - 1; x++,
-                                        y2++, y3++,
-                                        pixel++)
-    {
-        // Вычисляем приближенное значение градиента
-        gradient = abs(-((*(y2 - 1)) + 2 * (*y2) + (*(y2 + 1)))
-                       + (*(y3 - 1)) + 2 * (*y3) + (*(y3 + 1)))
-                 + abs(-((*(y2 - 1)) + (*(y3 - 1)))
-                       + (*(y2 + 1)) + (*(y3 + 1)));
-        *pixel = (gradient > 0) ? 1 : 0;
-
-    }
-    // Верхний правый элемент
-    gradient = abs(-(*(y2 - 1) + *y2 ) + *(y3 - 1) + *y3)
-             + abs(-(*(y2 - 1) + *(y3 - 1)) + *y2 + *y3);
-    *pixel = (gradient > 0) ? 1 : 0;
-
-    /// Строки со второй, кроме последней
-    y1 = origin->bits();
-    pixel++; y2++; y3++;
-
-    for (int y = 1; y < imageHeight - 1; y++)
-    {
-        // Первая точка в строке
-        gradient = abs(-(*y1 + *(y1 + 1)) + (*y3 + *(y3 + 1)))
-                 + abs(-(*y1 + *y3) + *(y1 + 1) + *(y3 + 1));
-        *pixel = (gradient > 0) ? 1 : 0;
-
-        y1++; y2++; y3++; pixel++;
-
-        // Внутренние точки
-        for (int x = 1; x < imageWidth - 1; x++,
-                                            y1++, y2++, y3++,
-                                            pixel++)
-        {
-            gradient = abs(-(*(y1 - 1) + 2 * (*y1) + *(y1 + 1))
-                           + *(y3 - 1) + 2 * (*y3) + *(y3 + 1) )
-                     + abs(-(*(y1 - 1) + 2 * (*(y2 - 1)) + *(y3 - 1))
-                           + *(y1 + 1) + 2 * (*(y2 + 1)) + *(y3 + 1));
-            *pixel = (gradient > 0) ? 1 : 0;
-        }
-
-        // Последняя точка в строке
-        gradient = abs(-(*(y1 - 1) + *y1 ) + *(y3 - 1) + *y3)
-                 + abs(-(*(y1 - 1) + *(y3 - 1)) + *y1 + *y3);
-        *pixel = (gradient > 0) ? 1 : 0;
-
-        y1++; y2++; y3++; pixel++;
-    }
-
-    /// Последняя строка
-    // Левый нижний угол
-    gradient = abs(-(*y1 + *(y1 + 1)) + (*y2 + *(y2 + 1)))
-             + abs(-(*y1 + *y2) + *(y1 + 1) + *(y2 + 1));
-    *pixel = (gradient > 0) ? 1 : 0;
-    pixel++; y1++; y2++;
-    // Элементы первой строки, кроме крайних
-    for (int x = 1; x < imageWidth - 1; x++,
-                                        y1++, y2++,
-                                        pixel++)
-    {
-        // Вычисляем приближенное значение градиента
-        gradient = abs(-((*(y1 - 1)) + 2 * (*y1) + (*(y1 + 1)))
-                       + (*(y2 - 1)) + 2 * (*y2) + (*(y2 + 1)))
-                 + abs(-((*(y1 - 1)) + (*(y2 - 1)))
-                       + (*(y1 + 1)) + (*(y2 + 1)));
-        *pixel = (gradient > 0) ? 1 : 0;
-
-    }
-    // Правый нижний элемент
-    gradient = abs(-(*(y1 - 1) + *y1 ) + *(y2 - 1) + *y2)
-             + abs(-(*(y1 - 1) + *(y2 - 1)) + *y1 + *y2);
-    *pixel = (gradient > 0) ? 1 : 0;
-    }
-    ///
-    //////////////////////////////////////////////////////////////
-
-    return mask;
+    session = Session();
+    maskArchive.close();
+    QFile::remove(maskArchiveName);
+    QFile::remove(maskArchiveName + ".idx");
 }
 
 void MainWindow::clearLists()
 {
+    thumbnails->cancel();
     foreach (QImage* iter, imageList)
     {
         delete iter;
@@ -658,264 +806,13 @@ void MainWindow::clearLists()
         delete iter;
     }
     imagesWithMasks.clear();
-
-    clearBackg();
-}
-
-void MainWindow::convertToGrayscale(QImage &image)
-{
-    QVector<QRgb> ColorTable;
-    for (unsigned int i = 0; i < 256; i++)
-    {
-        ColorTable << ((0xFF000000) + (i << 16) + (i << 8) + i);
-    }
-
-    QImage grayImage(image.width(), image.height(), QImage::Format_Indexed8);
-    grayImage.setColorTable(ColorTable);
-
-    QRgb*  origPixel = (QRgb*)image.bits();
-    uchar* grayPixel =        grayImage.bits();
-
-    for (int i = 0; i < grayImage.byteCount(); i++, origPixel++, grayPixel++)
-    {
-        int R, G, B;
-        R = G = B = *origPixel;
-        R >>= 16; G >>= 8;
-        R = R & 0xFF; R = R & 0xFF; R = R & 0xFF;
-    //    *grayPixel = qGray(*origPixel);
-    }
-
-    image = grayImage;
-}
-
-/////////////////////////////////////////////////////////////////////////////////
-/// \brief Gaussian::Gaussian
-///
-/////////////////////////////////////////////////////////////////////////////////
-
-Gaussian::Gaussian(float _sirmamin, bool fullMatrix, bool hsv) :
-    usingRealTime(false), usingFullMastrix(fullMatrix), usingHsv(hsv)
-{
-    sigmamin = _sirmamin;
-    isNotFinalized = true;
-}
-
-void Gaussian::addItem(QRgb x_)
-{
-    RgbColor x;
-    if (usingHsv)
-    {
-        QColor hsv(x_);
-
-        x.R = hsv.hsvHue();
-        x.G = hsv.hsvSaturation();
-        x.B = hsv.value();
-    }
-    else
-    {
-        x.B = x_ & 0xFF;
-        x_ >>= 8;
-        x.G = x_ & 0xFF;
-        x_ >>= 8;
-        x.R = x_ & 0xFF;
-    }
-    points << x;
-    isNotFinalized = true;
-}
-/*
-void Gaussian::addItemMix(QRgb x_)
-{
-    // Реализация для смешивания
-    RgbColor x;
-    if (usingHsv)
-    {
-        QColor hsv(x_);
-
-        x.R = hsv.hsvHue();
-        x.G = hsv.hsvSaturation();
-        x.B = hsv.value();
-    }
-    else
-    {
-        x.B = x_ & 0xFF;
-        x_ >>= 8;
-        x.G = x_ & 0xFF;
-        x_ >>= 8;
-        x.R = x_ & 0xFF;
-    }
-
-    if (!usingRealTime)
-    {
-        usingRealTime = true;
-        mu.R = x.R;
-        mu.G = x.G;
-        mu.B = x.B;
-
-        memset(&sigma, 0, sizeof(sigma));
-        memset(&inver, 0, sizeof(inver));
-
-
-    }
-
-
-
-}*/
-
-float Gaussian::p(uchar x)
-{
-    /*float expPower = (float)x - mu;
-    expPower *= expPower * sigma_2;
-    expPower = (float)exp((double)expPower);
-
-    static float coef = 1. / sqrt(2* M_PI);
-
-    return coef * expPower * sigma_sqrt_1;*/
-    return 0;
-}
-
-bool Gaussian::isBackground(QRgb x_)
-{
-    if (isNotFinalized)
-        finalize();
-
-    if (isNotFinalized)
-    {
-        return -1;
-    }
-
-    RgbColor x;
-    if (usingHsv)
-    {
-        QColor hsv(x_);
-        x.R = hsv.hslHue();
-        x.G = hsv.hslSaturation();
-        x.B = hsv.value();
-    }
-    else
-    {
-        x.B = x_ & 0xFF;
-        x_ >>= 8;
-        x.G = x_ & 0xFF;
-        x_ >>= 8;
-        x.R = x_ & 0xFF;
-    }
-
-    float x_mu[3];
-    x_mu[0] = ((float)x.R - mu.Rf);
-    if (x_mu[0] < 0)
-        x_mu[0] = -x_mu[0];
-
-    x_mu[1] = ((float)x.G - mu.Gf);
-    if (x_mu[1] < 0)
-        x_mu[1] = -x_mu[1];
-
-    x_mu[2] = ((float)x.B - mu.Bf);
-    if (x_mu[2] < 0)
-        x_mu[2] = -x_mu[2];
-
-    double expPower;
-    if (usingFullMastrix)
-    {
-        expPower = x_mu[0] * (inver[0][0] * x_mu[0] + inver[0][1] * x_mu[1] + inver[0][2] * x_mu[2])
-                 + x_mu[1] * (inver[1][0] * x_mu[0] + inver[1][1] * x_mu[1] + inver[1][2] * x_mu[2])
-                 + x_mu[2] * (inver[2][0] * x_mu[0] + inver[2][1] * x_mu[1] + inver[2][2] * x_mu[2]);
-                    //(x - mu) * inv * (x - mu) * 0.5;
-        if (expPower < 0)
-            expPower = -expPower;
-
-        expPower = sqrt(expPower);
-    }
-    else
-    {
-        expPower = x_mu[0] + x_mu[1] + x_mu[2];
-        expPower /= detSqrt;
-    }
-    return (expPower < k * k * k) ? true : false;
-}
-
-void Gaussian::finalize()
-{
-    memset(&mu, 0, sizeof(mu));
-    memset(&sigma, 0, sizeof(sigma));
-
-    int size = points.size();
-
-    foreach (RgbColor iter, points) {
-        mu.Rf += iter.R;
-        mu.Gf += iter.G;
-        mu.Bf += iter.B;
-    }
-    mu.Rf /= size; mu.Gf /= size; mu.Bf /= size;
-
-    if (usingFullMastrix)
-    {
-        foreach (RgbColor iter, points) {
-            sigma[0][0] += (iter.R - mu.Rf) * (iter.R - mu.Rf);
-            sigma[0][1] += (iter.R - mu.Rf) * (iter.G - mu.Gf);
-            sigma[0][2] += (iter.R - mu.Rf) * (iter.B - mu.Bf);
-
-            sigma[1][1] += (iter.G - mu.Gf) * (iter.G - mu.Gf);
-            sigma[1][2] += (iter.G - mu.Gf) * (iter.B - mu.Bf);
-
-            sigma[2][2] += (iter.B - mu.Bf) * (iter.B - mu.Bf);
-        }
-        sigma[0][0] /= size; sigma[0][1] /= size; sigma[0][2] /= size;
-                             sigma[1][1] /= size; sigma[1][2] /= size;
-                                                  sigma[2][2] /= size;
-
-        sigma[1][0] = sigma[0][1];
-        sigma[2][0] = sigma[0][2]; sigma[2][1] = sigma[1][2];
-    }
-    else
-    {
-        foreach (RgbColor iter, points) {
-            sigma[0][0] += (iter.R - mu.Rf) * (iter.R - mu.Rf);
-            sigma[1][1] += (iter.G - mu.Gf) * (iter.G - mu.Gf);
-            sigma[2][2] += (iter.B - mu.Bf) * (iter.B - mu.Bf);
-        }
-        sigma[0][0] /= size; sigma[1][1] /= size; sigma[2][2] /= size;
-    }
-
-    if (sigma[0][0] < sigmamin)
-        sigma[0][0] = sigmamin;
-    if (sigma[1][1] < sigmamin)
-        sigma[1][1] = sigmamin;
-    if (sigma[2][2] < sigmamin)
-        sigma[2][2] = sigmamin;
-
-    if (usingFullMastrix)
-    {
-        inver[0][0] = sigma[1][1] * sigma[2][2] - sigma[1][2] * sigma[2][1];
-        inver[1][0] = sigma[1][2] * sigma[2][0] - sigma[1][0] * sigma[2][2];
-        inver[2][0] = sigma[1][0] * sigma[2][1] - sigma[1][1] * sigma[2][0];
-
-        inver[0][1] = inver[1][0];
-        inver[1][1] = sigma[0][0] * sigma[2][2] - sigma[0][2] * sigma[2][0];
-        inver[2][1] = sigma[0][1] * sigma[2][0] - sigma[0][0] * sigma[2][1];
-
-        inver[0][2] = inver[2][0];
-        inver[1][2] = inver[2][1];
-        inver[2][2] = sigma[0][0] * sigma[1][1] - sigma[0][1] * sigma[1][0];
-
-        det = sigma[0][0] * inver[0][0] + sigma[0][1] * inver[0][1]
-            + sigma[0][2] * inver[0][2];
-
-        if (det < 0)
-            detSqrt = sqrt(-det);
-        else
-            detSqrt = sqrt(det);
-
-        inver[0][0] /= det;        inver[0][1] /= det;        inver[0][2] /= det;
-        inver[1][0] = inver[0][1]; inver[1][1] /= det;        inver[1][2] /= det;
-        inver[2][0] = inver[0][2]; inver[2][1] = inver[1][2]; inver[2][2] /= det;
-    }
-    else
-    {
-        inver[0][0] = 1. / sigma[0][0]; inver[1][1] = 1. / sigma[1][1]; inver[2][2] = 1. / sigma[2][2];
-
-        det = sigma[0][0] + sigma[1][1] + sigma[2][2];
-        detSqrt = sqrt(det);
-    }
-
-    isNotFinalized = false;
+    distanceMaps.clear();
+
+    clearMasks();
+    recognizer.clear();
+    loadQueue.clear();
+    loadsPending = 0;
+    openedFiles.clear();
+    learnedFirst = -1;
+    learnedLast = -1;
 }
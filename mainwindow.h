@@ -4,60 +4,23 @@
 #include <QMainWindow>
 #include <QListWidget>
 #include <QVector>
+#include <QTimer>
 
-#include "morphology.h"
-#include "components.h"
+#include "maskarchive.h"
+#include "recognizer.h"
+#include "session.h"
+#include "thumbnails.h"
+#include "worker.h"
 
-#define k 3
-#define rho 0.01
-#define QueueLength 25
-const qint64 fps = 20;
-
-struct RgbColor
-{
-    unsigned int R, G, B;
-};
+class QProgressDialog;
 
-struct RgbColorF
-{
-    float Rf, Gf, Bf;
-};
+// Интервал между кадрами при воспроизведении, мс
+const qint64 fps = 20;
 
 namespace Ui {
 class MainWindow;
 }
 
-class Gaussian
-{
-private:
-    float sigma[3][3];
-    float inver[3][3];
-    float sigma_k;
-    QList<RgbColor> points;
-
-    bool isNotFinalized;
-    bool usingRealTime;
-    bool usingFullMastrix;
-    bool usingHsv;
-
-public:
-    float sigmamin;
-
-    RgbColorF mu;
-    float det;
-    float detSqrt;
-    float det3Rt;
-
-    Gaussian(float _sirmamin = 5, bool fullMatrix = true, bool hsv = false);
-
-    void finalize();
-    void addItem(QRgb x_);
-    //void addItemMix(QRgb x_);
-
-    float p(uchar x);
-    bool isBackground(QRgb x_);
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -72,43 +35,99 @@ public slots:
     void play();
     void recognize();
     void learn();
+    void recognizeVideo();
+    void exportTracks();
+    void saveSession();
+    void sweep();
 
     void itemClicked(QListWidgetItem * item);
 
     void spinSigmaMinChanged(double newValue);
+    void checkEdgesToggled(bool checked);
+    void spinEdgeChanged(int newValue);
+    void checkGrayToggled(bool checked);
+    void spinTilesChanged(int newValue);
+    void comboScaleChanged(int index);
+    void comboCovarianceChanged(int index);
+    void checkHsvToggled(bool checked);
+    void checkShadowsToggled(bool checked);
+    void spinKChanged(double newValue);
+    void spinRadiusChanged(int newValue);
+    void comboDistancesChanged(int index);
+    void spinHysteresisChanged(double newValue);
+    void spinVoteChanged(int newValue);
+    void checkReconstructToggled(bool checked);
+    void checkHolesToggled(bool checked);
+
+    void playNext();
+
+    void jobProgress(int done, int total);
+    void frameRecognized(int index, const QImage& overlay, xy centre);
+    void distancesComputed(int index, const DistanceMap& map);
+    void frameLoaded(int generation, int index, const QImage& image, const QImage& thumbnail);
+    void videoLoaded(int generation, int frames);
+    void jobFailed(const QString& message);
+    void jobFinished();
 
 public:
-    void playImages(QList<QImage*>& pixmap);
-    void substractBackground();
+    void playImages();
+    void stopPlaying();
     void substractBackground2();
     void applyMasks();
 
-    QList<QImage *>* createBorders();
-    void applyBorders();
-
-    void getCentresOfMass();
-
     QList<xy> centresOfMass;
 
 private:
     Ui::MainWindow *ui;
 
-    QVector<Gaussian*> backg;
-    void fillBackg(int n);
-    void clearBackg();
+    // Обработка идет в потоке worker, recognizer принадлежит ему на время задачи
+    Recognizer recognizer;
+    Worker* worker;
+    QProgressDialog* progressDialog;
+    // Настройки, которые получит recognizer при запуске следующей задачи
+    RecognizerSettings settings;
+    void startJob(const QString& title);
+    void setBusy(bool busy);
 
-    QImage* maskGradient(QImage *origin);
+    QTimer playTimer;
+    int playIndex;
 
+    // Пока файлы читаются, на месте еще не прочитанных кадров - 0
     QList<QImage*>  imageList;
-    QList<QImage*>  masks;
+    // Кадры и значки списка читаются в других потоках; перед удалением или заменой кадров - cancel()
+    ThumbnailLoader* thumbnails;
+    // Файлы, которые ждут прочитанного видео перед ними, и число читаемых файлов
+    QStringList loadQueue;
+    int loadsPending;
+    void continueLoading();
+    void finishLoading();
+    // Строка списка для следующего кадра; сам кадр приходит в frameLoaded
+    void insertFrame();
+    // Маски распознанных кадров - в архиве во временном каталоге, читаются по одной
+    QString maskArchiveName;
+    MaskArchiveReader maskArchive;
     QList<QImage*>  imagesWithMasks;
-
-    int pixelCount;
-
-    float sigmamin;
+    // Расстояния распознанных кадров, если они включены: маска при новом k без модели
+    // По номеру кадра, пустая карта - кадр без расстояний
+    QVector<DistanceMap> distanceMaps;
+    void showThreshold();
+
+    // Кадры загружаются как яркость, модель - GaussianGray
+    bool useGray;
+
+    // Для сеанса: открытые файлы по порядку (вход повтора - их список), режим, в котором
+    // они открыты, и обученный отрезок кадров (-1 - обучение по несмежным кадрам)
+    QStringList openedFiles;
+    bool openedGray;
+    int learnedFirst, learnedLast;
+    // Сеанс последнего распознавания без хешей масок: они берутся из архива при сохранении.
+    // width == 0 - распознавания не было
+    Session session;
 
     void clearLists();
-    void convertToGrayscale(QImage &image);
+    void clearMasks();
+    // Сеанс по только что завершенному распознаванию (session)
+    void recordSession();
 };
 
 #endif // MAINWINDOW_H
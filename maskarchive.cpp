@@ -0,0 +1,391 @@
+#include <cstring>
+
+#include <QtEndian>
+
+#include "maskarchive.h"
+#include "maskfilter.h"
+#include "recognizer.h"
+
+// "PMAD", "PMAI"
+static const quint32 DataFileMagic = 0x44414D50;
+static const quint32 IndexFileMagic = 0x49414D50;
+static const quint32 ArchiveVersion = 1;
+static const int DataHeaderBytes = 8;
+static const int IndexHeaderBytes = 16;
+// Запись индекса: смещение в файле данных (8 байт) и размер записи (4 байта)
+static const int IndexEntryBytes = 12;
+
+static inline int trailingZeros64(quint64 v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    for (; !(v & 1); v >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+static inline void putVarint(QByteArray& out, quint32 value)
+{
+    while (value >= 0x80)
+    {
+        out.append((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.append((char)value);
+}
+
+static inline bool getVarint(const uchar*& p, const uchar* end, quint32& value)
+{
+    value = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7)
+    {
+        uchar byte = *p++;
+        value |= (quint32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+void encodeMask(const quint64 *bits, int width, int height, QByteArray &result,
+                QByteArray &raw, QVector<int> &transitions)
+{
+    int words = (width + 63) / 64;
+    raw.resize(0);
+
+    // Строка: 0 - как предыдущая, иначе число смен значения + 1 и разности их положений.
+    // Смена в точке x - значение x отличается от x - 1 (левее строки - 0)
+    for (int y = 0; y < height; y++)
+    {
+        const quint64* row = bits + y * words;
+        if (y > 0 && memcmp(row, row - words, words * sizeof(quint64)) == 0)
+        {
+            raw.append((char)0);
+            continue;
+        }
+
+        transitions.resize(0);
+        quint64 carry = 0;
+        for (int w = 0; w < words; w++)
+        {
+            quint64 change = row[w] ^ ((row[w] << 1) | carry);
+            carry = row[w] >> 63;
+            while (change)
+            {
+                int x = w * 64 + trailingZeros64(change);
+                change &= change - 1;
+                if (x < width)
+                    transitions << x;
+            }
+        }
+
+        putVarint(raw, transitions.size() + 1);
+        int previous = 0;
+        for (int i = 0; i < transitions.size(); i++)
+        {
+            putVarint(raw, transitions.at(i) - previous);
+            previous = transitions.at(i);
+        }
+    }
+
+    result = qCompress(raw, MaskArchiveLevel);
+}
+
+bool decodeMask(const QByteArray &data, int width, int height, QImage &mask)
+{
+    QByteArray raw = qUncompress(data);
+    const uchar* p   = (const uchar*)raw.constData();
+    const uchar* end = p + raw.size();
+
+    for (int y = 0; y < height; y++)
+    {
+        uchar* row = mask.scanLine(y);
+        quint32 code;
+        if (!getVarint(p, end, code))
+            return false;
+
+        if (code == 0)
+        {
+            if (y == 0)
+                return false;
+            memcpy(row, mask.constScanLine(y - 1), width);
+            continue;
+        }
+
+        int start = 0;
+        uchar value = 0;
+        for (quint32 i = 0; i + 1 < code; i++)
+        {
+            quint32 delta;
+            if (!getVarint(p, end, delta) || delta > (quint32)(width - start))
+                return false;
+            memset(row + start, value, delta);
+            start += delta;
+            value ^= 1;
+        }
+        memset(row + start, value, width - start);
+    }
+    return p == end;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+///
+/// \brief MaskArchiveWriter
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+MaskArchiveWriter::MaskArchiveWriter(QObject *parent) :
+    QThread(parent), frameWidth(0), frameHeight(0), frames(0), writing(false), finishing(false), failed(false)
+{
+}
+
+MaskArchiveWriter::~MaskArchiveWriter()
+{
+    finish();
+}
+
+bool MaskArchiveWriter::start(const QString &fileName, int width, int height, int keepFrames)
+{
+    finish();
+    data.setFileName(fileName);
+    index.setFileName(fileName + ".idx");
+    frameWidth = width;
+    frameHeight = height;
+    frames = 0;
+    finishing = false;
+    failed = false;
+    queue.clear();
+
+    if (keepFrames > 0)
+    {
+        // Старый архив обрезается до keepFrames кадров: до конца записи последнего из них
+        if (!data.open(QIODevice::ReadWrite) || !index.open(QIODevice::ReadWrite))
+        {
+            data.close();
+            index.close();
+            return false;
+        }
+
+        uchar header[IndexHeaderBytes], entry[IndexEntryBytes];
+        bool valid = index.read((char*)header, IndexHeaderBytes) == IndexHeaderBytes
+                && qFromLittleEndian<quint32>(header) == IndexFileMagic
+                && qFromLittleEndian<quint32>(header + 4) == ArchiveVersion
+                && qFromLittleEndian<qint32>(header + 8) == width
+                && qFromLittleEndian<qint32>(header + 12) == height
+                && index.size() >= IndexHeaderBytes + (qint64)keepFrames * IndexEntryBytes
+                && index.seek(IndexHeaderBytes + (qint64)(keepFrames - 1) * IndexEntryBytes)
+                && index.read((char*)entry, IndexEntryBytes) == IndexEntryBytes;
+        qint64 dataEnd = valid ? (qint64)qFromLittleEndian<quint64>(entry) + qFromLittleEndian<quint32>(entry + 8) : 0;
+        if (!valid || dataEnd > data.size()
+                || !data.resize(dataEnd) || !index.resize(IndexHeaderBytes + (qint64)keepFrames * IndexEntryBytes)
+                || !data.seek(dataEnd) || !index.seek(index.size()))
+        {
+            data.close();
+            index.close();
+            return false;
+        }
+        frames = keepFrames;
+    }
+    else
+    {
+        if (!data.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || !index.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            data.close();
+            index.close();
+            return false;
+        }
+
+        uchar dataHeader[DataHeaderBytes], indexHeader[IndexHeaderBytes];
+        qToLittleEndian<quint32>(DataFileMagic, dataHeader);
+        qToLittleEndian<quint32>(ArchiveVersion, dataHeader + 4);
+        qToLittleEndian<quint32>(IndexFileMagic, indexHeader);
+        qToLittleEndian<quint32>(ArchiveVersion, indexHeader + 4);
+        qToLittleEndian<qint32>(width, indexHeader + 8);
+        qToLittleEndian<qint32>(height, indexHeader + 12);
+        if (data.write((const char*)dataHeader, DataHeaderBytes) != DataHeaderBytes
+                || index.write((const char*)indexHeader, IndexHeaderBytes) != IndexHeaderBytes)
+        {
+            data.close();
+            index.close();
+            return false;
+        }
+    }
+
+    QThread::start();
+    return true;
+}
+
+bool MaskArchiveWriter::append(const QImage &mask)
+{
+    int words = (frameWidth + 63) / 64;
+    QVector<quint64> bits;
+    {
+        QMutexLocker locker(&mutex);
+        while (queue.size() >= MaskArchiveQueueLength && !failed)
+            notFull.wait(&mutex);
+        if (failed || !isRunning())
+            return false;
+        if (!spare.isEmpty())
+            bits = spare.takeLast();
+    }
+
+    // Упаковка - в вызывающем потоке: она в разы быстрее сжатия и уменьшает очередь в 8 раз
+    bits.resize(frameHeight * words);
+    for (int y = 0; y < frameHeight; y++)
+        packMaskRow(mask.constScanLine(y), frameWidth, bits.data() + y * words);
+
+    QMutexLocker locker(&mutex);
+    queue.enqueue(bits);
+    frames++;
+    notEmpty.wakeOne();
+    return true;
+}
+
+bool MaskArchiveWriter::flush()
+{
+    QMutexLocker locker(&mutex);
+    while ((!queue.isEmpty() || writing) && !failed && isRunning())
+        notFull.wait(&mutex);
+    return !failed;
+}
+
+bool MaskArchiveWriter::finish()
+{
+    if (isRunning())
+    {
+        mutex.lock();
+        finishing = true;
+        notEmpty.wakeOne();
+        mutex.unlock();
+
+        wait();
+    }
+
+    bool ok = !failed;
+    if (data.isOpen())
+    {
+        ok = data.flush() && index.flush() && ok;
+        data.close();
+        index.close();
+    }
+    spare.clear();
+    return ok;
+}
+
+bool MaskArchiveWriter::writeFrame(const QVector<quint64> &bits)
+{
+    encodeMask(bits.constData(), frameWidth, frameHeight, encoded, raw, transitions);
+
+    uchar entry[IndexEntryBytes];
+    qToLittleEndian<quint64>(data.pos(), entry);
+    qToLittleEndian<quint32>(encoded.size(), entry + 8);
+    return data.write(encoded) == encoded.size()
+        && index.write((const char*)entry, IndexEntryBytes) == IndexEntryBytes
+        // Индекс сбрасывается после данных: запись индекса не опережает свои данные
+        && data.flush() && index.flush();
+}
+
+void MaskArchiveWriter::run()
+{
+    while (true)
+    {
+        QVector<quint64> bits;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.isEmpty() && !finishing)
+                notEmpty.wait(&mutex);
+            if (queue.isEmpty())
+                break;
+            bits = queue.dequeue();
+            writing = true;
+        }
+
+        bool written = writeFrame(bits);
+
+        QMutexLocker locker(&mutex);
+        writing = false;
+        spare << bits;
+        if (!written)
+        {
+            failed = true;
+            queue.clear();
+            notFull.wakeAll();
+            return;
+        }
+        notFull.wakeAll();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+///
+/// \brief MaskArchiveReader
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+MaskArchiveReader::MaskArchiveReader() :
+    frameWidth(0), frameHeight(0), frames(0)
+{
+}
+
+bool MaskArchiveReader::open(const QString &fileName)
+{
+    close();
+    data.setFileName(fileName);
+    index.setFileName(fileName + ".idx");
+    if (!data.open(QIODevice::ReadOnly) || !index.open(QIODevice::ReadOnly))
+    {
+        close();
+        return false;
+    }
+
+    uchar header[IndexHeaderBytes];
+    if (index.read((char*)header, IndexHeaderBytes) != IndexHeaderBytes
+            || qFromLittleEndian<quint32>(header) != IndexFileMagic
+            || qFromLittleEndian<quint32>(header + 4) != ArchiveVersion)
+    {
+        close();
+        return false;
+    }
+    frameWidth  = qFromLittleEndian<qint32>(header + 8);
+    frameHeight = qFromLittleEndian<qint32>(header + 12);
+    // Недописанная последняя запись индекса (сбой при записи) не считается
+    frames = (int)((index.size() - IndexHeaderBytes) / IndexEntryBytes);
+    return frameWidth > 0 && frameHeight > 0;
+}
+
+void MaskArchiveReader::close()
+{
+    data.close();
+    index.close();
+    frameWidth = frameHeight = frames = 0;
+}
+
+bool MaskArchiveReader::read(int frame, QImage &mask)
+{
+    if (frame < 0 || frame >= frames)
+        return false;
+
+    uchar entry[IndexEntryBytes];
+    if (!index.seek(IndexHeaderBytes + (qint64)frame * IndexEntryBytes)
+            || index.read((char*)entry, IndexEntryBytes) != IndexEntryBytes)
+        return false;
+    qint64 offset = qFromLittleEndian<quint64>(entry);
+    int size = qFromLittleEndian<quint32>(entry + 8);
+    if (offset < DataHeaderBytes || offset + size > data.size() || !data.seek(offset))
+        return false;
+
+    buffer.resize(size);
+    if (data.read(buffer.data(), size) != size)
+        return false;
+
+    if (mask.width() != frameWidth || mask.height() != frameHeight || mask.format() != QImage::Format_Indexed8)
+    {
+        mask = QImage(frameWidth, frameHeight, QImage::Format_Indexed8);
+        mask.setColorTable(Recognizer::maskColorTable());
+    }
+    return decodeMask(buffer, frameWidth, frameHeight, mask);
+}
@@ -0,0 +1,102 @@
+#ifndef MASKARCHIVE_H
+#define MASKARCHIVE_H
+// Архив масок последовательности. Строка маски хранится как точки смены значения
+// (разности в varint) или признак "как предыдущая строка", кадр целиком сжимается zlib.
+// Записи кадров только дописываются в файл данных, их положения - в индекс с записями
+// одного размера, поэтому любой кадр читается одним переходом.
+// Файлы: имя - данные, имя.idx - индекс (заголовок: размер кадра).
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+// Кадров в очереди записи
+#define MaskArchiveQueueLength 16
+// Уровень сжатия zlib
+#define MaskArchiveLevel 6
+
+// Сжатие маски по строкам бит (packMaskRow, (width + 63) / 64 слов на строку).
+// raw и transitions - рабочие буферы
+void encodeMask(const quint64* bits, int width, int height, QByteArray& result,
+                QByteArray& raw, QVector<int>& transitions);
+// mask должна быть Indexed8 размера width x height; false - запись повреждена
+bool decodeMask(const QByteArray& data, int width, int height, QImage& mask);
+
+// Запись архива в отдельном потоке: в вызывающем потоке маска только упаковывается
+// по биту на точку, сжатие и запись идут здесь
+class MaskArchiveWriter : public QThread
+{
+public:
+    explicit MaskArchiveWriter(QObject *parent = 0);
+    ~MaskArchiveWriter();
+
+    // keepFrames - сколько кадров уже записанного архива оставить (продолжение после
+    // контрольной точки), 0 - новый архив. false, если файлы не открылись или в архиве
+    // другой размер кадра или меньше keepFrames кадров
+    bool start(const QString& fileName, int width, int height, int keepFrames = 0);
+    // mask - Indexed8 0/1 размера архива. false после ошибки записи
+    bool append(const QImage& mask);
+    // Ждет, пока очередь запишется в файлы: после этого в архиве все добавленные кадры
+    bool flush();
+    // Дописывает очередь и закрывает архив; false, если была ошибка записи
+    bool finish();
+
+    int frameCount() const { return frames; }
+
+protected:
+    void run();
+
+private:
+    bool writeFrame(const QVector<quint64>& bits);
+
+    QFile data, index;
+    int frameWidth, frameHeight;
+    int frames;
+
+    // Упакованные маски: очередь и свободные буферы для повторного использования
+    QQueue<QVector<quint64> > queue;
+    QList<QVector<quint64> > spare;
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    // Поток записи взял кадр и еще пишет его
+    bool writing;
+    bool finishing;
+    bool failed;
+
+    // Буферы потока записи
+    QByteArray encoded, raw;
+    QVector<int> transitions;
+};
+
+class MaskArchiveReader
+{
+public:
+    MaskArchiveReader();
+
+    bool open(const QString& fileName);
+    void close();
+
+    int frameCount() const { return frames; }
+    int width() const  { return frameWidth; }
+    int height() const { return frameHeight; }
+
+    // Маска кадра frame (Indexed8 0/1, таблица Recognizer::maskColorTable());
+    // false - нет такого кадра или запись повреждена
+    bool read(int frame, QImage& mask);
+
+private:
+    QFile data, index;
+    int frameWidth, frameHeight;
+    int frames;
+    QByteArray buffer;
+};
+
+#endif // MASKARCHIVE_H
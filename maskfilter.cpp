@@ -0,0 +1,272 @@
+#include <cstring>
+
+#include "maskfilter.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Есть ли среди 8 соседей точки (x, y) точка маски
+static inline bool touchesStrong(const QImage& mask, int x, int y)
+{
+    int x0 = qMax(x - 1, 0), x1 = qMin(x + 1, mask.width() - 1);
+    for (int ny = qMax(y - 1, 0); ny <= qMin(y + 1, mask.height() - 1); ny++)
+    {
+        const uchar* line = mask.constScanLine(ny);
+        for (int nx = x0; nx <= x1; nx++)
+            if (line[nx])
+                return true;
+    }
+    return false;
+}
+
+void hysteresis(const DistanceMap &map, int low, int high, QImage &mask, QImage &scratch, QVector<int> &stack)
+{
+    int width = map.width(), height = map.height();
+    if (scratch.width() != width || scratch.height() != height || scratch.format() != QImage::Format_Indexed8)
+        scratch = QImage(width, height, QImage::Format_Indexed8);
+
+    // scratch - слабые точки, mask - сильные и уже присоединенные
+    map.threshold(low, scratch);
+    map.threshold(high, mask);
+    reconstruct(mask, scratch, stack);
+}
+
+void reconstruct(QImage &marker, const QImage &mask, QVector<int> &stack)
+{
+    int width = mask.width(), height = mask.height();
+
+    // Начала заливки - точки mask рядом с marker. Точек mask вне marker
+    // мало, поэтому строки просматриваются по 8 точек
+    stack.clear();
+    for (int y = 0; y < height; y++)
+    {
+        const uchar* weak = mask.constScanLine(y);
+        uchar* strong = marker.scanLine(y);
+        for (int x = 0; x < width; x++)
+        {
+            if (x + 8 <= width)
+            {
+                quint64 w, s;
+                memcpy(&w, weak + x, 8);
+                memcpy(&s, strong + x, 8);
+                if ((w & ~s) == 0)
+                {
+                    x += 7;
+                    continue;
+                }
+            }
+            if (weak[x] && !strong[x] && touchesStrong(marker, x, y))
+            {
+                strong[x] = 1;
+                stack << y * width + x;
+            }
+        }
+    }
+
+    // Заливка от marker по точкам mask
+    while (!stack.isEmpty())
+    {
+        int i = stack.last();
+        stack.removeLast();
+        int x = i % width, y = i / width;
+        for (int ny = qMax(y - 1, 0); ny <= qMin(y + 1, height - 1); ny++)
+        {
+            const uchar* weak = mask.constScanLine(ny);
+            uchar* result = marker.scanLine(ny);
+            for (int nx = qMax(x - 1, 0); nx <= qMin(x + 1, width - 1); nx++)
+                if (weak[nx] && !result[nx])
+                {
+                    result[nx] = 1;
+                    stack << ny * width + nx;
+                }
+        }
+    }
+}
+
+// Фон, достижимый от края прямоугольника, при заливке помечается так
+#define OuterBackground 2
+
+static inline void pushBackground(uchar* pixel, int i, QVector<int>& queue)
+{
+    if (*pixel == 0)
+    {
+        *pixel = OuterBackground;
+        queue << i;
+    }
+}
+
+void fillHoles(QImage &mask, const QVector<QRect> &boxes, QVector<int> &queue)
+{
+    int width = mask.width();
+    uchar* bits = mask.bits();
+    int stride = mask.bytesPerLine();
+
+    foreach (const QRect& box, boxes)
+    {
+        // В прямоугольнике меньше 3x3 дыре негде быть
+        if (box.width() < 3 || box.height() < 3)
+            continue;
+        int x0 = box.left(), x1 = box.right(), y0 = box.top(), y1 = box.bottom();
+
+        // Очередь от фона на краю прямоугольника, по 4-связности (область 8-связная)
+        queue.clear();
+        for (int x = x0; x <= x1; x++)
+        {
+            pushBackground(bits + y0 * stride + x, y0 * width + x, queue);
+            pushBackground(bits + y1 * stride + x, y1 * width + x, queue);
+        }
+        for (int y = y0 + 1; y < y1; y++)
+        {
+            pushBackground(bits + y * stride + x0, y * width + x0, queue);
+            pushBackground(bits + y * stride + x1, y * width + x1, queue);
+        }
+
+        for (int head = 0; head < queue.size(); head++)
+        {
+            int i = queue.at(head);
+            int x = i % width, y = i / width;
+            uchar* pixel = bits + y * stride + x;
+            if (x > x0)
+                pushBackground(pixel - 1, i - 1, queue);
+            if (x < x1)
+                pushBackground(pixel + 1, i + 1, queue);
+            if (y > y0)
+                pushBackground(pixel - stride, i - width, queue);
+            if (y < y1)
+                pushBackground(pixel + stride, i + width, queue);
+        }
+
+        // Не достигнутый фон - дыры
+        for (int y = y0; y <= y1; y++)
+        {
+            uchar* pixel = bits + y * stride;
+            for (int x = x0; x <= x1; x++)
+                pixel[x] = (pixel[x] != OuterBackground);
+        }
+    }
+}
+
+TemporalVote::TemporalVote() :
+    maskWidth(0), maskHeight(0), rowWords(0), ringSize(1), head(0), filled(0)
+{
+}
+
+void TemporalVote::reset(int width, int height, int frames)
+{
+    maskWidth = width;
+    maskHeight = height;
+    rowWords = (width + 63) / 64;
+    ringSize = qBound(1, frames, MaxVoteFrames);
+    head = filled = 0;
+    ring.fill(0, ringSize > 1 ? ringSize * rowWords * height : 0);
+    voted.resize(rowWords);
+}
+
+void packMaskRow(const uchar* mask, int width, quint64* bits)
+{
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 64 <= width; x += 64)
+    {
+        quint64 word = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(mask + x + 16 * j));
+            word |= (quint64)(quint16)_mm_movemask_epi8(_mm_slli_epi16(v, 7)) << (16 * j);
+        }
+        bits[x / 64] = word;
+    }
+#endif
+    for (; x < width; x += 64)
+    {
+        quint64 word = 0;
+        for (int j = 0; j < 64 && x + j < width; j++)
+            word |= (quint64)(mask[x + j] & 1) << j;
+        bits[x / 64] = word;
+    }
+}
+
+// Байт масок 8 точек по 8 битам
+struct ByteTable
+{
+    ByteTable()
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            quint64 v = 0;
+            for (int j = 0; j < 8; j++)
+                v |= (quint64)((b >> j) & 1) << (8 * j);
+            bytes[b] = v;
+        }
+    }
+    quint64 bytes[256];
+};
+
+void unpackMaskRow(const quint64* bits, int width, uchar* mask)
+{
+    static const ByteTable table;
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        // Порядок байтов little endian: младший байт - первая точка
+        quint64 v = table.bytes[(bits[x / 64] >> (x % 64)) & 0xFF];
+        memcpy(mask + x, &v, 8);
+    }
+    for (; x < width; x++)
+        mask[x] = (uchar)((bits[x / 64] >> (x % 64)) & 1);
+}
+
+void TemporalVote::apply(QImage &mask)
+{
+    if (ringSize <= 1)
+        return;
+
+    quint64* slot = ring.data() + head * rowWords * maskHeight;
+    head = (head + 1) % ringSize;
+    filled = qMin(filled + 1, ringSize);
+
+    // Пока буфер не заполнен - большинство из накопленных кадров
+    int votes = filled / 2 + 1;
+    int frameWords = rowWords * maskHeight;
+    const quint64* frames = ring.constData();
+
+    for (int y = 0; y < maskHeight; y++)
+    {
+        uchar* line = mask.scanLine(y);
+        quint64* row = slot + y * rowWords;
+        packMaskRow(line, maskWidth, row);
+
+        for (int w = 0; w < rowWords; w++)
+        {
+            // Побитовые 4-битные счетчики c3 c2 c1 c0: 64 точки за раз
+            quint64 c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+            for (int f = 0; f < filled; f++)
+            {
+                quint64 carry = frames[f * frameWords + y * rowWords + w];
+                quint64 t;
+                t = c0 & carry; c0 ^= carry; carry = t;
+                t = c1 & carry; c1 ^= carry; carry = t;
+                t = c2 & carry; c2 ^= carry; carry = t;
+                c3 ^= carry;
+            }
+
+            // Счетчик не меньше votes: сравнение от старшего бита
+            const quint64 c[4] = { c0, c1, c2, c3 };
+            quint64 greater = 0, equal = ~(quint64)0;
+            for (int b = 3; b >= 0; b--)
+            {
+                if ((votes >> b) & 1)
+                    equal &= c[b];
+                else
+                {
+                    greater |= equal & c[b];
+                    equal &= ~c[b];
+                }
+            }
+            voted[w] = greater | equal;
+        }
+        unpackMaskRow(voted.constData(), maskWidth, line);
+    }
+}
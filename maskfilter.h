@@ -0,0 +1,60 @@
+#ifndef MASKFILTER_H
+#define MASKFILTER_H
+// Очистка маски до размыкания: порог с гистерезисом по карте расстояний и
+// голосование точки по нескольким последним кадрам. После них для того же
+// результата хватает диска размыкания меньшего радиуса.
+// После размыкания: восстановление стертых им тонких частей и заливка дыр в областях.
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#include "distancemap.h"
+
+// Голосование идет 4-битными счетчиками, кадров не больше
+#define MaxVoteFrames 15
+
+// Строка маски 0/1 <-> биты: бит x % 64 слова x / 64 - точка x, лишние биты последнего слова - 0
+void packMaskRow(const uchar* mask, int width, quint64* bits);
+void unpackMaskRow(const quint64* bits, int width, uchar* mask);
+
+// mask (Indexed8 размера карты) - точки с уровнем не меньше high и связные с ними
+// (8-связность) точки с уровнем не меньше low. scratch и stack - рабочие буферы,
+// между кадрами переиспользуются без выделений
+void hysteresis(const DistanceMap& map, int low, int high, QImage& mask, QImage& scratch, QVector<int>& stack);
+
+// Восстановление дилатацией: к marker (0/1, подмножество mask) добавляются точки mask,
+// связные с ним (8-связность) по точкам mask. Время - просмотр строк, где mask и marker
+// различаются, и линейное по числу добавленных точек. stack - рабочий буфер
+void reconstruct(QImage& marker, const QImage& mask, QVector<int>& stack);
+
+// Заливка дыр: фон внутри описанного прямоугольника области маски, не связный с краем
+// прямоугольника, становится объектом. Заливка очередью от края отдельно в каждом
+// прямоугольнике, время линейно по их площади. boxes - прямоугольники областей
+// (componentBoxes), queue - рабочий буфер
+void fillHoles(QImage& mask, const QVector<QRect>& boxes, QVector<int>& queue);
+
+// Точка маски остается передним планом, если была им в большинстве из последних
+// frames кадров, включая текущий. Маски хранятся по биту на точку в кольцевом буфере
+class TemporalVote
+{
+public:
+    TemporalVote();
+
+    // frames от 1 (голосование выключено) до MaxVoteFrames
+    void reset(int width, int height, int frames);
+    int frames() const { return ringSize; }
+
+    // Добавляет mask (0/1) в буфер и заменяет ее результатом голосования
+    void apply(QImage& mask);
+
+private:
+    int maskWidth, maskHeight, rowWords;
+    int ringSize, head, filled;
+    // Кадр за кадром: строки по rowWords слов, бит x % 64 слова x / 64 - точка x
+    QVector<quint64> ring;
+    // Результат голосования строки
+    QVector<quint64> voted;
+};
+
+#endif // MASKFILTER_H
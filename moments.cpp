@@ -0,0 +1,215 @@
+#include <cmath>
+
+#include "moments.h"
+#include "maskfilter.h"
+
+static inline int popcount64(quint64 v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & Q_UINT64_C(0x5555555555555555));
+    v = (v & Q_UINT64_C(0x3333333333333333)) + ((v >> 2) & Q_UINT64_C(0x3333333333333333));
+    v = (v + (v >> 4)) & Q_UINT64_C(0x0F0F0F0F0F0F0F0F);
+    return (int)((v * Q_UINT64_C(0x0101010101010101)) >> 56);
+#endif
+}
+
+static inline int trailingZeros64(quint64 v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    for (; !(v & 1); v >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+// Сумма номеров единичных бит слова: бит k номера j дает 2^k, слова с этим битом номера - маски
+static inline int bitIndexSum(quint64 v)
+{
+    return      popcount64(v & Q_UINT64_C(0xAAAAAAAAAAAAAAAA))
+         + 2  * popcount64(v & Q_UINT64_C(0xCCCCCCCCCCCCCCCC))
+         + 4  * popcount64(v & Q_UINT64_C(0xF0F0F0F0F0F0F0F0))
+         + 8  * popcount64(v & Q_UINT64_C(0xFF00FF00FF00FF00))
+         + 16 * popcount64(v & Q_UINT64_C(0xFFFF0000FFFF0000))
+         + 32 * popcount64(v & Q_UINT64_C(0xFFFFFFFF00000000));
+}
+
+Moments::Moments() :
+    area(0), sumX(0), sumY(0), sumXX(0), sumYY(0), sumXY(0)
+{
+}
+
+void Moments::addRun(int x0, int x1, int y)
+{
+    // Суммы арифметической прогрессии и квадратов на отрезке
+    qint64 n = x1 - x0 + 1;
+    qint64 sx = (qint64)(x0 + x1) * n / 2;
+    qint64 a = x0 - 1, b = x1;
+    qint64 sxx = b * (b + 1) * (2 * b + 1) / 6 - a * (a + 1) * (2 * a + 1) / 6;
+
+    area += n;
+    sumX += sx;
+    sumY += n * y;
+    sumXX += sxx;
+    sumYY += n * y * y;
+    sumXY += sx * y;
+}
+
+void Moments::add(const Moments &other)
+{
+    area += other.area;
+    sumX += other.sumX;
+    sumY += other.sumY;
+    sumXX += other.sumXX;
+    sumYY += other.sumYY;
+    sumXY += other.sumXY;
+}
+
+double Moments::x() const
+{
+    return area ? (double)sumX / area : -1;
+}
+
+double Moments::y() const
+{
+    return area ? (double)sumY / area : -1;
+}
+
+double Moments::varianceX() const
+{
+    if (!area)
+        return 0;
+    double mx = (double)sumX / area;
+    return (double)sumXX / area - mx * mx;
+}
+
+double Moments::varianceY() const
+{
+    if (!area)
+        return 0;
+    double my = (double)sumY / area;
+    return (double)sumYY / area - my * my;
+}
+
+double Moments::covariance() const
+{
+    if (!area)
+        return 0;
+    return (double)sumXY / area - ((double)sumX / area) * ((double)sumY / area);
+}
+
+double Moments::orientation() const
+{
+    return 0.5 * std::atan2(2 * covariance(), varianceX() - varianceY());
+}
+
+// Собственные числа матрицы ковариации; у эллипса равномерной плотности дисперсия вдоль полуоси a - a^2 / 4
+double Moments::majorAxis() const
+{
+    double half = (varianceX() + varianceY()) / 2;
+    double d = (varianceX() - varianceY()) / 2;
+    double lambda = half + std::sqrt(d * d + covariance() * covariance());
+    return 2 * std::sqrt(qMax(lambda, 0.));
+}
+
+double Moments::minorAxis() const
+{
+    double half = (varianceX() + varianceY()) / 2;
+    double d = (varianceX() - varianceY()) / 2;
+    double lambda = half - std::sqrt(d * d + covariance() * covariance());
+    return 2 * std::sqrt(qMax(lambda, 0.));
+}
+
+MomentAccumulator::MomentAccumulator() :
+    left(0), width(0), words(0), planes(0)
+{
+}
+
+void MomentAccumulator::begin(int left_, int width_, int rows)
+{
+    left = left_;
+    width = width_;
+    words = (width + 63) / 64;
+    planes = 1;
+    while ((1 << planes) <= rows && planes < 31)
+        planes++;
+    columns.fill(0, words * planes);
+    result.clear();
+}
+
+void MomentAccumulator::addRow(int y, const quint64 *bits)
+{
+    qint64 count = 0, sumX = 0;
+    for (int w = 0; w < words; w++)
+    {
+        quint64 v = bits[w];
+        if (!v)
+            continue;
+
+        int n = popcount64(v);
+        count += n;
+        sumX += (qint64)n * (left + 64 * w) + bitIndexSum(v);
+
+        // Прибавление строки к счетчикам столбцов: перенос идет, пока не обнулится
+        quint64* plane = columns.data() + w * planes;
+        for (int b = 0; v && b < planes; b++)
+        {
+            quint64 carry = plane[b] & v;
+            plane[b] ^= v;
+            v = carry;
+        }
+    }
+
+    // x^2 по строкам не раскладывается - он берется из столбцов в finish()
+    result.area += count;
+    result.sumX += sumX;
+    result.sumY += count * y;
+    result.sumYY += count * y * y;
+    result.sumXY += sumX * y;
+}
+
+Moments MomentAccumulator::finish()
+{
+    qint64 sumXX = 0;
+    for (int w = 0; w < words; w++)
+    {
+        const quint64* plane = columns.constData() + w * planes;
+        quint64 any = 0;
+        for (int b = 0; b < planes; b++)
+            any |= plane[b];
+
+        // Только столбцы, в которых есть точки
+        while (any)
+        {
+            int j = trailingZeros64(any);
+            any &= any - 1;
+            qint64 n = 0;
+            for (int b = 0; b < planes; b++)
+                n |= (qint64)((plane[b] >> j) & 1) << b;
+            qint64 x = left + 64 * w + j;
+            sumXX += n * x * x;
+        }
+    }
+    result.sumXX = sumXX;
+    return result;
+}
+
+Moments maskMoments(const QImage &mask, const QRect &rect, MomentAccumulator &accumulator, QVector<quint64> &bits)
+{
+    QRect r = rect.intersected(QRect(0, 0, mask.width(), mask.height()));
+    if (r.isEmpty())
+        return Moments();
+
+    accumulator.begin(r.left(), r.width(), r.height());
+    bits.resize(accumulator.rowWords());
+    for (int y = r.top(); y <= r.bottom(); y++)
+    {
+        packMaskRow(mask.constScanLine(y) + r.left(), r.width(), bits.data());
+        accumulator.addRow(y, bits.constData());
+    }
+    return accumulator.finish();
+}
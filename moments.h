@@ -0,0 +1,66 @@
+#ifndef MOMENTS_H
+#define MOMENTS_H
+// Моменты точек маски до второго порядка: площадь, центр масс с точностью до долей
+// точки, ориентация и полуоси эллипса с теми же моментами. Суммы 64-битные -
+// не переполняются на кадре любого размера, сплошь занятом объектом.
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+struct Moments
+{
+    Moments();
+
+    // Суммы по точкам: 1, x, y, x^2, y^2, xy
+    qint64 area;
+    qint64 sumX, sumY;
+    qint64 sumXX, sumYY, sumXY;
+
+    void clear() { *this = Moments(); }
+    // Отрезок [x0, x1] строки y
+    void addRun(int x0, int x1, int y);
+    void add(const Moments& other);
+
+    // Центр масс; для пустой маски -1
+    double x() const;
+    double y() const;
+    // Центральные моменты второго порядка на точку
+    double varianceX() const;
+    double varianceY() const;
+    double covariance() const;
+    // Угол главной оси от оси x, радианы, (-pi/2, pi/2]
+    double orientation() const;
+    // Полуоси эллипса равномерной плотности с теми же моментами
+    double majorAxis() const;
+    double minorAxis() const;
+};
+Q_DECLARE_TYPEINFO(Moments, Q_PRIMITIVE_TYPE);
+
+// Моменты упакованной по битам маски. Строки добавляются по словам: число точек
+// строки и сумма их x - через popcount, гистограмма столбцов - побитовыми счетчиками
+// по 64 столбца за раз. Буферы переиспользуются между вызовами begin()
+class MomentAccumulator
+{
+public:
+    MomentAccumulator();
+
+    // Точки left .. left + width - 1, строк не больше rows
+    void begin(int left, int width, int rows);
+    // bits - (width + 63) / 64 слов, бит j слова w - точка left + 64 w + j
+    void addRow(int y, const quint64* bits);
+    Moments finish();
+
+    int rowWords() const { return words; }
+
+private:
+    int left, width, words, planes;
+    // Счетчики столбцов: слой b слова w - бит b числа точек каждого из 64 столбцов
+    QVector<quint64> columns;
+    Moments result;
+};
+
+// Моменты ненулевых точек маски (0/1) внутри rect; bits - рабочий буфер строки
+Moments maskMoments(const QImage& mask, const QRect& rect, MomentAccumulator& accumulator, QVector<quint64>& bits);
+
+#endif // MOMENTS_H
@@ -1,7 +1,10 @@
 #include "morphology.h"
 
+#include <cstring>
+
 #include <QColor>
 #include <QPainter>
+#include <QVarLengthArray>
 // Структурные элементы
 
 QImage* disk(int radius, QRgb color)
@@ -26,7 +29,7 @@ QImage* disk(int radius, QRgb color)
     return disk;
 }
 
-void dilation(QImage* origin, const QImage &element, const QRgb pixelColor, const QRgb background)
+static void dilationPainter(QImage* origin, const QImage &element, const QRgb pixelColor, const QRgb background)
 {
     int width       = origin->width(),
         height      = origin->height(),
@@ -71,3 +74,87 @@ void dilation(QImage* origin, const QImage &element, const QRgb pixelColor, cons
 
     delete delationResult;
 }
+
+void dilation(QImage* origin, const QImage &element, const QRgb pixelColor, const QRgb background, QImage *scratch)
+{
+    QVector<QRgb> colorTable = origin->colorTable();
+    int pixelIndex      = colorTable.indexOf(pixelColor);
+    int backgroundIndex = colorTable.indexOf(background);
+
+    if (origin->format() != QImage::Format_Indexed8 || pixelIndex < 0 || backgroundIndex < 0)
+    {
+        dilationPainter(origin, element, pixelColor, background);
+        return;
+    }
+
+    int width       = origin->width(),
+        height      = origin->height(),
+        elementSizeX= element.width(),
+        elementSizeY= element.height(),
+        elementRadX = elementSizeX / 2,
+        elementRadY = elementSizeY / 2;
+
+    // Крайние непрозрачные точки каждой строки структурного элемента
+    QVarLengthArray<int, 64> spanLeft(elementSizeY), spanRight(elementSizeY);
+    for (int ey = 0; ey < elementSizeY; ey++)
+    {
+        spanLeft[ey]  = elementSizeX;
+        spanRight[ey] = -1;
+        for (int ex = 0; ex < elementSizeX; ex++)
+            if (qAlpha(element.pixel(ex, ey)))
+            {
+                if (ex < spanLeft[ey])
+                    spanLeft[ey] = ex;
+                spanRight[ey] = ex;
+            }
+    }
+
+    QImage local;
+    QImage* result = scratch ? scratch : &local;
+    if (result->width() != width || result->height() != height || result->format() != QImage::Format_Indexed8)
+        *result = QImage(width, height, QImage::Format_Indexed8);
+    result->setColorTable(colorTable);
+    result->fill(backgroundIndex);
+
+    uchar* resultBits = result->bits();
+    int bytesPerLine  = result->bytesPerLine();
+
+    // Вместо наложения элемента в каждую точку закрашиваем серии точек
+    // подряд: серия [x0, x1] дает в каждой строке элемента отрезок
+    for (int y = 0; y < height; y++)
+    {
+        const uchar* line = origin->constScanLine(y);
+
+        int x = 0;
+        while (x < width)
+        {
+            if (line[x] != pixelIndex)
+            {
+                x++;
+                continue;
+            }
+
+            int runStart = x;
+            while (x < width && line[x] == pixelIndex)
+                x++;
+            int runEnd = x - 1;
+
+            for (int ey = 0; ey < elementSizeY; ey++)
+            {
+                int ty = y - elementRadY + ey;
+                if (spanRight[ey] < 0 || ty < 0 || ty >= height)
+                    continue;
+
+                int x0 = qMax(runStart - elementRadX + spanLeft[ey], 0);
+                int x1 = qMin(runEnd - elementRadX + spanRight[ey], width - 1);
+                if (x0 <= x1)
+                    memset(resultBits + ty * bytesPerLine + x0, pixelIndex, x1 - x0 + 1);
+            }
+        }
+    }
+
+    // Обмен указателями на данные, без копирования
+    QImage temp = *origin;
+    *origin = *result;
+    *result = temp;
+}
@@ -4,5 +4,7 @@
 #include <QImage>
 
 QImage *disk(int radius, QRgb color);
-void dilation(QImage *origin, const QImage &element, const QRgb pixelColor, const QRgb background);
+// scratch - буфер того же размера для результата, после вызова меняется местами с origin.
+// Для Indexed8 строки структурного элемента считаются сплошными (выпуклый элемент)
+void dilation(QImage *origin, const QImage &element, const QRgb pixelColor, const QRgb background, QImage *scratch = 0);
 #endif // MORPHOLOGY_H
@@ -11,13 +11,60 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = pathAnalyzer
 TEMPLATE = app
 
+# qmake CONFIG+=countalloc - подсчет выделений памяти на кадр (см. FramePool::heapAllocations)
+countalloc: DEFINES += COUNT_ALLOCATIONS
+
 SOURCES += main.cpp\
         mainwindow.cpp \
     morphology.cpp \
-    components.cpp
+    components.cpp \
+    videostream.cpp \
+    framepool.cpp \
+    gradient.cpp \
+    luminance.cpp \
+    backgroundmodel.cpp \
+    pyramid.cpp \
+    changedetector.cpp \
+    recognizer.cpp \
+    worker.cpp \
+    trackstore.cpp \
+    tracker.cpp \
+    sweep.cpp \
+    distancemap.cpp \
+    maskfilter.cpp \
+    moments.cpp \
+    batch.cpp \
+    checkpoint.cpp \
+    maskarchive.cpp \
+    thumbnails.cpp \
+    profile.cpp \
+    framesource.cpp \
+    session.cpp
 
 HEADERS  += mainwindow.h \
     morphology.h \
-    components.h
+    components.h \
+    videostream.h \
+    framepool.h \
+    gradient.h \
+    luminance.h \
+    backgroundmodel.h \
+    pyramid.h \
+    changedetector.h \
+    recognizer.h \
+    worker.h \
+    trackstore.h \
+    tracker.h \
+    sweep.h \
+    distancemap.h \
+    maskfilter.h \
+    moments.h \
+    batch.h \
+    checkpoint.h \
+    maskarchive.h \
+    thumbnails.h \
+    profile.h \
+    framesource.h \
+    session.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstring>
+
+#include <QFile>
+#include <QTextStream>
+
+#include "profile.h"
+
+// Ширина полосы этапа, занимающего весь кадр
+#define ProfileBarWidth 40
+
+static const char* const stageNames[StageCount] =
+{
+    "frame", "classify", "pyramid", "model", "hysteresis", "edges", "vote", "opening", "reconstruct", "holes",
+    "track", "blobs", "tracker"
+};
+
+static const int stageParents[StageCount] =
+{
+    -1, StageFrame, StageClassify, StageClassify, StageClassify, StageClassify, StageClassify, StageClassify,
+    StageClassify, StageClassify, StageFrame, StageTrack, StageTrack
+};
+
+static int depth(Stage stage)
+{
+    int result = 0;
+    for (int s = stageParents[stage]; s >= 0; s = stageParents[s])
+        result++;
+    return result;
+}
+
+// Путь этапа для свернутых стеков: frame;classify;model
+static QString path(Stage stage)
+{
+    QString result = stageNames[stage];
+    for (int s = stageParents[stage]; s >= 0; s = stageParents[s])
+        result = QString(stageNames[s]) + ";" + result;
+    return result;
+}
+
+static QString column(double milliseconds)
+{
+    return QString("%1").arg(milliseconds, 9, 'f', 3);
+}
+
+StageProfile::StageProfile()
+{
+    clear();
+}
+
+const char* StageProfile::name(Stage stage)
+{
+    return stageNames[stage];
+}
+
+int StageProfile::parent(Stage stage)
+{
+    return stageParents[stage];
+}
+
+void StageProfile::clear()
+{
+    memset(current, 0, sizeof(current));
+    samples.clear();
+}
+
+void StageProfile::reserve(int frames)
+{
+    samples.reserve(frames * StageCount);
+}
+
+void StageProfile::endFrame()
+{
+    current[StageFrame] = 0;
+    for (int s = 0; s < StageCount; s++)
+        if (stageParents[s] == StageFrame)
+            current[StageFrame] += current[s];
+    appendFrame(current);
+    memset(current, 0, sizeof(current));
+}
+
+void StageProfile::appendFrame(const qint64 times[])
+{
+    for (int s = 0; s < StageCount; s++)
+        samples << times[s];
+}
+
+void StageProfile::append(const StageProfile &other)
+{
+    samples += other.samples;
+}
+
+qint64 StageProfile::total(Stage stage) const
+{
+    qint64 sum = 0;
+    for (int i = stage; i < samples.size(); i += StageCount)
+        sum += samples.at(i);
+    return sum;
+}
+
+qint64 StageProfile::selfTotal(Stage stage) const
+{
+    qint64 self = total(stage);
+    for (int c = 0; c < StageCount; c++)
+        if (stageParents[c] == stage)
+            self -= total((Stage)c);
+    return self;
+}
+
+qint64 StageProfile::percentile(Stage stage, double fraction) const
+{
+    int count = frameCount();
+    if (count == 0)
+        return 0;
+
+    QVector<qint64> times(count);
+    for (int f = 0; f < count; f++)
+        times[f] = at(f, stage);
+    int n = qBound(0, (int)(fraction * count), count - 1);
+    std::nth_element(times.begin(), times.begin() + n, times.end());
+    return times.at(n);
+}
+
+QString StageProfile::summary(const StageProfile *reference) const
+{
+    QString result;
+    QTextStream stream(&result);
+    int count = qMax(frameCount(), 1);
+    qint64 frameTotal = qMax(total(StageFrame), (qint64)1);
+    bool compare = reference && reference->frameCount() > 0;
+
+    stream << "stage               ms/frame    median       95%      self";
+    if (compare)
+        stream << "  recorded   ratio";
+    stream << "   share\n";
+
+    for (int s = 0; s < StageCount; s++)
+    {
+        Stage stage = (Stage)s;
+        qint64 inclusive = total(stage);
+        qint64 self = selfTotal(stage);
+
+        // Выключенные этапы не показываются
+        if (inclusive == 0 && s != StageFrame && (!compare || reference->total(stage) == 0))
+            continue;
+
+        QString label = QString(2 * depth(stage), ' ') + stageNames[s];
+        stream << label.leftJustified(16) << column(inclusive / 1e6 / count)
+               << ' ' << column(percentile(stage, 0.5) / 1e6) << ' ' << column(percentile(stage, 0.95) / 1e6)
+               << ' ' << column(self / 1e6 / count);
+        if (compare)
+        {
+            double recorded = reference->total(stage) / 1e6 / reference->frameCount();
+            double ratio = recorded > 0 ? inclusive / 1e6 / count / recorded : 0;
+            stream << ' ' << column(recorded) << ' ' << QString("%1").arg(ratio, 7, 'f', 2);
+        }
+
+        double share = (double)inclusive / frameTotal;
+        stream << ' ' << QString("%1%").arg(100 * share, 6, 'f', 1) << ' '
+               << QString(qRound(share * ProfileBarWidth), '#') << '\n';
+    }
+
+    stream << frameCount() << " frames\n";
+    stream.flush();
+    return result;
+}
+
+bool StageProfile::writeFolded(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    // Собственное время этапа, мкс по всем кадрам
+    QTextStream stream(&file);
+    for (int s = 0; s < StageCount; s++)
+    {
+        qint64 self = selfTotal((Stage)s);
+        if (self > 0)
+            stream << path((Stage)s) << ' ' << self / 1000 << '\n';
+    }
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
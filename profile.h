@@ -0,0 +1,69 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+// Время этапов обработки по кадрам. Этапы вложены: время этапа включает время
+// вложенных, собственное время - остаток. Итог выводится деревом с полосами
+// (как flame graph, сбоку) и в формате свернутых стеков для flamegraph.pl:
+//   frame;classify;model 1234      - собственное время этапа, мкс
+
+#include <QString>
+#include <QVector>
+
+enum Stage
+{
+    StageFrame,         // кадр: classifyFrame() и track()
+    StageClassify,      //   классификация и очистка маски
+    StagePyramid,       //     кандидаты по уменьшенному кадру
+    StageModel,         //     модель фона
+    StageHysteresis,    //     порог с гистерезисом
+    StageEdges,         //     уточнение по градиенту
+    StageVote,          //     голосование по кадрам
+    StageOpening,       //     размыкание
+    StageReconstruct,   //     восстановление после размыкания
+    StageHoles,         //     заливка дыр
+    StageTrack,         //   траектории
+    StageBlobs,         //     связные области
+    StageTracker,       //     сопровождение
+    StageCount
+};
+
+class StageProfile
+{
+public:
+    StageProfile();
+
+    static const char* name(Stage stage);
+    // Объемлющий этап, -1 у StageFrame
+    static int parent(Stage stage);
+
+    void clear();
+    // Место под frames кадров, чтобы endFrame() не выделял память
+    void reserve(int frames);
+    // Время этапа текущего кадра, нс. Время StageFrame - сумма его этапов, его не добавляют
+    void add(Stage stage, qint64 nanoseconds) { current[stage] += nanoseconds; }
+    // Закрывает кадр: время этапов сохраняется, следующий кадр копится с нуля
+    void endFrame();
+    // Кадры other после своих (повторы одного прохода)
+    void append(const StageProfile& other);
+
+    int frameCount() const { return samples.size() / StageCount; }
+    qint64 at(int frame, Stage stage) const { return samples.at(frame * StageCount + stage); }
+    void appendFrame(const qint64 times[StageCount]);
+
+    // Сумма по кадрам, нс; selfTotal() - без вложенных этапов
+    qint64 total(Stage stage) const;
+    qint64 selfTotal(Stage stage) const;
+    // Время этапа, которого не превышает доля fraction (0..1) кадров, нс
+    qint64 percentile(Stage stage, double fraction) const;
+
+    // Дерево этапов: время на кадр, медиана, 95%, доля кадра и полоса.
+    // reference - то же для сравнения (записанный проход), может быть пустым
+    QString summary(const StageProfile* reference = 0) const;
+    bool writeFolded(const QString& fileName) const;
+
+private:
+    qint64 current[StageCount];
+    // По кадрам: StageCount значений подряд
+    QVector<qint64> samples;
+};
+
+#endif // PROFILE_H
@@ -0,0 +1,183 @@
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pyramid.h"
+#include "components.h"
+#include "luminance.h"
+
+// sums[i] += src[i]
+static void accumulate(const uchar* src, quint32* sums, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128i* sum = (__m128i*)(sums + i);
+        _mm_storeu_si128(sum,     _mm_add_epi32(_mm_loadu_si128(sum),     _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(sum + 1, _mm_add_epi32(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(sum + 2, _mm_add_epi32(_mm_loadu_si128(sum + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(sum + 3, _mm_add_epi32(_mm_loadu_si128(sum + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#endif
+    for (; i < count; i++)
+        sums[i] += src[i];
+}
+
+void Downscaler::scale(const QImage &src, QImage &dst, int width, int height)
+{
+    bool gray = src.format() == QImage::Format_Indexed8;
+    if (!gray && src.depth() != 32)
+    {
+        scale(src.convertToFormat(QImage::Format_RGB32), dst, width, height);
+        return;
+    }
+
+    int channels = gray ? 1 : 4;
+    QImage::Format format = gray ? QImage::Format_Indexed8 : QImage::Format_RGB32;
+    if (dst.width() != width || dst.height() != height || dst.format() != format || !dst.isDetached())
+        dst = QImage(width, height, format);
+    if (gray)
+        dst.setColorTable(grayColorTable());
+
+    int srcWidth = src.width();
+    int srcHeight= src.height();
+    if (width <= 0 || height <= 0 || srcWidth <= 0 || srcHeight <= 0)
+        return;
+
+    // Границы прямоугольников по горизонтали одинаковы для всех строк.
+    // При увеличении прямоугольник вырождается в одну точку
+    columnStart.resize(width + 1);
+    for (int x = 0; x <= width; x++)
+        columnStart[x] = (int)((qint64)x * srcWidth / width);
+
+    sums.resize(srcWidth * channels);
+
+    for (int y = 0; y < height; y++)
+    {
+        int y0 = (int)((qint64)y * srcHeight / height);
+        int y1 = qMax((int)((qint64)(y + 1) * srcHeight / height), y0 + 1);
+
+        // Сначала складываются строки, потом столбцы внутри строки сумм
+        quint32* sum = sums.data();
+        memset(sum, 0, sums.size() * sizeof(quint32));
+        for (int row = y0; row < y1; row++)
+            accumulate(src.constScanLine(row), sum, srcWidth * channels);
+
+        uchar* out = dst.scanLine(y);
+        int rows = y1 - y0;
+        for (int x = 0; x < width; x++)
+        {
+            int c0 = columnStart[x];
+            int c1 = qMax(columnStart[x + 1], c0 + 1);
+            quint32 area = rows * (c1 - c0);
+            quint32 half = area / 2;
+
+            if (gray)
+            {
+                quint32 s = 0;
+                for (int c = c0; c < c1; c++)
+                    s += sum[c];
+                out[x] = (s + half) / area;
+            }
+#ifdef __SSE2__
+            // Точка RGB32 - ровно четыре суммы. Деление через обратную величину точно,
+            // пока запас 0.5 / area больше погрешности float
+            else if (area <= 4096)
+            {
+                __m128i s = _mm_setzero_si128();
+                for (const quint32* p = sum + c0 * 4; p < sum + c1 * 4; p += 4)
+                    s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)p));
+                __m128 q = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(half + 0.5f)),
+                                      _mm_set1_ps(1.f / area));
+                __m128i v = _mm_cvttps_epi32(q);
+                v = _mm_packs_epi32(v, v);
+                *(quint32*)(out + x * 4) = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+            }
+#endif
+            else
+            {
+                quint32 s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                for (const quint32* p = sum + c0 * 4; p < sum + c1 * 4; p += 4)
+                {
+                    s0 += p[0];
+                    s1 += p[1];
+                    s2 += p[2];
+                    s3 += p[3];
+                }
+                uchar* o = out + x * 4;
+                o[0] = (s0 + half) / area;
+                o[1] = (s1 + half) / area;
+                o[2] = (s2 + half) / area;
+                o[3] = (s3 + half) / area;
+            }
+        }
+    }
+}
+
+QImage downscaled(const QImage &src, int width, int height)
+{
+    Downscaler downscaler;
+    QImage dst;
+    downscaler.scale(src, dst, width, height);
+    return dst;
+}
+
+MaskComparison compareMasks(const QImage &mask, const QImage &reference)
+{
+    qint64 both = 0, any = 0;
+    qint64 count = 0, countRef = 0;
+    double x = 0, y = 0, xRef = 0, yRef = 0;
+
+    int width = qMin(mask.width(), reference.width());
+    int height= qMin(mask.height(), reference.height());
+    for (int row = 0; row < height; row++)
+    {
+        const uchar* a = mask.constScanLine(row);
+        const uchar* b = reference.constScanLine(row);
+        for (int col = 0; col < width; col++)
+        {
+            bool inA = a[col] != 0, inB = b[col] != 0;
+            both += inA && inB;
+            any  += inA || inB;
+            if (inA)
+            {
+                count++;
+                x += col;
+                y += row;
+            }
+            if (inB)
+            {
+                countRef++;
+                xRef += col;
+                yRef += row;
+            }
+        }
+    }
+
+    MaskComparison result;
+    result.iou = any ? (double)both / any : 1.;
+    result.centreError = 0;
+    result.boxError = 0;
+
+    if (count && countRef)
+        result.centreError = hypot(x / count - xRef / countRef, y / count - yRef / countRef);
+
+    xy box[2], boxRef[2];
+    bool found = crop(mask, box), foundRef = crop(reference, boxRef);
+    if (found && foundRef)
+        result.boxError = qMax(qMax(qAbs(box[0].x - boxRef[0].x), qAbs(box[0].y - boxRef[0].y)),
+                               qMax(qAbs(box[1].x - boxRef[1].x), qAbs(box[1].y - boxRef[1].y)));
+    else if (found != foundRef)
+        result.boxError = qMax(width, height);
+
+    return result;
+}
@@ -0,0 +1,34 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+// Уменьшение кадров усреднением по прямоугольникам (box filter).
+// На уменьшенном кадре ищутся кандидаты, по нему же строятся миниатюры.
+
+#include <QImage>
+#include <QVector>
+
+class Downscaler
+{
+public:
+    // RGB32 -> RGB32, Indexed8 (яркость) -> Indexed8.
+    // Каждая точка результата - округленное среднее своего прямоугольника исходного кадра.
+    // dst переиспользуется, если у него подходящий размер и формат
+    void scale(const QImage& src, QImage& dst, int width, int height);
+
+private:
+    QVector<int> columnStart;
+    QVector<quint32> sums;
+};
+
+QImage downscaled(const QImage& src, int width, int height);
+
+// Расхождение маски с эталонной
+struct MaskComparison
+{
+    double iou;          // пересечение / объединение, 1 для двух пустых масок
+    double centreError;  // расстояние между центрами масс, точки
+    int boxError;        // наибольшее смещение стороны описанного прямоугольника, точки
+};
+
+MaskComparison compareMasks(const QImage& mask, const QImage& reference);
+
+#endif // PYRAMID_H
@@ -0,0 +1,689 @@
+#include <cstring>
+
+#include <QDebug>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include "recognizer.h"
+#include "morphology.h"
+#include "gradient.h"
+#include "luminance.h"
+
+// Время этапа в профиль кадра; таймер отсчитывает следующий этап
+static inline void lap(StageProfile& profile, Stage stage, QElapsedTimer& timer)
+{
+    profile.add(stage, timer.nsecsElapsed());
+    timer.start();
+}
+
+RecognizerSettings::RecognizerSettings() :
+    sigmamin(5), thresholdK(k), openingRadius(4), covariance(FullCovariance), colorSpace(RgbSpace), suppressShadows(false), useEdges(false), edgeThreshold(16), pyramidScale(1), tileThreshold(0), hysteresisK(0), voteFrames(1), reconstruct(false), fillHoles(false), distanceDepth(0)
+{
+}
+
+Recognizer::Recognizer() :
+    diskRadius(4), classifyTime(0), distanceTime(0), filterTime(0), frames(0)
+{
+    blackDisk = disk(diskRadius, 0xFF000000);
+    whiteDisk = disk(diskRadius, 0xFFFFFFFF);
+}
+
+Recognizer::~Recognizer()
+{
+    delete blackDisk;
+    delete whiteDisk;
+}
+
+const QVector<QRgb>& Recognizer::maskColorTable()
+{
+    static const QVector<QRgb> colorTable = QVector<QRgb>() << 0xFF000000 << 0xFFFFFFFF;
+    return colorTable;
+}
+
+// Сторона уменьшенного кадра с округлением вверх: неполный последний прямоугольник
+// тоже дает точку, иначе правые и нижние точки кадра не попадают в грубый проход
+static int coarseSide(int side, int scale)
+{
+    return (side + scale - 1) / scale;
+}
+
+void Recognizer::beginLearning(const QImage &firstFrame, int parts)
+{
+    clear();
+
+    bool gray = isGrayscale(firstFrame);
+    int scale = settings.pyramidScale;
+    model.create(firstFrame.width(), firstFrame.height(), gray, settings.sigmamin,
+                 settings.covariance, settings.colorSpace);
+    if (scale > 1)
+        coarseModel.create(coarseSide(firstFrame.width(), scale), coarseSide(firstFrame.height(), scale), gray, settings.sigmamin,
+                           settings.covariance, settings.colorSpace);
+
+    for (int i = 1; i < parts; i++)
+    {
+        LearningPart* part = new LearningPart;
+        part->model.create(model.width(), model.height(), gray, settings.sigmamin,
+                           settings.covariance, settings.colorSpace);
+        if (!coarseModel.isEmpty())
+            part->coarseModel.create(coarseModel.width(), coarseModel.height(), gray, settings.sigmamin,
+                                     settings.covariance, settings.colorSpace);
+        learningParts << part;
+    }
+}
+
+void Recognizer::learnFrame(const QImage &frame, int part)
+{
+    const QImage* frames[1] = { &frame };
+    learnFrames(frames, 1, part);
+}
+
+void Recognizer::learnFrames(const QImage * const *frames, int count, int part)
+{
+    LearningPart* learningPart = (part > 0) ? learningParts.at(part - 1) : 0;
+    BackgroundModel& target       = learningPart ? learningPart->model : model;
+    BackgroundModel& coarseTarget = learningPart ? learningPart->coarseModel : coarseModel;
+
+    target.addFrames(frames, count);
+    if (!coarseTarget.isEmpty())
+    {
+        Downscaler& scaler = learningPart ? learningPart->downscaler : downscaler;
+        QImage& scaled     = learningPart ? learningPart->coarseFrame : coarseFrame;
+        for (int f = 0; f < count; f++)
+        {
+            scaler.scale(*frames[f], scaled, coarseTarget.width(), coarseTarget.height());
+            coarseTarget.addFrame(scaled);
+        }
+    }
+}
+
+// Слияние пары частей: полосы строк сливаются в разных потоках
+class MergeTask : public QRunnable
+{
+public:
+    MergeTask(BackgroundModel& target_, const BackgroundModel& source_,
+              BackgroundModel& coarseTarget_, const BackgroundModel& coarseSource_, int band_, int bands_) :
+        target(target_), source(source_), coarseTarget(coarseTarget_), coarseSource(coarseSource_),
+        band(band_), bands(bands_)
+    {
+    }
+
+    void run()
+    {
+        target.merge(source, band, bands);
+        if (!coarseTarget.isEmpty())
+            coarseTarget.merge(coarseSource, band, bands);
+    }
+
+private:
+    BackgroundModel& target;
+    const BackgroundModel& source;
+    BackgroundModel& coarseTarget;
+    const BackgroundModel& coarseSource;
+    int band, bands;
+};
+
+void Recognizer::mergeLearningParts()
+{
+    // Части 0..n-1 сливаются деревом: на шаге step часть i + step добавляется в часть i
+    int n = learningParts.size() + 1;
+    int threads = qMax(1, QThread::idealThreadCount());
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(threads);
+
+    for (int step = 1; step < n; step *= 2)
+    {
+        int pairs = (n - step + 2 * step - 1) / (2 * step);
+        int bands = qMax(1, threads / pairs);
+        for (int i = 0; i + step < n; i += 2 * step)
+        {
+            BackgroundModel& target       = (i == 0) ? model : learningParts.at(i - 1)->model;
+            BackgroundModel& coarseTarget = (i == 0) ? coarseModel : learningParts.at(i - 1)->coarseModel;
+            const LearningPart* source = learningParts.at(i + step - 1);
+            for (int band = 0; band < bands; band++)
+                threadPool.start(new MergeTask(target, source->model, coarseTarget, source->coarseModel,
+                                               band, bands));
+        }
+        threadPool.waitForDone();
+    }
+
+    qDeleteAll(learningParts);
+    learningParts.clear();
+}
+
+void Recognizer::endLearning()
+{
+    mergeLearningParts();
+    model.finalize();
+    coarseModel.finalize();
+
+    int pixels = model.width() * model.height();
+    if (pixels > 0 && !model.isGray())
+        qDebug() << "finalize" << model.lastFinalizeTime() / 1e6 << "ms, degenerate covariance"
+                 << model.degeneratePixels() << "of" << pixels << "pixels ("
+                 << 100. * model.degeneratePixels() / pixels << "%)";
+    updateBackgroundGradient();
+}
+
+void Recognizer::updateBackgroundGradient()
+{
+    if (!hasModel())
+        return;
+
+    // Градиент фона считается один раз по средним значениям модели
+    QImage luma;
+    model.meanLuminance(luma);
+    if (luma.isNull())
+        return;
+    gradientMagnitude(luma, backgroundGradient);
+}
+
+void Recognizer::saveModel(QDataStream &stream) const
+{
+    stream << (qint32)settings.pyramidScale;
+    model.save(stream);
+    coarseModel.save(stream);
+}
+
+bool Recognizer::loadModel(QDataStream &stream)
+{
+    clear();
+
+    qint32 scale;
+    stream >> scale;
+    if (stream.status() != QDataStream::Ok || !model.load(stream) || !coarseModel.load(stream))
+    {
+        clear();
+        return false;
+    }
+
+    settings.pyramidScale = scale;
+    settings.sigmamin = model.sigmaMin();
+    settings.covariance = model.covarianceType();
+    settings.colorSpace = model.colorSpace();
+
+    // Суммы целые, поэтому модель получается та же, что после обучения
+    model.finalize();
+    coarseModel.finalize();
+    updateBackgroundGradient();
+    return true;
+}
+
+bool Recognizer::hasModel() const
+{
+    return !model.isEmpty();
+}
+
+bool Recognizer::isGray() const
+{
+    return model.isGray();
+}
+
+int Recognizer::width() const
+{
+    return model.width();
+}
+
+int Recognizer::height() const
+{
+    return model.height();
+}
+
+void Recognizer::clear()
+{
+    qDeleteAll(learningParts);
+    learningParts.clear();
+    model.clear();
+    coarseModel.clear();
+    backgroundGradient = QImage();
+}
+
+void Recognizer::track(int frame, const QImage &mask)
+{
+    QElapsedTimer stageTimer;
+    stageTimer.start();
+    findBlobs(mask, blobs, labels, parents, TrackMinArea);
+    qint64 blobTime = stageTimer.nsecsElapsed();
+    tracker.update(frame, blobs, trackStore);
+    qint64 trackTime = stageTimer.nsecsElapsed();
+
+    // Кадр заканчивается сопровождением
+    stageProfile.add(StageBlobs, blobTime);
+    stageProfile.add(StageTracker, trackTime - blobTime);
+    stageProfile.add(StageTrack, trackTime);
+    stageProfile.endFrame();
+}
+
+void Recognizer::saveTracking(QDataStream &stream) const
+{
+    tracker.save(stream);
+}
+
+bool Recognizer::restoreTracking(QDataStream &stream, const TrackStore &points)
+{
+    if (!tracker.load(stream))
+        return false;
+    trackStore = points;
+    return true;
+}
+
+xy Recognizer::trackedCentre(const QImage &mask) const
+{
+    double x, y;
+    if (!tracker.primaryPosition(x, y))
+        return centreOfMass(mask);
+
+    xy centre;
+    centre.x = qRound(x);
+    centre.y = qRound(y);
+    return centre;
+}
+
+void Recognizer::begin(int width, int height, int frameCount)
+{
+    framePool.reset(width, height);
+    changeDetector.reset();
+    model.setShadowSuppression(settings.suppressShadows);
+    coarseModel.setShadowSuppression(settings.suppressShadows);
+    model.setThresholdK(settings.thresholdK);
+    coarseModel.setThresholdK(settings.thresholdK);
+
+    if (settings.openingRadius != diskRadius)
+    {
+        delete blackDisk;
+        delete whiteDisk;
+        diskRadius = settings.openingRadius;
+        blackDisk = disk(diskRadius, 0xFF000000);
+        whiteDisk = disk(diskRadius, 0xFFFFFFFF);
+    }
+    vote.reset(width, height, settings.voteFrames);
+    tracker.reset();
+    tracker.reserve(TrackReserveBlobs);
+    trackStore.clear();
+    stageProfile.clear();
+
+    // Новая метка ставится только точке без соседей слева и сверху, поэтому таких точек
+    // не больше одной на квадрат 2x2
+    labels.reserve(width * height);
+    parents.reserve((width + 1) / 2 * ((height + 1) / 2) + 1);
+    blobs.reserve(TrackReserveBlobs);
+    if (frameCount > 0)
+    {
+        trackStore.reserve(frameCount * TrackReservePoints);
+        stageProfile.reserve(frameCount);
+    }
+
+    classifyTime = 0;
+    distanceTime = 0;
+    filterTime = 0;
+    frames = 0;
+}
+
+const QImage& Recognizer::modelFrame(const QImage &frame, QImage *&converted)
+{
+    converted = 0;
+    if (model.isEmpty() || model.acceptsFrame(frame) || frame.width() != model.width() || frame.height() != model.height())
+        return frame;
+
+    if (model.isGray())
+    {
+        converted = framePool.acquire(QImage::Format_Indexed8, grayColorTable());
+        if (frame.depth() == 32)
+            luminance(frame, *converted);
+        else
+            luminance(frame.convertToFormat(QImage::Format_RGB32), *converted);
+    }
+    else if (frame.format() == QImage::Format_Indexed8)
+    {
+        // Серый (или палитровый) кадр для цветной модели - точки по палитре
+        converted = framePool.acquire(QImage::Format_RGB32);
+        QVector<QRgb> table = frame.colorTable();
+        for (int y = 0; y < frame.height(); y++)
+        {
+            const uchar* index = frame.constScanLine(y);
+            QRgb* pixel = (QRgb*)converted->scanLine(y);
+            for (int x = 0; x < frame.width(); x++)
+                pixel[x] = index[x] < table.size() ? table.at(index[x]) : 0;
+        }
+    }
+    else
+    {
+        converted = framePool.acquire(QImage::Format_RGB32);
+        *converted = frame.convertToFormat(QImage::Format_RGB32);
+    }
+    return *converted;
+}
+
+void Recognizer::classifyFrame(const QImage &input, QImage *mask, DistanceMap *map)
+{
+    QImage* converted;
+    const QImage& frame = modelFrame(input, converted);
+    qint64 allocations = FramePool::heapAllocations();
+    timer.start();
+
+    classify(frame, mask, map);
+
+    qint64 elapsed = timer.nsecsElapsed();
+    classifyTime += elapsed;
+    stageProfile.add(StageClassify, elapsed);
+    checkAllocations(allocations, frames++);
+
+    if (converted)
+        framePool.release(converted);
+}
+
+void Recognizer::distances(const QImage &input, DistanceMap &map)
+{
+    QImage* converted;
+    const QImage& frame = modelFrame(input, converted);
+    timer.start();
+    map.create(model.width(), model.height(), settings.distanceDepth);
+    model.distances(frame, map);
+    distanceTime += timer.nsecsElapsed();
+    if (converted)
+        framePool.release(converted);
+}
+
+void Recognizer::report()
+{
+    if (frames == 0)
+        return;
+
+    qDebug() << frames << "frames," << classifyTime / 1e6 / frames << "ms per frame";
+    qDebug() << "filter:" << filterTime / 1e6 / frames << "ms per frame, hysteresis" << settings.hysteresisK
+             << ", vote" << settings.voteFrames << "frames, disk" << settings.openingRadius
+             << ", reconstruct" << settings.reconstruct << ", fill holes" << settings.fillHoles;
+    if (distanceTime)
+        qDebug() << "distance maps:" << distanceTime / 1e6 / frames << "ms per frame," << settings.distanceDepth << "bit";
+    if (settings.tileThreshold > 0)
+        qDebug() << "tiles: skipped" << 100. * changeDetector.skippedFraction() << "% of"
+                 << changeDetector.tilesTotal() << "blocks";
+    qDebug() << "tracks:" << tracker.tracksStarted() << "," << trackStore.size() << "points";
+    qDebug("%s", qPrintable(stageProfile.summary()));
+}
+
+void Recognizer::checkAllocations(qint64 before, int frame)
+{
+    // Первые кадры заполняют пул, дальше выделений быть не должно
+    qint64 after = FramePool::heapAllocations();
+    if (before >= 0 && frame > 2 && after != before)
+        qWarning() << "frame" << frame << ":" << after - before << "heap allocations";
+}
+
+bool Recognizer::pyramidActive(const QImage &frame) const
+{
+    // Модель обучена для другого масштаба - работаем в полном разрешении
+    return settings.pyramidScale > 1 && !coarseModel.isEmpty()
+        && coarseModel.width() == coarseSide(frame.width(), settings.pyramidScale)
+        && coarseModel.height() == coarseSide(frame.height(), settings.pyramidScale);
+}
+
+bool Recognizer::hysteresisActive() const
+{
+    return settings.hysteresisK > 0 && settings.hysteresisK < settings.thresholdK && !model.isEmpty();
+}
+
+void Recognizer::findCandidates(const QImage &frame)
+{
+    int coarseWidth = coarseModel.width();
+    int coarseHeight= coarseModel.height();
+
+    // Грубый проход
+    downscaler.scale(frame, coarseFrame, coarseWidth, coarseHeight);
+    if (coarseMask.width() != coarseWidth || coarseMask.height() != coarseHeight)
+        coarseMask = QImage(coarseWidth, coarseHeight, QImage::Format_Indexed8);
+    coarseModel.classify(coarseFrame, coarseMask);
+    componentBoxes(coarseMask, candidates, labels, parents);
+
+    // Области кадра полного разрешения, в которых работает точная модель. Границы точек
+    // уменьшенного кадра - те же, что у Downscaler: x * ширина кадра / ширина уменьшенного
+    int frameWidth = frame.width(), frameHeight = frame.height();
+    QRect frameRect(0, 0, frameWidth, frameHeight);
+    int margin = PyramidMargin * settings.pyramidScale;
+    for (int i = 0; i < candidates.size(); i++)
+    {
+        QRect& box = candidates[i];
+        QRect scaled;
+        scaled.setCoords(box.left() * frameWidth / coarseWidth - margin, box.top() * frameHeight / coarseHeight - margin,
+                         (box.right() + 1) * frameWidth / coarseWidth - 1 + margin,
+                         (box.bottom() + 1) * frameHeight / coarseHeight - 1 + margin);
+        box = scaled.intersected(frameRect);
+    }
+
+    // Там, где траектории ждут объект, точная модель работает и без кандидата грубого прохода
+    tracker.searchWindows(trackWindows, frameRect);
+    candidates += trackWindows;
+}
+
+void Recognizer::classifyRect(const QImage &frame, QImage &mask, const QRect &rect, bool pyramid)
+{
+    if (!pyramid)
+    {
+        model.classify(frame, mask, rect);
+        return;
+    }
+
+    // Вне кандидатов - фон, края и центр масс берутся из точной маски
+    for (int y = rect.top(); y <= rect.bottom(); y++)
+        memset(mask.scanLine(y) + rect.left(), 0, rect.width());
+    for (int i = 0; i < candidates.size(); i++)
+    {
+        QRect roi = candidates.at(i).intersected(rect);
+        if (!roi.isEmpty())
+            model.classify(frame, mask, roi);
+    }
+}
+
+void Recognizer::classify(const QImage &frame, QImage *mask, DistanceMap *map)
+{
+    bool gray = isGrayscale(frame);
+    bool useHysteresis = hysteresisActive();
+    // Маска по карте расстояний (гистерезис или запрошенная карта) - всегда по всему кадру
+    bool fullDistances = useHysteresis || map;
+    bool pyramid = !fullDistances && pyramidActive(frame);
+    // Голосование помнит прошлые маски: кадр, пропущенный целиком, выпал бы из окна
+    bool skipTiles = !fullDistances && settings.tileThreshold > 0 && vote.frames() <= 1;
+    QElapsedTimer filterTimer, stageTimer;
+    stageTimer.start();
+
+    if (pyramid)
+    {
+        findCandidates(frame);
+        lap(stageProfile, StagePyramid, stageTimer);
+    }
+
+    if (fullDistances)
+    {
+        DistanceMap& distanceMap = map ? *map : hysteresisMap;
+        distanceMap.create(frame.width(), frame.height(), map ? settings.distanceDepth : 16);
+        model.distances(frame, distanceMap);
+        lap(stageProfile, StageModel, stageTimer);
+        if (useHysteresis)
+        {
+            // Слабые точки (выше нижнего порога) остаются только рядом с сильными
+            filterTimer.start();
+            hysteresis(distanceMap, distanceMap.levelOf(settings.hysteresisK), distanceMap.levelOf(settings.thresholdK),
+                       *mask, hysteresisScratch, floodStack);
+            filterTime += filterTimer.nsecsElapsed();
+            lap(stageProfile, StageHysteresis, stageTimer);
+        }
+        else
+            distanceMap.threshold(settings.thresholdK, *mask);
+    }
+    else if (skipTiles)
+    {
+        if (rawMask.width() != frame.width() || rawMask.height() != frame.height())
+        {
+            rawMask = QImage(frame.width(), frame.height(), QImage::Format_Indexed8);
+            changeDetector.reset();
+        }
+
+        if (changeDetector.update(frame, settings.tileThreshold) == 0
+                && lastMask.width() == frame.width() && lastMask.height() == frame.height())
+        {
+            // Ни один блок не изменился - результат тот же, размыкание не нужно
+            memcpy(mask->bits(), lastMask.constBits(), lastMask.byteCount());
+            lap(stageProfile, StageModel, stageTimer);
+            return;
+        }
+
+        // Неизменившиеся блоки сохраняют точки маски прошлых кадров (до размыкания,
+        // чтобы размыкание дало тот же результат, что и при полной классификации)
+        const QVector<QRect>& changed = changeDetector.changedRects();
+        for (int i = 0; i < changed.size(); i++)
+            classifyRect(frame, rawMask, changed.at(i), pyramid);
+        memcpy(mask->bits(), rawMask.constBits(), rawMask.byteCount());
+        lap(stageProfile, StageModel, stageTimer);
+    }
+    else
+    {
+        classifyRect(frame, *mask, QRect(0, 0, frame.width(), frame.height()), pyramid);
+        lap(stageProfile, StageModel, stageTimer);
+    }
+
+    // Тени и блики не меняют текстуру фона - оставляем только точки рядом с изменившимися границами
+    if (settings.useEdges && !backgroundGradient.isNull())
+    {
+        // Серый кадр уже и есть яркость
+        QImage* luma     = gray ? 0 : framePool.acquire(QImage::Format_Indexed8);
+        QImage* gradient = framePool.acquire(QImage::Format_Indexed8);
+        QImage* scratch1 = framePool.acquire(QImage::Format_Indexed8);
+        QImage* scratch2 = framePool.acquire(QImage::Format_Indexed8);
+
+        if (luma)
+            luminance(frame, *luma);
+        gradientMagnitude(gray ? frame : *luma, *gradient);
+        refineByEdges(mask, *gradient, backgroundGradient, settings.edgeThreshold, EdgeRadius, *scratch1, *scratch2);
+
+        if (luma)
+            framePool.release(luma);
+        framePool.release(gradient);
+        framePool.release(scratch1);
+        framePool.release(scratch2);
+        lap(stageProfile, StageEdges, stageTimer);
+    }
+
+    filterTimer.start();
+
+    if (vote.frames() > 1)
+    {
+        vote.apply(*mask);
+        lap(stageProfile, StageVote, stageTimer);
+    }
+
+    // Размыкание
+    QImage* scratch = framePool.acquire(QImage::Format_Indexed8);
+    QImage* unopened = 0;
+    if (settings.reconstruct)
+    {
+        unopened = framePool.acquire(QImage::Format_Indexed8);
+        memcpy(unopened->bits(), mask->constBits(), mask->byteCount());
+    }
+    dilation(mask, *blackDisk, 0xFF000000, 0xFFFFFFFF, scratch);
+    dilation(mask, *whiteDisk, 0xFFFFFFFF, 0xFF000000, scratch);
+    framePool.release(scratch);
+    lap(stageProfile, StageOpening, stageTimer);
+
+    // Тонкие части объекта (ноги, руки), стертые размыканием, возвращаются вместе
+    // со связями между частями; шум, стертый целиком, не возвращается
+    if (unopened)
+    {
+        reconstruct(*mask, *unopened, floodStack);
+        framePool.release(unopened);
+        lap(stageProfile, StageReconstruct, stageTimer);
+    }
+    if (settings.fillHoles)
+    {
+        componentBoxes(*mask, holeBoxes, labels, parents);
+        fillHoles(*mask, holeBoxes, floodStack);
+        lap(stageProfile, StageHoles, stageTimer);
+    }
+
+    filterTime += filterTimer.nsecsElapsed();
+
+    if (skipTiles)
+    {
+        if (lastMask.width() != mask->width() || lastMask.height() != mask->height())
+            lastMask = QImage(mask->width(), mask->height(), QImage::Format_Indexed8);
+        memcpy(lastMask.bits(), mask->constBits(), mask->byteCount());
+    }
+}
+
+void Recognizer::pushCentre(QList<xy> &centres, xy centre)
+{
+    if (centre.x > 0)
+    {
+        if (centres.size() == QueueLength)
+        {
+            centres.removeFirst();
+        }
+        centres << centre;
+    }
+}
+
+static void drawLine(QImage &image, int x0, int y0, int x1, int y1, QRgb color)
+{
+    // Брезенхем, точки вне изображения пропускаются
+    int dx = qAbs(x1 - x0), sx = (x0 < x1) ? 1 : -1;
+    int dy = -qAbs(y1 - y0), sy = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+
+    while (true)
+    {
+        if (x0 >= 0 && y0 >= 0 && x0 < image.width() && y0 < image.height())
+            ((QRgb*)image.scanLine(y0))[x0] = color;
+
+        if (x0 == x1 && y0 == y1)
+            break;
+
+        int error2 = 2 * error;
+        if (error2 >= dy)
+        {
+            error += dy;
+            x0 += sx;
+        }
+        if (error2 <= dx)
+        {
+            error += dx;
+            y0 += sy;
+        }
+    }
+}
+
+static void drawRect(QImage &image, int x, int y, int width, int height, QRgb color)
+{
+    drawLine(image, x, y, x + width, y, color);
+    drawLine(image, x, y + height, x + width, y + height, color);
+    drawLine(image, x, y, x, y + height, color);
+    drawLine(image, x + width, y, x + width, y + height, color);
+}
+
+void Recognizer::drawTrajectory(QImage &image, const QImage &mask, const QList<xy> &centres)
+{
+    // Рисуем прямо по точкам: QPainter создает движок отрисовки при каждом begin()
+    const QRgb trajColor = 0xFFFF0000;
+
+    xy croped[2];
+    if (crop(mask, croped))
+        drawRect(image, croped[0].x, croped[0].y, croped[1].x - croped[0].x, croped[1].y - croped[0].y, trajColor);
+
+    // Рисование траекторий
+    if (centres.size() > 1)
+        for (QList<xy>::const_iterator iter = centres.begin() + 1, iter1 = centres.begin();
+             iter != centres.end(); iter++, iter1++)
+        {
+            drawLine(image, iter1->x, iter1->y, iter->x, iter->y, trajColor);
+            drawRect(image, iter->x - 2, iter->y - 2, 4, 4, trajColor);
+        }
+}
+
+xy Recognizer::centreOfMass(const QImage &mask) const
+{
+    Moments moments = maskMoments(mask, QRect(0, 0, mask.width(), mask.height()), centreAccumulator, centreBits);
+
+    // Пустая маска - (-1, -1)
+    xy center;
+    center.x = moments.area ? qRound(moments.x()) : -1;
+    center.y = moments.area ? qRound(moments.y()) : -1;
+    return center;
+}
@@ -0,0 +1,212 @@
+#ifndef RECOGNIZER_H
+#define RECOGNIZER_H
+// Обработка кадров без GUI: обучение модели фона, выделение объектов, траектории.
+// Объектом пользуется один поток за раз - пока работает Worker, GUI его не трогает.
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "backgroundmodel.h"
+#include "changedetector.h"
+#include "components.h"
+#include "framepool.h"
+#include "maskfilter.h"
+#include "profile.h"
+#include "pyramid.h"
+#include "tracker.h"
+#include "trackstore.h"
+
+#define QueueLength 25
+// Радиус окрестности изменения текстуры, в которой сохраняется маска
+#define EdgeRadius 4
+// Запас вокруг кандидата грубого прохода, в точках уменьшенного кадра
+#define PyramidMargin 2
+// Области меньшей площади в траектории не попадают
+#define TrackMinArea 20
+// Точек траекторий на кадр, под которые begin() резервирует хранилище
+#define TrackReservePoints 4
+// Областей и траекторий в кадре, под которые begin() резервирует буферы; при большем
+// числе буферы растут, и track() выделяет память, пока не достигнет нового максимума
+#define TrackReserveBlobs 64
+// Потоков обучения не больше: у каждого своя копия сумм модели
+#define MaxLearningThreads 8
+// Кадров, которые поток обучения берет за раз
+#define LearningBatch 8
+
+struct RecognizerSettings
+{
+    RecognizerSettings();
+
+    float sigmamin;
+    // Порог: фон - расстояние Махаланобиса меньше thresholdK^3
+    float thresholdK;
+    // Радиус диска размыкания маски
+    int openingRadius;
+    // Цветная модель: вид ковариации и пространство цвета
+    CovarianceType covariance;
+    ColorSpace colorSpace;
+    // Подавление теней и бликов (цветная модель RGB)
+    bool suppressShadows;
+    // Уточнение маски по градиенту
+    bool useEdges;
+    int edgeThreshold;
+    // Пирамида: кандидаты ищутся моделью уменьшенного в pyramidScale раз кадра
+    int pyramidScale;
+    // Пропуск неизменившихся блоков: порог средней разности на точку, 0 - выключен.
+    // При голосовании (voteFrames > 1) не используется
+    int tileThreshold;
+    // Нижний порог гистерезиса (меньше thresholdK), 0 - выключен. Включенный гистерезис
+    // считает расстояния всего кадра, пирамида и пропуск блоков не используются
+    float hysteresisK;
+    // Голосование точки по стольким последним маскам, 1 - выключено; включенное отключает
+    // пропуск блоков
+    int voteFrames;
+    // После размыкания: вернуть стертые им части областей (восстановление по маске
+    // до размыкания) и залить дыры внутри областей
+    bool reconstruct;
+    bool fillHoles;
+    // Квантованные расстояния кадров для нового порога без модели: 8 или 16 бит, 0 - не нужны
+    int distanceDepth;
+};
+
+class Recognizer
+{
+public:
+    Recognizer();
+    ~Recognizer();
+
+    // Меняется только между задачами
+    RecognizerSettings settings;
+
+    // Обучение: модель создается по первому кадру и текущим settings.
+    // Кадры делятся на parts частей, каждую часть копит свой поток в своей
+    // модели; endLearning() сливает части попарно и завершает модель
+    void beginLearning(const QImage& firstFrame, int parts = 1);
+    void learnFrame(const QImage& frame, int part = 0);
+    void learnFrames(const QImage* const* frames, int count, int part = 0);
+    void endLearning();
+
+    // Модель для подбора параметров (ParameterSweep), только между задачами
+    BackgroundModel& backgroundModel() { return model; }
+
+    // Обученная модель (суммы и обе модели пирамиды) для продолжения прерванной работы.
+    // loadModel() берет из потока sigmamin, вид ковариации, пространство цвета и масштаб пирамиды
+    void saveModel(QDataStream& stream) const;
+    bool loadModel(QDataStream& stream);
+
+    bool hasModel() const;
+    bool isGray() const;
+    int width() const;
+    int height() const;
+    void clear();
+
+    // Начало последовательности кадров: буферы, опорные блоки и статистика.
+    // frameCount - число кадров, если известно: профиль и траектории (по TrackReservePoints
+    // точек на кадр) резервируются сразу. Разметка областей резервируется на худший случай,
+    // области и траектории - на TrackReserveBlobs, и track() не выделяет память по ходу
+    void begin(int width, int height, int frameCount = 0);
+    // mask - Indexed8 размера кадра, 1 - объект. Кадр другого вида, чем модель, переводится в ее вид.
+    // map - если задана, в нее пишутся квантованные расстояния кадра (settings.distanceDepth бит) и
+    // маска строится порогом по ним: модель считается один раз, без пирамиды и пропуска блоков
+    void classifyFrame(const QImage& frame, QImage* mask, DistanceMap* map = 0);
+    // Только квантованные расстояния кадра, map создается здесь (settings.distanceDepth бит)
+    void distances(const QImage& frame, DistanceMap& map);
+    // Точки траекторий по готовой маске кадра
+    void track(int frame, const QImage& mask);
+    // Положение объекта для рисования траектории: сглаженное фильтром самой старой
+    // траектории (и предсказанное, если объект пропал), без траекторий - центр масс mask
+    xy trackedCentre(const QImage& mask) const;
+    // Центр масс mask, (-1, -1) у пустой. Рабочие буферы - члены, между кадрами не выделяются
+    xy centreOfMass(const QImage& mask) const;
+    // Траектории последовательности, очищаются в begin()
+    const TrackStore& tracks() const { return trackStore; }
+    // Состояние сопровождения в контрольной точке; restoreTracking() - после begin(),
+    // points - траектории до кадра, с которого продолжается работа
+    void saveTracking(QDataStream& stream) const;
+    bool restoreTracking(QDataStream& stream, const TrackStore& points);
+    // Статистика последовательности в отладочный вывод
+    void report();
+    // Время этапов по кадрам последовательности; кадр закрывает track()
+    const StageProfile& profile() const { return stageProfile; }
+
+    FramePool& pool() { return framePool; }
+    static const QVector<QRgb>& maskColorTable();
+
+    static void pushCentre(QList<xy>& centres, xy centre);
+    static void drawTrajectory(QImage& image, const QImage& mask, const QList<xy>& centres);
+
+private:
+    Q_DISABLE_COPY(Recognizer)
+
+    // Кадр в виде модели: серый для серой, RGB32 для цветной. Если перевод нужен, converted -
+    // буфер из пула (освобождает вызывающий), иначе 0 и возвращается сам frame
+    const QImage& modelFrame(const QImage& frame, QImage*& converted);
+    // map - см. classifyFrame()
+    void classify(const QImage& frame, QImage* mask, DistanceMap* map = 0);
+    static void checkAllocations(qint64 before, int frame);
+
+    BackgroundModel model;
+    QImage backgroundGradient;
+
+    // Части обучения 1..parts-1, часть 0 - сами model и coarseModel
+    struct LearningPart
+    {
+        BackgroundModel model;
+        BackgroundModel coarseModel;
+        Downscaler downscaler;
+        QImage coarseFrame;
+    };
+    QList<LearningPart*> learningParts;
+    void mergeLearningParts();
+    void updateBackgroundGradient();
+
+    QImage* blackDisk;
+    QImage* whiteDisk;
+    int diskRadius;
+
+    FramePool framePool;
+
+    BackgroundModel coarseModel;
+    Downscaler downscaler;
+    QImage coarseFrame;
+    QImage coarseMask;
+    QVector<QRect> candidates;
+    QVector<QRect> trackWindows;
+    QVector<int> labels;
+    QVector<int> parents;
+    bool pyramidActive(const QImage& frame) const;
+    bool hysteresisActive() const;
+    void findCandidates(const QImage& frame);
+    void classifyRect(const QImage& frame, QImage& mask, const QRect& rect, bool pyramid);
+
+    Tracker tracker;
+    TrackStore trackStore;
+    QVector<Blob> blobs;
+    mutable MomentAccumulator centreAccumulator;
+    mutable QVector<quint64> centreBits;
+
+    // Гистерезис, голосование, восстановление и заливка дыр
+    DistanceMap hysteresisMap;
+    QImage hysteresisScratch;
+    QVector<int> floodStack;
+    QVector<QRect> holeBoxes;
+    TemporalVote vote;
+
+    ChangeDetector changeDetector;
+    QImage rawMask;
+    QImage lastMask;
+
+    // Статистика последовательности
+    QElapsedTimer timer;
+    StageProfile stageProfile;
+    qint64 classifyTime;
+    qint64 distanceTime;
+    // Очистка маски: гистерезис, голосование и размыкание
+    qint64 filterTime;
+    int frames;
+};
+
+#endif // RECOGNIZER_H
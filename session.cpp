@@ -0,0 +1,339 @@
+#include <cstdio>
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QMap>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include "session.h"
+#include "framesource.h"
+
+// Смещение и множитель 64-битного FNV-1a; хеш идет по 8 байт маски за шаг
+static const quint64 HashOffset = 0xCBF29CE484222325ull;
+static const quint64 HashPrime = 0x100000001B3ull;
+
+// Ключи параметров распознавания и остальные ключи сеанса
+static const char* const settingKeys[] = { "sigmamin", "k", "disk", "rho", "covariance", "color_space", "shadows",
+                                           "edges", "edge_threshold", "pyramid_scale", "tile_threshold", "hysteresis_k",
+                                           "vote_frames", "reconstruct", "fill_holes", "distance_depth", 0 };
+static const char* const sessionKeys[] = { "version", "input", "learn_first", "learn_last", "first", "width", "height",
+                                           "gray", 0 };
+
+static bool isKey(const char* const* keys, const QString& key)
+{
+    for (int i = 0; keys[i]; i++)
+        if (key == keys[i])
+            return true;
+    return false;
+}
+
+// Строки ключ=значение до строки frames (начала таблицы кадров) или конца файла
+static QMap<QString, QString> readValues(QTextStream& stream)
+{
+    QMap<QString, QString> values;
+    while (!stream.atEnd())
+    {
+        QString line = stream.readLine().trimmed();
+        if (line == "frames")
+            break;
+        int separator = line.indexOf('=');
+        if (separator > 0 && !line.startsWith('#'))
+            values[line.left(separator).trimmed()] = line.mid(separator + 1).trimmed();
+    }
+    return values;
+}
+
+Session::Session() :
+    learnFirst(0), learnLast(0), firstFrame(0), width(0), height(0), gray(false)
+{
+}
+
+quint64 Session::maskHash(const QImage &mask)
+{
+    quint64 hash = HashOffset;
+    for (int y = 0; y < mask.height(); y++)
+    {
+        const uchar* line = mask.constScanLine(y);
+        int x = 0;
+        for (; x + 8 <= mask.width(); x += 8)
+        {
+            quint64 word;
+            memcpy(&word, line + x, 8);
+            hash = (hash ^ word) * HashPrime;
+        }
+        for (; x < mask.width(); x++)
+            hash = (hash ^ line[x]) * HashPrime;
+    }
+    return hash;
+}
+
+bool Session::save(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "version=" << SessionVersion << "\ninput=" << input << "\nlearn_first=" << learnFirst
+           << "\nlearn_last=" << learnLast << "\nfirst=" << firstFrame << "\nwidth=" << width << "\nheight=" << height
+           << "\ngray=" << (int)gray << '\n';
+    writeSettings(stream, settings);
+    stream << "frames\n";
+
+    stream << "frame,mask_hash";
+    for (int s = 0; s < StageCount; s++)
+        stream << ',' << StageProfile::name((Stage)s) << "_ns";
+    stream << '\n';
+    for (int f = 0; f < maskHashes.size(); f++)
+    {
+        stream << firstFrame + f << ',' << QString("%1").arg(maskHashes.at(f), 16, 16, QChar('0'));
+        for (int s = 0; s < StageCount; s++)
+            stream << ',' << (f < profile.frameCount() ? profile.at(f, (Stage)s) : 0);
+        stream << '\n';
+    }
+
+    stream.flush();
+    if (stream.status() != QTextStream::Ok)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool Session::load(const QString &fileName, QString &error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = "cannot open " + fileName;
+        return false;
+    }
+
+    // Сеанс версии 2 отличается только отсутствием gray и distance_depth
+    QTextStream stream(&file);
+    QMap<QString, QString> values = readValues(stream);
+    int version = values.value("version").toInt();
+    if (version < 2 || version > SessionVersion || !values.contains("input"))
+    {
+        error = "not a session file: " + fileName;
+        return false;
+    }
+
+    input = values.value("input");
+    learnFirst = values.value("learn_first").toInt();
+    learnLast = values.value("learn_last").toInt();
+    firstFrame = values.value("first").toInt();
+    width = values.value("width").toInt();
+    height = values.value("height").toInt();
+    gray = values.value("gray").toInt() != 0;
+    settings = RecognizerSettings();
+    readSettings(values, settings);
+
+    // Таблица кадров: заголовок, затем кадр, хеш и StageCount времен
+    maskHashes.clear();
+    profile.clear();
+    stream.readLine();
+    qint64 times[StageCount];
+    for (int line = 1; !stream.atEnd(); line++)
+    {
+        QString text = stream.readLine().trimmed();
+        if (text.isEmpty())
+            continue;
+
+        QStringList fields = text.split(',');
+        bool ok = fields.size() == StageCount + 2 && fields.at(0).toInt() == firstFrame + maskHashes.size();
+        quint64 hash = ok ? fields.at(1).toULongLong(&ok, 16) : 0;
+        for (int s = 0; ok && s < StageCount; s++)
+            times[s] = fields.at(s + 2).toLongLong(&ok);
+        if (!ok)
+        {
+            error = QString("error in frame line %1 of %2").arg(line).arg(fileName);
+            return false;
+        }
+        maskHashes << hash;
+        profile.appendFrame(times);
+    }
+    return true;
+}
+
+void Session::writeSettings(QTextStream &stream, const RecognizerSettings &settings)
+{
+    // rho - постоянная сборки (backgroundmodel.h), записывается для сверки
+    stream << "sigmamin=" << settings.sigmamin << "\nk=" << settings.thresholdK << "\ndisk=" << settings.openingRadius
+           << "\nrho=" << rho << "\ncovariance=" << (int)settings.covariance << "\ncolor_space=" << (int)settings.colorSpace
+           << "\nshadows=" << (int)settings.suppressShadows << "\nedges=" << (int)settings.useEdges
+           << "\nedge_threshold=" << settings.edgeThreshold << "\npyramid_scale=" << settings.pyramidScale
+           << "\ntile_threshold=" << settings.tileThreshold << "\nhysteresis_k=" << settings.hysteresisK
+           << "\nvote_frames=" << settings.voteFrames << "\nreconstruct=" << (int)settings.reconstruct
+           << "\nfill_holes=" << (int)settings.fillHoles << "\ndistance_depth=" << settings.distanceDepth << '\n';
+}
+
+void Session::readSettings(const QMap<QString, QString> &values, RecognizerSettings &settings)
+{
+    if (values.contains("sigmamin"))
+        settings.sigmamin = values.value("sigmamin").toFloat();
+    if (values.contains("k"))
+        settings.thresholdK = values.value("k").toFloat();
+    if (values.contains("disk"))
+        settings.openingRadius = values.value("disk").toInt();
+    if (values.contains("covariance"))
+        settings.covariance = (CovarianceType)values.value("covariance").toInt();
+    if (values.contains("color_space"))
+        settings.colorSpace = (ColorSpace)values.value("color_space").toInt();
+    if (values.contains("shadows"))
+        settings.suppressShadows = values.value("shadows").toInt() != 0;
+    if (values.contains("edges"))
+        settings.useEdges = values.value("edges").toInt() != 0;
+    if (values.contains("edge_threshold"))
+        settings.edgeThreshold = values.value("edge_threshold").toInt();
+    if (values.contains("pyramid_scale"))
+        settings.pyramidScale = qMax(1, values.value("pyramid_scale").toInt());
+    if (values.contains("tile_threshold"))
+        settings.tileThreshold = values.value("tile_threshold").toInt();
+    if (values.contains("hysteresis_k"))
+        settings.hysteresisK = values.value("hysteresis_k").toFloat();
+    if (values.contains("vote_frames"))
+        settings.voteFrames = qMax(1, values.value("vote_frames").toInt());
+    if (values.contains("reconstruct"))
+        settings.reconstruct = values.value("reconstruct").toInt() != 0;
+    if (values.contains("fill_holes"))
+        settings.fillHoles = values.value("fill_holes").toInt() != 0;
+    if (values.contains("distance_depth"))
+        settings.distanceDepth = values.value("distance_depth").toInt();
+    if (values.contains("rho") && values.value("rho").toDouble() != rho)
+        qWarning() << "settings recorded with rho" << values.value("rho") << ", this build uses" << rho;
+}
+
+bool Session::loadSettings(const QString &fileName, RecognizerSettings &settings, QString &error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = "cannot open " + fileName;
+        return false;
+    }
+
+    QTextStream stream(&file);
+    QMap<QString, QString> values = readValues(stream);
+    foreach (const QString& key, values.keys())
+        if (!isKey(settingKeys, key) && !isKey(sessionKeys, key))
+        {
+            error = QString("unknown setting %1 in %2").arg(key).arg(fileName);
+            return false;
+        }
+
+    readSettings(values, settings);
+    return true;
+}
+
+int runReplay(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    QString sessionName, foldedName;
+    int repeats = 1;
+    for (int i = 1; i + 1 < arguments.size(); i++)
+    {
+        if (arguments.at(i) == "--replay")
+            sessionName = arguments.at(++i);
+        else if (arguments.at(i) == "--repeat")
+            repeats = arguments.at(++i).toInt();
+        else if (arguments.at(i) == "--folded")
+            foldedName = arguments.at(++i);
+    }
+    if (sessionName.isEmpty() || repeats < 1)
+    {
+        fprintf(stderr, "usage: pathAnalyzer --replay session [--repeat N] [--folded stacks.txt]\n");
+        return 2;
+    }
+
+    Session session;
+    QString error;
+    if (!session.load(sessionName, error))
+    {
+        fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 2;
+    }
+
+    // Обучение, как при записи: один поток, те же кадры и параметры
+    Recognizer recognizer;
+    recognizer.settings = session.settings;
+    FrameSource source;
+    source.setGrayscale(session.gray);
+    if (!source.open(session.input) || !learnSequence(source, session.input, session.learnFirst, session.learnLast,
+                                                      recognizer, error))
+    {
+        fprintf(stderr, "%s: %s\n", session.input.toLocal8Bit().constData(),
+                error.isEmpty() ? "cannot open input" : error.toLocal8Bit().constData());
+        return 2;
+    }
+    if (recognizer.width() != session.width || recognizer.height() != session.height)
+    {
+        fprintf(stderr, "frame size differs from the recorded one\n");
+        return 2;
+    }
+
+    // Время этапов копится по всем повторам, маски сверяются в каждом
+    StageProfile profile;
+    int mismatches = 0, firstMismatch = -1;
+    QImage frame;
+    // Маска с картой расстояний строится по ней, как при записи
+    DistanceMap map;
+    bool withMap = session.settings.distanceDepth != 0;
+    for (int repeat = 0; repeat < repeats; repeat++)
+    {
+        if (repeat > 0 && !source.open(session.input))
+        {
+            fprintf(stderr, "cannot open %s\n", session.input.toLocal8Bit().constData());
+            return 2;
+        }
+        if (source.skip(session.firstFrame) != session.firstFrame)
+        {
+            fprintf(stderr, "input is shorter than the recorded session\n");
+            return 2;
+        }
+
+        recognizer.begin(session.width, session.height, session.maskHashes.size());
+        QImage* mask = recognizer.pool().acquire(QImage::Format_Indexed8, Recognizer::maskColorTable());
+        int frames = 0;
+        while (frames < session.maskHashes.size() && source.readFrame(frame)
+               && frame.width() == session.width && frame.height() == session.height)
+        {
+            recognizer.classifyFrame(frame, mask, withMap ? &map : 0);
+            recognizer.track(session.firstFrame + frames, *mask);
+            if (Session::maskHash(*mask) != session.maskHashes.at(frames))
+            {
+                if (firstMismatch < 0)
+                    firstMismatch = session.firstFrame + frames;
+                mismatches++;
+            }
+            frames++;
+        }
+        recognizer.pool().release(mask);
+        if (frames < session.maskHashes.size())
+        {
+            fprintf(stderr, "only %d of %d recorded frames replayed\n", frames, session.maskHashes.size());
+            return 2;
+        }
+        profile.append(recognizer.profile());
+    }
+
+    printf("%s", profile.summary(&session.profile).toLocal8Bit().constData());
+    if (mismatches)
+        printf("%d masks differ from the recorded ones, first at frame %d\n", mismatches, firstMismatch);
+    else
+        printf("all %d masks match the recording\n", session.maskHashes.size() * repeats);
+
+    if (!foldedName.isEmpty() && !profile.writeFolded(foldedName))
+    {
+        fprintf(stderr, "cannot write %s\n", foldedName.toLocal8Bit().constData());
+        return 2;
+    }
+    return mismatches ? 1 : 0;
+}
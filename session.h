@@ -0,0 +1,61 @@
+#ifndef SESSION_H
+#define SESSION_H
+// Записанный сеанс распознавания для воспроизводимого замера: вход, кадры обучения,
+// параметры, хеш маски и время этапов каждого кадра. Повтор заново обучает модель и
+// распознает те же кадры без окна, сверяет маски и сравнивает время этапов с записанным.
+// Сеанс пишет пакетный режим (--record) и окно (кнопка "Сеанс" после распознавания, вход -
+// список открытых файлов, framesource.h). Файл текстовый и прикладывается к отчету об ошибке:
+//   ключ=значение    - по строке: вход, кадры, параметры распознавания
+//   frames           - дальше таблица CSV: кадр, хеш маски, время этапов, нс (profile.h)
+// Повтор под perf: perf record -g pathAnalyzer --replay сеанс; без perf итог дает
+// встроенный замер этапов, --folded пишет его свернутыми стеками для flamegraph.pl
+
+#include <QImage>
+#include <QMap>
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+
+#include "profile.h"
+#include "recognizer.h"
+
+#define SessionVersion 3
+
+class Session
+{
+public:
+    Session();
+
+    QString input;
+    int learnFirst, learnLast;
+    // Первый распознанный кадр и размер кадра
+    int firstFrame;
+    int width, height;
+    // Кадры переведены в яркость (серый режим окна)
+    bool gray;
+    RecognizerSettings settings;
+    // По распознанным кадрам, начиная с firstFrame
+    QVector<quint64> maskHashes;
+    StageProfile profile;
+
+    // Целиком через QSaveFile, прежний сеанс заменяется
+    bool save(const QString& fileName) const;
+    bool load(const QString& fileName, QString& error);
+
+    // Хеш значимой части строк маски (без выравнивания строк)
+    static quint64 maskHash(const QImage& mask);
+
+    // Параметры распознавания - строки ключ=значение, те же в сеансе и в файле параметров
+    // пакетного режима (--settings). Ключей, которых нет в values, readSettings не меняет
+    static void writeSettings(QTextStream& stream, const RecognizerSettings& settings);
+    static void readSettings(const QMap<QString, QString>& values, RecognizerSettings& settings);
+    // Файл параметров: ключи параметров (или целый сеанс), # - комментарий. Неизвестный ключ - ошибка
+    static bool loadSettings(const QString& fileName, RecognizerSettings& settings, QString& error);
+};
+
+// Повтор из командной строки:
+//   pathAnalyzer --replay сеанс [--repeat N] [--folded стеки.txt]
+// Код возврата 0 - маски совпали с записанными, 1 - не совпали, 2 - ошибка входа
+int runReplay(int argc, char* argv[]);
+
+#endif // SESSION_H
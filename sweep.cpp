@@ -0,0 +1,220 @@
+#include <cstring>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include "sweep.h"
+#include "morphology.h"
+
+double SweepResult::precision() const
+{
+    qint64 detected = truePositives + falsePositives;
+    return detected ? (double)truePositives / detected : 0;
+}
+
+double SweepResult::recall() const
+{
+    qint64 actual = truePositives + falseNegatives;
+    return actual ? (double)truePositives / actual : 0;
+}
+
+double SweepResult::f1() const
+{
+    double p = precision(), r = recall();
+    return (p + r > 0) ? 2 * p * r / (p + r) : 0;
+}
+
+ParameterSweep::ParameterSweep() :
+    model(0), originalSigmamin(0), originalK(0), sigmaIndex(0), frameIndex(0)
+{
+    sigmamins << 2.5f << 5 << 10 << 20;
+    ks << 2 << 2.5f << 3 << 3.5f << 4;
+    radii << 2 << 3 << 4 << 6;
+}
+
+ParameterSweep::~ParameterSweep()
+{
+    clearDisks();
+}
+
+void ParameterSweep::clearDisks()
+{
+    qDeleteAll(blackDisks);
+    qDeleteAll(whiteDisks);
+    blackDisks.clear();
+    whiteDisks.clear();
+}
+
+void ParameterSweep::start(BackgroundModel *model_, const QList<QImage*> &frames_, const QList<QImage> &truths_)
+{
+    model = model_;
+    originalSigmamin = model->sigmaMin();
+    originalK = model->thresholdK();
+    frames = frames_;
+    sigmaIndex = frameIndex = 0;
+
+    // Разметка приводится к маске 0/1
+    truths.clear();
+    for (int i = 0; i < truths_.size(); i++)
+    {
+        const QImage& source = truths_.at(i);
+        QImage truth(source.width(), source.height(), QImage::Format_Indexed8);
+        for (int y = 0; y < source.height(); y++)
+        {
+            uchar* pixel = truth.scanLine(y);
+            for (int x = 0; x < source.width(); x++)
+                pixel[x] = qGray(source.pixel(x, y)) > 127;
+        }
+        truths << truth;
+    }
+
+    clearDisks();
+    for (int r = 0; r < radii.size(); r++)
+    {
+        blackDisks << disk(radii.at(r), 0xFF000000);
+        whiteDisks << disk(radii.at(r), 0xFFFFFFFF);
+    }
+
+    QVector<QRgb> colorTable;
+    colorTable << 0xFF000000 << 0xFFFFFFFF;
+    thresholded = QImage(model->width(), model->height(), QImage::Format_Indexed8);
+    thresholded.setColorTable(colorTable);
+    opened  = thresholded.copy();
+    scratch = thresholded.copy();
+
+    sweepResults.clear();
+    for (int s = 0; s < sigmamins.size(); s++)
+        for (int ki = 0; ki < ks.size(); ki++)
+            for (int r = 0; r < radii.size(); r++)
+            {
+                SweepResult result;
+                memset(&result, 0, sizeof(result));
+                result.sigmamin = sigmamins.at(s);
+                result.kValue = ks.at(ki);
+                result.radius = radii.at(r);
+                sweepResults << result;
+            }
+}
+
+int ParameterSweep::stepCount() const
+{
+    return sigmamins.size() * qMin(frames.size(), truths.size());
+}
+
+bool ParameterSweep::step()
+{
+    int frameCount = qMin(frames.size(), truths.size());
+    if (sigmaIndex >= sigmamins.size() || frameCount == 0)
+        return false;
+
+    // Модель заново завершается по сохраненным суммам обучения
+    if (frameIndex == 0)
+    {
+        model->setSigmaMin(sigmamins.at(sigmaIndex));
+        model->finalize();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    model->distances(*frames.at(frameIndex), distanceMap);
+    qint64 distanceTime = timer.nsecsElapsed();
+
+    const QImage& truth = truths.at(frameIndex);
+    int width = model->width(), height = model->height();
+    int first = sigmaIndex * ks.size() * radii.size();
+
+    for (int ki = 0; ki < ks.size(); ki++)
+    {
+        timer.restart();
+        float kValue = ks.at(ki);
+        float threshold = (kValue * kValue * kValue) * (kValue * kValue * kValue);
+        for (int y = 0, i = 0; y < height; y++)
+        {
+            uchar* pixel = thresholded.scanLine(y);
+            for (int x = 0; x < width; x++, i++)
+                pixel[x] = distanceMap.at(i) >= threshold;
+        }
+        qint64 thresholdTime = timer.nsecsElapsed();
+
+        for (int r = 0; r < radii.size(); r++)
+        {
+            timer.restart();
+            memcpy(opened.bits(), thresholded.constBits(), thresholded.byteCount());
+            dilation(&opened, *blackDisks.at(r), 0xFF000000, 0xFFFFFFFF, &scratch);
+            dilation(&opened, *whiteDisks.at(r), 0xFFFFFFFF, 0xFF000000, &scratch);
+            qint64 openingTime = timer.nsecsElapsed();
+
+            SweepResult& result = sweepResults[first + ki * radii.size() + r];
+            for (int y = 0; y < height; y++)
+            {
+                const uchar* detected = opened.constScanLine(y);
+                const uchar* actual = truth.constScanLine(y);
+                for (int x = 0; x < width; x++)
+                {
+                    result.truePositives  += detected[x] & actual[x];
+                    result.falsePositives += detected[x] & (actual[x] ^ 1);
+                    result.falseNegatives += (detected[x] ^ 1) & actual[x];
+                }
+            }
+            result.distanceTime += distanceTime;
+            result.stageTime += thresholdTime + openingTime;
+            result.frames++;
+        }
+    }
+
+    if (++frameIndex >= frameCount)
+    {
+        frameIndex = 0;
+        sigmaIndex++;
+    }
+    return true;
+}
+
+void ParameterSweep::finish()
+{
+    if (!model)
+        return;
+
+    model->setSigmaMin(originalSigmamin);
+    model->setThresholdK(originalK);
+    model->finalize();
+    model = 0;
+    frames.clear();
+    truths.clear();
+    clearDisks();
+}
+
+bool ParameterSweep::saveCsv(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "sigmamin,k,radius,precision,recall,f1,distance_ms,stage_ms,frames\n";
+    foreach (const SweepResult& result, sweepResults)
+    {
+        if (result.frames == 0)
+            continue;
+        stream << result.sigmamin << ',' << result.kValue << ',' << result.radius << ','
+               << QString::number(result.precision(), 'f', 4) << ','
+               << QString::number(result.recall(), 'f', 4) << ','
+               << QString::number(result.f1(), 'f', 4) << ','
+               << QString::number(result.distanceTime / 1e6 / result.frames, 'f', 3) << ','
+               << QString::number(result.stageTime / 1e6 / result.frames, 'f', 3) << ','
+               << result.frames << '\n';
+    }
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+const SweepResult* ParameterSweep::best() const
+{
+    const SweepResult* best = 0;
+    foreach (const SweepResult& result, sweepResults)
+        if (result.frames > 0 && (!best || result.f1() > best->f1()))
+            best = &result;
+    return best;
+}
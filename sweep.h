@@ -0,0 +1,75 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+// Подбор параметров по размеченной последовательности: сетка sigmamin x k x радиус диска.
+// Расстояния Махаланобиса кадра считаются один раз на sigmamin, порог и размыкание -
+// для каждой пары k и радиуса по готовой карте расстояний.
+// Оценивается полная классификация: расстояния (с подавлением теней, если оно включено у
+// модели), порог и размыкание. Пирамида и пропуск блоков - ее приближения; уточнение по краям,
+// гистерезис, голосование, восстановление и заливку дыр подбор не повторяет.
+
+#include <QImage>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "backgroundmodel.h"
+
+struct SweepResult
+{
+    float sigmamin;
+    float kValue;
+    int radius;
+
+    qint64 truePositives, falsePositives, falseNegatives;
+    // Время на кадр, нс: карта расстояний (общая для всех k и радиусов этого sigmamin)
+    // и порог с размыканием
+    qint64 distanceTime, stageTime;
+    int frames;
+
+    double precision() const;
+    double recall() const;
+    double f1() const;
+};
+
+class ParameterSweep
+{
+public:
+    ParameterSweep();
+    ~ParameterSweep();
+
+    // Сетка; по умолчанию sigmamin 2.5..20, k 2..4, радиус 2..6
+    QVector<float> sigmamins;
+    QVector<float> ks;
+    QVector<int> radii;
+
+    // model должна быть обучена; ее sigmamin и k восстанавливаются в finish().
+    // Кадры - того же вида, что модель (acceptsFrame). truths - разметка кадров, объект - светлые точки
+    void start(BackgroundModel* model, const QList<QImage*>& frames, const QList<QImage>& truths);
+    int stepCount() const;
+    // Один кадр при одном sigmamin; false - сетка пройдена
+    bool step();
+    void finish();
+
+    const QList<SweepResult>& results() const { return sweepResults; }
+    bool saveCsv(const QString& fileName) const;
+    // Лучшая по F1 конфигурация, 0 - ни один кадр не посчитан
+    const SweepResult* best() const;
+
+private:
+    Q_DISABLE_COPY(ParameterSweep)
+
+    void clearDisks();
+
+    BackgroundModel* model;
+    float originalSigmamin, originalK;
+    QList<QImage*> frames;
+    QList<QImage> truths;
+    int sigmaIndex, frameIndex;
+
+    QList<SweepResult> sweepResults;
+    QList<QImage*> blackDisks, whiteDisks;
+    QVector<float> distanceMap;
+    QImage thresholded, opened, scratch;
+};
+
+#endif // SWEEP_H
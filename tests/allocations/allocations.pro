@@ -0,0 +1,10 @@
+TARGET = tst_allocations
+include(../tests.pri)
+
+# Счетчик operator new FramePool::heapAllocations(), как у CONFIG+=countalloc приложения
+DEFINES += COUNT_ALLOCATIONS
+# С glibc считаются и malloc/calloc/realloc, в том числе внутри Qt (countmalloc.h)
+linux*: DEFINES += COUNT_MALLOC
+
+SOURCES += tst_allocations.cpp countmalloc.cpp
+HEADERS += countmalloc.h
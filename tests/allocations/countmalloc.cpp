@@ -0,0 +1,62 @@
+#include "countmalloc.h"
+
+#ifdef COUNT_MALLOC
+#include <cerrno>
+#include <cstddef>
+
+// Исходные функции glibc
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+// __thread, а не thread_local: счетчик нужен до конструкторов и не должен сам выделять память
+static __thread qint64 mallocCounter = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    mallocCounter++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    mallocCounter++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+    mallocCounter++;
+    return __libc_realloc(p, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+    mallocCounter++;
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** p, size_t alignment, size_t size)
+{
+    mallocCounter++;
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    mallocCounter++;
+    return __libc_memalign(alignment, size);
+}
+
+qint64 mallocCalls()
+{
+    return mallocCounter;
+}
+#else
+qint64 mallocCalls()
+{
+    return -1;
+}
+#endif
@@ -0,0 +1,12 @@
+#ifndef COUNTMALLOC_H
+#define COUNTMALLOC_H
+// Счетчик malloc, calloc, realloc и выделений с выравниванием в текущем потоке. Функции glibc подменяются в самом
+// тесте, поэтому считаются и выделения внутри Qt (QArrayData, QListData, буферы QImage),
+// которые идут мимо operator new.
+
+#include <QtGlobal>
+
+// Вызовов с начала работы потока; -1 - подмена не собрана (не glibc)
+qint64 mallocCalls();
+
+#endif // COUNTMALLOC_H
@@ -0,0 +1,106 @@
+// Кадр без выделений памяти: после первых кадров, заполняющих пул, Recognizer::classifyFrame()
+// и track() не должны обращаться к куче. Считаются malloc и прочие (countmalloc.h), без glibc -
+// только operator new (FramePool::heapAllocations(), COUNT_ALLOCATIONS в allocations.pro).
+// Профиль и траектории резервируются в begin() по числу кадров, буферы областей - на
+// худший случай и TrackReserveBlobs (в сценах теста меньше областей).
+
+#include <QtTest>
+
+#include "countmalloc.h"
+#include "framepool.h"
+#include "recognizer.h"
+#include "synthetic.h"
+
+// Кадры прогрева: пул, буферы фильтров и опорные блоки заполняются на них
+#define AllocationWarmupFrames 3
+
+class AllocationsTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void frame_data();
+    void frame();
+
+private:
+    static qint64 heapAllocations();
+};
+
+qint64 AllocationsTest::heapAllocations()
+{
+    qint64 calls = mallocCalls();
+    return calls >= 0 ? calls : FramePool::heapAllocations();
+}
+
+void AllocationsTest::initTestCase()
+{
+    if (heapAllocations() < 0)
+        QSKIP("built without COUNT_MALLOC and COUNT_ALLOCATIONS");
+}
+
+void AllocationsTest::frame_data()
+{
+    QTest::addColumn<bool>("gray");
+    QTest::addColumn<int>("pyramidScale");
+    QTest::addColumn<int>("tileThreshold");
+    QTest::addColumn<float>("hysteresisK");
+    QTest::addColumn<int>("voteFrames");
+    QTest::addColumn<bool>("useEdges");
+
+    QTest::newRow("default") << false << 1 << 0 << 0.f << 1 << false;
+    QTest::newRow("gray") << true << 1 << 0 << 0.f << 1 << false;
+    QTest::newRow("pyramid") << false << 2 << 0 << 0.f << 1 << false;
+    QTest::newRow("tiles") << false << 1 << 8 << 0.f << 1 << false;
+    QTest::newRow("hysteresis") << false << 1 << 0 << 2.f << 1 << false;
+    QTest::newRow("vote and edges") << false << 1 << 0 << 0.f << 3 << true;
+}
+
+void AllocationsTest::frame()
+{
+    QFETCH(bool, gray);
+    QFETCH(int, pyramidScale);
+    QFETCH(int, tileThreshold);
+    QFETCH(float, hysteresisK);
+    QFETCH(int, voteFrames);
+    QFETCH(bool, useEdges);
+
+    SyntheticScene scene = SyntheticScene::corpus().first();
+    scene.gray = gray;
+
+    Recognizer recognizer;
+    recognizer.settings.pyramidScale = pyramidScale;
+    recognizer.settings.tileThreshold = tileThreshold;
+    recognizer.settings.hysteresisK = hysteresisK;
+    recognizer.settings.voteFrames = voteFrames;
+    recognizer.settings.useEdges = useEdges;
+
+    QImage frame;
+    for (int i = 0; i < scene.learnFrames; i++)
+    {
+        scene.learningFrame(i, frame);
+        if (i == 0)
+            recognizer.beginLearning(frame);
+        recognizer.learnFrame(frame);
+    }
+    recognizer.endLearning();
+
+    recognizer.begin(scene.width, scene.height, scene.frames);
+    QImage* mask = recognizer.pool().acquire(QImage::Format_Indexed8, Recognizer::maskColorTable());
+    for (int i = 0; i < scene.frames; i++)
+    {
+        // Кадр готовится до замера: синтетическая сцена сама выделяет память
+        scene.frame(i, frame);
+        qint64 before = heapAllocations();
+        recognizer.classifyFrame(frame, mask);
+        recognizer.track(i, *mask);
+        qint64 allocations = heapAllocations() - before;
+        if (i >= AllocationWarmupFrames)
+            QVERIFY2(allocations == 0, qPrintable(QString("frame %1: %2 heap allocations").arg(i).arg(allocations)));
+    }
+    recognizer.pool().release(mask);
+}
+
+QTEST_APPLESS_MAIN(AllocationsTest)
+
+#include "tst_allocations.moc"
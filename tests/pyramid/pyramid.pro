@@ -0,0 +1,4 @@
+TARGET = tst_pyramid
+include(../tests.pri)
+
+SOURCES += tst_pyramid.cpp
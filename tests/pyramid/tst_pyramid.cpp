@@ -0,0 +1,103 @@
+// Пирамида против полной классификации: маска по кандидатам уменьшенного кадра должна
+// совпадать с маской полного разрешения. Стороны кадра не делятся на масштаб, диски идут
+// вдоль правого и нижнего краев - в точки, не попадающие в целые прямоугольники уменьшения.
+
+#include <QtTest>
+
+#include "pyramid.h"
+#include "recognizer.h"
+#include "synthetic.h"
+
+// Наименьшее отношение пересечения к объединению на кадре: маски пирамиды к маске
+// полного разрешения и маски полного разрешения к истинным дискам
+#define PyramidMinIoU 0.98
+#define PyramidTruthMinIoU 0.95
+
+class PyramidTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void edges_data();
+    void edges();
+
+private:
+    static void learn(Recognizer& recognizer, const SyntheticScene& scene);
+};
+
+void PyramidTest::learn(Recognizer &recognizer, const SyntheticScene &scene)
+{
+    QImage frame;
+    for (int i = 0; i < scene.learnFrames; i++)
+    {
+        scene.learningFrame(i, frame);
+        if (i == 0)
+            recognizer.beginLearning(frame);
+        recognizer.learnFrame(frame);
+    }
+    recognizer.endLearning();
+    recognizer.begin(scene.width, scene.height);
+}
+
+void PyramidTest::edges_data()
+{
+    QTest::addColumn<int>("scale");
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    QTest::addColumn<bool>("gray");
+
+    QTest::newRow("1:2") << 2 << 321 << 241 << false;
+    QTest::newRow("1:4") << 4 << 323 << 242 << false;
+    QTest::newRow("1:8") << 8 << 327 << 247 << false;
+    QTest::newRow("1:4 gray") << 4 << 323 << 243 << true;
+}
+
+void PyramidTest::edges()
+{
+    QFETCH(int, scale);
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QFETCH(bool, gray);
+
+    SyntheticScene scene;
+    scene.name = "edges";
+    scene.width = width;
+    scene.height = height;
+    scene.learnFrames = 30;
+    scene.frames = 40;
+    scene.noise = 3;
+    scene.gray = gray;
+    scene.seed = 5;
+    // Вдоль правого края вниз и вдоль нижнего края вправо, частично за кадром
+    SyntheticScene::Disc right = { width - 4.f, 20, 0, 4.5f, 9, qRgb(250, 250, 250) };
+    SyntheticScene::Disc bottom = { 20, height - 3.f, 7, 0, 8, qRgb(250, 250, 250) };
+    scene.discs << right << bottom;
+
+    Recognizer full, pyramid;
+    pyramid.settings.pyramidScale = scale;
+    learn(full, scene);
+    learn(pyramid, scene);
+
+    QImage frame, truth;
+    QImage fullMask(width, height, QImage::Format_Indexed8), pyramidMask(width, height, QImage::Format_Indexed8);
+    fullMask.setColorTable(Recognizer::maskColorTable());
+    pyramidMask.setColorTable(Recognizer::maskColorTable());
+    for (int i = 0; i < scene.frames; i++)
+    {
+        scene.frame(i, frame, &truth);
+        full.classifyFrame(frame, &fullMask);
+        pyramid.classifyFrame(frame, &pyramidMask);
+
+        QVERIFY2(maskIoU(fullMask, truth) >= PyramidTruthMinIoU,
+                 qPrintable(QString("frame %1: full classification IoU with true discs %2")
+                            .arg(i).arg(maskIoU(fullMask, truth))));
+        MaskComparison difference = compareMasks(pyramidMask, fullMask);
+        QVERIFY2(difference.iou >= PyramidMinIoU,
+                 qPrintable(QString("frame %1: pyramid IoU %2, box error %3 px")
+                            .arg(i).arg(difference.iou).arg(difference.boxError)));
+    }
+}
+
+QTEST_APPLESS_MAIN(PyramidTest)
+
+#include "tst_pyramid.moc"
@@ -0,0 +1,10 @@
+TARGET = tst_regression
+include(../tests.pri)
+
+# Эталон и база времени лежат рядом с тестом
+DEFINES += GOLDEN_DIR=\\\"$$PWD/golden\\\"
+
+# Маски эталона сжаты, как в архиве масок
+SOURCES += tst_regression.cpp \
+    $$ROOT/maskarchive.cpp
+HEADERS += $$ROOT/maskarchive.h
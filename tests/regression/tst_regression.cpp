@@ -0,0 +1,527 @@
+// Регрессионная проверка на синтетических последовательностях (synthetic.h). Маски, число
+// связных областей, прямоугольники и траектории сверяются с эталоном в golden/, время
+// этапов - с базой golden/timings.txt. Время в базе и при проверке - в долях опорного прохода,
+// замеренного в том же запуске (measureCalibration), поэтому база годится для любой машины.
+//   tst_regression [аргументы QTest]             - проверка
+//   tst_regression --record [аргументы QTest]    - записать эталон и базу заново
+// Эталон и база записываются после намеренного изменения результата или скорости.
+// --golden каталог - эталон не из golden/ рядом с тестом.
+
+#include <cmath>
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+#include <QtTest>
+
+#include "components.h"
+#include "maskarchive.h"
+#include "maskfilter.h"
+#include "morphology.h"
+#include "recognizer.h"
+#include "trackstore.h"
+#include "synthetic.h"
+
+// Доля точек кадра, в которых маска может отличаться от эталонной
+#define RegressionMaskTolerance 0.002
+// Сдвиг сторон прямоугольников областей и точек траекторий от эталона, точки
+#define RegressionBoxTolerance 2
+#define RegressionTrackTolerance 1.0
+// Маска против истинных дисков: наименьшее отношение пересечения к объединению
+#define RegressionMinIoU 0.95
+// Этап медленнее базы больше чем во столько раз (плюс RegressionTimeSlack мс на шум таймера,
+// в долях опорного прохода) - ошибка
+#define RegressionTimeFactor 1.5
+#define RegressionTimeSlack 0.05
+// Повторов замера этапа, берется наименьшее время
+#define RegressionTimeRuns 7
+
+// "PGLD"
+static const quint32 GoldenFileMagic = 0x444C4750;
+static const quint32 GoldenFileVersion = 2;
+
+class RegressionTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    RegressionTest(const QString& goldenDir, bool record);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void masks_data();
+    void masks();
+    void components_data();
+    void components();
+    void trajectories_data();
+    void trajectories();
+    void timings_data();
+    void timings();
+
+private:
+    // Результат последовательности: маски, прямоугольники областей и число областей
+    // selectComponents по кадрам, траектории
+    struct SceneResult
+    {
+        QList<QImage> masks;
+        QList<QVector<QRect> > boxes;
+        QVector<int> componentCounts;
+        TrackStore tracks;
+        double iouMin;
+    };
+
+    static void runScene(const SyntheticScene& scene, SceneResult& result);
+    static double measureStage(const QString& stage);
+    static double measureCalibration();
+    static void addSceneRows();
+
+    bool saveGolden(const QString& name, const SceneResult& result) const;
+    bool loadGolden(const QString& name, SceneResult& golden) const;
+
+    QString goldenDir;
+    bool record;
+    QMap<QString, SceneResult> results;
+    // Время опорного прохода этого запуска, мс
+    double calibration;
+    // Время этапов в долях опорного прохода: замеренное и база
+    QMap<QString, double> stageTimes;
+    QMap<QString, double> baseline;
+};
+
+RegressionTest::RegressionTest(const QString &goldenDir_, bool record_) :
+    goldenDir(goldenDir_), record(record_), calibration(0)
+{
+}
+
+void RegressionTest::runScene(const SyntheticScene &scene, RegressionTest::SceneResult &result)
+{
+    Recognizer recognizer;
+    QImage frame, truth;
+    for (int i = 0; i < scene.learnFrames; i++)
+    {
+        scene.learningFrame(i, frame);
+        if (i == 0)
+            recognizer.beginLearning(frame);
+        recognizer.learnFrame(frame);
+    }
+    recognizer.endLearning();
+
+    recognizer.begin(scene.width, scene.height);
+    QImage* mask = recognizer.pool().acquire(QImage::Format_Indexed8, Recognizer::maskColorTable());
+    QVector<Blob> blobs;
+    QVector<int> labels, parents;
+    QImage bitmap, componentsMap;
+    result.iouMin = 1;
+
+    for (int i = 0; i < scene.frames; i++)
+    {
+        scene.frame(i, frame, &truth);
+        recognizer.classifyFrame(frame, mask);
+        recognizer.track(i, *mask);
+        result.masks << mask->copy();
+
+        findBlobs(*mask, blobs, labels, parents, TrackMinArea);
+        QVector<QRect> boxes;
+        foreach (const Blob& blob, blobs)
+            boxes << blob.box;
+        result.boxes << boxes;
+
+        int colorNumber = 0;
+        selectComponents(mask, colorNumber, bitmap, componentsMap);
+        result.componentCounts << colorNumber;
+
+        result.iouMin = qMin(result.iouMin, maskIoU(*mask, truth));
+    }
+
+    recognizer.pool().release(mask);
+    result.tracks = recognizer.tracks();
+}
+
+bool RegressionTest::saveGolden(const QString &name, const RegressionTest::SceneResult &result) const
+{
+    QDir dir(goldenDir);
+    if (!result.tracks.exportBinary(dir.filePath(name + ".tracks")))
+        return false;
+
+    QFile file(dir.filePath(name + ".masks"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    // Маски сжаты, как в архиве масок (encodeMask), за каждой - число областей и прямоугольники
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    const QImage& first = result.masks.first();
+    int width = first.width(), height = first.height(), words = (width + 63) / 64;
+    stream << GoldenFileMagic << GoldenFileVersion << (qint32)width << (qint32)height << (qint32)result.masks.size();
+
+    QVector<quint64> bits(words * height);
+    QByteArray encoded, raw;
+    QVector<int> transitions;
+    for (int f = 0; f < result.masks.size(); f++)
+    {
+        const QImage& mask = result.masks.at(f);
+        for (int y = 0; y < height; y++)
+            packMaskRow(mask.constScanLine(y), width, bits.data() + y * words);
+        encodeMask(bits.constData(), width, height, encoded, raw, transitions);
+        stream << encoded;
+
+        stream << (qint32)result.componentCounts.at(f) << (qint32)result.boxes.at(f).size();
+        foreach (const QRect& box, result.boxes.at(f))
+            stream << (qint16)box.left() << (qint16)box.top() << (qint16)box.right() << (qint16)box.bottom();
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool RegressionTest::loadGolden(const QString &name, RegressionTest::SceneResult &golden) const
+{
+    QDir dir(goldenDir);
+    if (!golden.tracks.importBinary(dir.filePath(name + ".tracks")))
+        return false;
+
+    QFile file(dir.filePath(name + ".masks"));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic, version;
+    qint32 width, height, count;
+    stream >> magic >> version >> width >> height >> count;
+    if (stream.status() != QDataStream::Ok || magic != GoldenFileMagic || version != GoldenFileVersion
+            || width <= 0 || height <= 0 || count < 0)
+        return false;
+
+    QByteArray encoded;
+    for (int f = 0; f < count && stream.status() == QDataStream::Ok; f++)
+    {
+        QImage mask(width, height, QImage::Format_Indexed8);
+        mask.setColorTable(Recognizer::maskColorTable());
+        stream >> encoded;
+        if (!decodeMask(encoded, width, height, mask))
+            return false;
+        golden.masks << mask;
+
+        qint32 components, boxCount;
+        stream >> components >> boxCount;
+        golden.componentCounts << components;
+        QVector<QRect> boxes;
+        for (int b = 0; b < boxCount && stream.status() == QDataStream::Ok; b++)
+        {
+            qint16 left, top, right, bottom;
+            stream >> left >> top >> right >> bottom;
+            QRect box;
+            box.setCoords(left, top, right, bottom);
+            boxes << box;
+        }
+        golden.boxes << boxes;
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+double RegressionTest::measureStage(const QString &stage)
+{
+    SyntheticScene scene = SyntheticScene::timingScene();
+    Recognizer recognizer;
+    QImage frame;
+    for (int i = 0; i < scene.learnFrames; i++)
+    {
+        scene.learningFrame(i, frame);
+        if (i == 0)
+            recognizer.beginLearning(frame);
+        recognizer.learnFrame(frame);
+    }
+    recognizer.endLearning();
+    recognizer.begin(scene.width, scene.height);
+
+    // Входы этапов - кадр из середины последовательности и его маска до размыкания
+    scene.frame(scene.frames / 2, frame);
+    QImage rawMask(scene.width, scene.height, QImage::Format_Indexed8);
+    rawMask.setColorTable(Recognizer::maskColorTable());
+    recognizer.backgroundModel().classify(frame, rawMask);
+
+    QImage mask = rawMask.copy(), scratch = rawMask.copy(), bitmap, componentsMap;
+    QImage* blackDisk = disk(recognizer.settings.openingRadius, 0xFF000000);
+    QImage* whiteDisk = disk(recognizer.settings.openingRadius, 0xFFFFFFFF);
+    QVector<Blob> blobs;
+    QVector<int> labels, parents;
+
+    qint64 best = -1;
+    for (int run = 0; run < RegressionTimeRuns; run++)
+    {
+        memcpy(mask.bits(), rawMask.constBits(), rawMask.byteCount());
+        int colorNumber = 0;
+
+        QElapsedTimer timer;
+        timer.start();
+        if (stage == "classify")
+            recognizer.backgroundModel().classify(frame, mask);
+        else if (stage == "opening")
+        {
+            dilation(&mask, *blackDisk, 0xFF000000, 0xFFFFFFFF, &scratch);
+            dilation(&mask, *whiteDisk, 0xFFFFFFFF, 0xFF000000, &scratch);
+        }
+        else if (stage == "selectComponents")
+            selectComponents(&mask, colorNumber, bitmap, componentsMap);
+        else if (stage == "findBlobs")
+            findBlobs(mask, blobs, labels, parents, TrackMinArea);
+        else if (stage == "frame")
+        {
+            recognizer.classifyFrame(frame, &mask);
+            recognizer.track(run, mask);
+        }
+        qint64 elapsed = timer.nsecsElapsed();
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    delete blackDisk;
+    delete whiteDisk;
+    return best / 1e6;
+}
+
+double RegressionTest::measureCalibration()
+{
+    // Сумма 3x3 по плоскости размера кадра замера: те же чтение памяти и целочисленная
+    // арифметика, что у этапов, без кода программы - ее изменения шкалу не сдвигают
+    SyntheticScene scene = SyntheticScene::timingScene();
+    int width = scene.width, height = scene.height;
+    QVector<uchar> plane(width * height);
+    for (int i = 0; i < plane.size(); i++)
+        plane[i] = (uchar)((i * 2654435761u) >> 24);
+    const uchar* data = plane.constData();
+
+    qint64 best = -1;
+    quint32 checksum = 0;
+    for (int run = 0; run < RegressionTimeRuns; run++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int y = 1; y + 1 < height; y++)
+        {
+            const uchar* above = data + (y - 1) * width;
+            const uchar* line = above + width;
+            const uchar* below = line + width;
+            for (int x = 1; x + 1 < width; x++)
+                checksum += above[x - 1] + above[x] + above[x + 1] + line[x - 1] + line[x] + line[x + 1]
+                          + below[x - 1] + below[x] + below[x + 1];
+        }
+        qint64 elapsed = timer.nsecsElapsed();
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    // Сумма нужна, чтобы проход не выбросил компилятор
+    static volatile quint32 sink;
+    sink = checksum;
+    return best / 1e6;
+}
+
+void RegressionTest::addSceneRows()
+{
+    QTest::addColumn<QString>("scene");
+    foreach (const SyntheticScene& scene, SyntheticScene::corpus())
+        QTest::newRow(scene.name.toLatin1().constData()) << scene.name;
+}
+
+void RegressionTest::initTestCase()
+{
+    calibration = measureCalibration();
+    qDebug() << "calibration" << calibration << "ms";
+
+    foreach (const SyntheticScene& scene, SyntheticScene::corpus())
+        runScene(scene, results[scene.name]);
+
+    if (record)
+    {
+        QVERIFY2(QDir().mkpath(goldenDir), qPrintable("cannot create " + goldenDir));
+        foreach (const QString& name, results.keys())
+            QVERIFY2(saveGolden(name, results[name]), qPrintable("cannot write golden " + name));
+        return;
+    }
+
+    // База времени: строки "этап доля", # - комментарий
+    QFile file(QDir(goldenDir).filePath("timings.txt"));
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QTextStream stream(&file);
+        while (!stream.atEnd())
+        {
+            QString line = stream.readLine().trimmed();
+            QStringList fields = line.split(' ');
+            if (!line.startsWith('#') && fields.size() == 2)
+                baseline[fields.at(0)] = fields.at(1).toDouble();
+        }
+    }
+}
+
+void RegressionTest::cleanupTestCase()
+{
+    if (!record || stageTimes.isEmpty())
+        return;
+
+    QFile file(QDir(goldenDir).filePath("timings.txt"));
+    QVERIFY2(file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text), "cannot write timings.txt");
+    QTextStream stream(&file);
+    stream << "# stage time / calibration pass time; calibration took " << QString::number(calibration, 'f', 4)
+           << " ms when recorded\n";
+    foreach (const QString& stage, stageTimes.keys())
+        stream << stage << ' ' << QString::number(stageTimes.value(stage), 'f', 4) << '\n';
+}
+
+void RegressionTest::masks_data()
+{
+    addSceneRows();
+}
+
+void RegressionTest::masks()
+{
+    QFETCH(QString, scene);
+    const SceneResult& result = results[scene];
+    QVERIFY2(result.iouMin >= RegressionMinIoU, qPrintable(QString("IoU with true discs %1").arg(result.iouMin)));
+
+    SceneResult golden;
+    if (!loadGolden(scene, golden))
+        QFAIL("no golden results, record them with --record");
+    QCOMPARE(result.masks.size(), golden.masks.size());
+
+    for (int f = 0; f < result.masks.size(); f++)
+    {
+        const QImage& mask = result.masks.at(f);
+        const QImage& expected = golden.masks.at(f);
+        QCOMPARE(mask.size(), expected.size());
+
+        int differences = 0;
+        for (int y = 0; y < mask.height(); y++)
+        {
+            const uchar* m = mask.constScanLine(y);
+            const uchar* e = expected.constScanLine(y);
+            for (int x = 0; x < mask.width(); x++)
+                differences += m[x] != e[x];
+        }
+        QVERIFY2(differences <= RegressionMaskTolerance * mask.width() * mask.height(),
+                 qPrintable(QString("frame %1: %2 pixels differ").arg(f).arg(differences)));
+    }
+}
+
+void RegressionTest::components_data()
+{
+    addSceneRows();
+}
+
+void RegressionTest::components()
+{
+    QFETCH(QString, scene);
+    const SceneResult& result = results[scene];
+    SceneResult golden;
+    if (!loadGolden(scene, golden))
+        QFAIL("no golden results, record them with --record");
+    QCOMPARE(result.boxes.size(), golden.boxes.size());
+
+    for (int f = 0; f < result.boxes.size(); f++)
+    {
+        QVERIFY2(result.componentCounts.at(f) == golden.componentCounts.at(f),
+                 qPrintable(QString("frame %1: selectComponents %2, golden %3").arg(f)
+                            .arg(result.componentCounts.at(f)).arg(golden.componentCounts.at(f))));
+
+        const QVector<QRect>& boxes = result.boxes.at(f);
+        const QVector<QRect>& expected = golden.boxes.at(f);
+        QVERIFY2(boxes.size() == expected.size(),
+                 qPrintable(QString("frame %1: %2 blobs, golden %3").arg(f).arg(boxes.size()).arg(expected.size())));
+        for (int b = 0; b < boxes.size(); b++)
+        {
+            const QRect& box = boxes.at(b);
+            const QRect& expectedBox = expected.at(b);
+            int shift = qMax(qMax(qAbs(box.left() - expectedBox.left()), qAbs(box.top() - expectedBox.top())),
+                             qMax(qAbs(box.right() - expectedBox.right()), qAbs(box.bottom() - expectedBox.bottom())));
+            QVERIFY2(shift <= RegressionBoxTolerance,
+                     qPrintable(QString("frame %1, blob %2: box moved by %3").arg(f).arg(b).arg(shift)));
+        }
+    }
+}
+
+void RegressionTest::trajectories_data()
+{
+    addSceneRows();
+}
+
+void RegressionTest::trajectories()
+{
+    QFETCH(QString, scene);
+    const TrackStore& tracks = results[scene].tracks;
+    SceneResult golden;
+    if (!loadGolden(scene, golden))
+        QFAIL("no golden results, record them with --record");
+    QCOMPARE(tracks.size(), golden.tracks.size());
+
+    for (int i = 0; i < tracks.size(); i++)
+    {
+        TrackPoint point = tracks.at(i), expected = golden.tracks.at(i);
+        QVERIFY2(point.frame == expected.frame && point.id == expected.id,
+                 qPrintable(QString("point %1: frame %2 track %3, golden frame %4 track %5").arg(i)
+                            .arg(point.frame).arg(point.id).arg(expected.frame).arg(expected.id)));
+        double error = qMax(std::fabs(point.x - expected.x), std::fabs(point.y - expected.y));
+        QVERIFY2(error <= RegressionTrackTolerance,
+                 qPrintable(QString("frame %1, track %2: moved by %3").arg(point.frame).arg(point.id).arg(error)));
+    }
+}
+
+void RegressionTest::timings_data()
+{
+    QTest::addColumn<QString>("stage");
+    QStringList stages;
+    stages << "classify" << "opening" << "selectComponents" << "findBlobs" << "frame";
+    foreach (const QString& stage, stages)
+        QTest::newRow(stage.toLatin1().constData()) << stage;
+}
+
+void RegressionTest::timings()
+{
+    QFETCH(QString, stage);
+    double time = measureStage(stage);
+    double units = time / calibration;
+    stageTimes[stage] = units;
+    qDebug() << stage.toLatin1().constData() << time << "ms," << units << "calibration passes";
+    if (record)
+        return;
+
+    QVERIFY2(baseline.contains(stage), qPrintable("no baseline for " + stage + ", record it with --record"));
+    double limit = baseline.value(stage) * RegressionTimeFactor + RegressionTimeSlack / calibration;
+    QVERIFY2(units <= limit, qPrintable(QString("%1: %2 ms = %3 calibration passes, baseline %4, limit %5").arg(stage)
+                                        .arg(time).arg(units).arg(baseline.value(stage)).arg(limit)));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    // Свои ключи убираются, остальное - аргументы QTest (-v2, -o файл и т. д.)
+    QString goldenDir = GOLDEN_DIR;
+    bool record = false;
+    QStringList testArguments;
+    testArguments << arguments.first();
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        if (arguments.at(i) == "--record")
+            record = true;
+        else if (arguments.at(i) == "--golden" && i + 1 < arguments.size())
+            goldenDir = arguments.at(++i);
+        else
+            testArguments << arguments.at(i);
+    }
+
+    RegressionTest test(goldenDir, record);
+    return QTest::qExec(&test, testArguments);
+}
+
+#include "tst_regression.moc"
@@ -0,0 +1,158 @@
+#include <cmath>
+
+#include "synthetic.h"
+#include "luminance.h"
+#include "recognizer.h"
+
+// Перемешивание 32 бит: начальное состояние генератора шума кадра
+static inline quint32 mix(quint32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+void SyntheticScene::background(quint32 frameSeed, QImage &frame) const
+{
+    if (frame.width() != width || frame.height() != height || frame.format() != QImage::Format_RGB32)
+        frame = QImage(width, height, QImage::Format_RGB32);
+
+    // Плавный градиент и равномерный шум; генератор - линейный конгруэнтный, по байту на компоненту
+    quint32 state = mix(seed ^ mix(frameSeed));
+    int range = 2 * noise + 1;
+    for (int y = 0; y < height; y++)
+    {
+        QRgb* pixel = (QRgb*)frame.scanLine(y);
+        for (int x = 0; x < width; x++)
+        {
+            state = state * 1664525u + 1013904223u;
+            int r = 60 + 80 * x / width                  + (int)((state >> 24) & 0xFF) % range - noise;
+            int g = 90 + 60 * y / height                 + (int)((state >> 16) & 0xFF) % range - noise;
+            int b = 120 + 40 * (x + y) / (width + height) + (int)((state >> 8) & 0xFF) % range - noise;
+            pixel[x] = qRgb(qBound(0, r, 255), qBound(0, g, 255), qBound(0, b, 255));
+        }
+    }
+}
+
+void SyntheticScene::learningFrame(int index, QImage &frame) const
+{
+    QImage rgb;
+    background(0x80000000u + index, gray ? rgb : frame);
+    if (gray)
+        luminance(rgb, frame);
+}
+
+void SyntheticScene::frame(int index, QImage &frame, QImage *truth) const
+{
+    QImage rgb;
+    QImage& target = gray ? rgb : frame;
+    background(index, target);
+
+    if (truth)
+    {
+        if (truth->width() != width || truth->height() != height || truth->format() != QImage::Format_Indexed8)
+        {
+            *truth = QImage(width, height, QImage::Format_Indexed8);
+            truth->setColorTable(Recognizer::maskColorTable());
+        }
+        truth->fill(0);
+    }
+
+    foreach (const Disc& disc, discs)
+    {
+        float cx = disc.x + disc.vx * index, cy = disc.y + disc.vy * index;
+        int r2 = disc.radius * disc.radius;
+        int y0 = qMax(0, (int)std::floor(cy) - disc.radius), y1 = qMin(height - 1, (int)std::ceil(cy) + disc.radius);
+        int x0 = qMax(0, (int)std::floor(cx) - disc.radius), x1 = qMin(width - 1, (int)std::ceil(cx) + disc.radius);
+        for (int y = y0; y <= y1; y++)
+        {
+            QRgb* pixel = (QRgb*)target.scanLine(y);
+            uchar* truthPixel = truth ? truth->scanLine(y) : 0;
+            for (int x = x0; x <= x1; x++)
+            {
+                float dx = x - cx, dy = y - cy;
+                if (dx * dx + dy * dy > r2)
+                    continue;
+                pixel[x] = disc.color;
+                if (truthPixel)
+                    truthPixel[x] = 1;
+            }
+        }
+    }
+
+    if (gray)
+        luminance(rgb, frame);
+}
+
+QList<SyntheticScene> SyntheticScene::corpus()
+{
+    QList<SyntheticScene> scenes;
+    SyntheticScene scene;
+    scene.width = 320;
+    scene.height = 240;
+    scene.learnFrames = 30;
+    scene.frames = 40;
+    scene.noise = 3;
+    scene.gray = false;
+
+    // Порог - k^3 стандартных отклонений, поэтому контраст дисков с фоном много больше шума
+    SyntheticScene::Disc disc = { 40, 60, 5, 2.5f, 14, qRgb(220, 40, 40) };
+    scene.name = "one_disc";
+    scene.seed = 1;
+    scene.discs << disc;
+    scenes << scene;
+
+    // Диски расходятся после пересечения: номера траекторий не должны перепутаться
+    SyntheticScene::Disc other = { 280, 80, -5.5f, 2, 11, qRgb(20, 230, 30) };
+    scene.name = "two_discs";
+    scene.seed = 2;
+    scene.discs << other;
+    scenes << scene;
+
+    scene.name = "gray";
+    scene.seed = 3;
+    scene.noise = 4;
+    scene.gray = true;
+    scene.discs.clear();
+    SyntheticScene::Disc bright = { 30, 200, 6, -3, 16, qRgb(250, 250, 250) };
+    scene.discs << bright;
+    scenes << scene;
+
+    return scenes;
+}
+
+SyntheticScene SyntheticScene::timingScene()
+{
+    SyntheticScene scene;
+    scene.name = "timing";
+    scene.width = 640;
+    scene.height = 480;
+    scene.learnFrames = 20;
+    scene.frames = 20;
+    scene.noise = 3;
+    scene.gray = false;
+    scene.seed = 4;
+    SyntheticScene::Disc disc = { 100, 100, 8, 6, 30, qRgb(220, 40, 40) };
+    SyntheticScene::Disc other = { 500, 120, -7, 8, 20, qRgb(40, 60, 220) };
+    scene.discs << disc << other;
+    return scene;
+}
+
+double maskIoU(const QImage &mask, const QImage &truth)
+{
+    int intersection = 0, merged = 0;
+    for (int y = 0; y < mask.height(); y++)
+    {
+        const uchar* m = mask.constScanLine(y);
+        const uchar* t = truth.constScanLine(y);
+        for (int x = 0; x < mask.width(); x++)
+        {
+            intersection += m[x] & t[x];
+            merged += m[x] | t[x];
+        }
+    }
+    return merged ? (double)intersection / merged : 1.;
+}
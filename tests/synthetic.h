@@ -0,0 +1,47 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+// Синтетические последовательности тестов: диски с постоянной скоростью на шумном фоне.
+// Кадры полностью определяются параметрами сцены, истинная маска дисков известна.
+
+#include <QImage>
+#include <QList>
+#include <QString>
+
+// Синтетическая последовательность. Кадры полностью определяются параметрами и seed
+struct SyntheticScene
+{
+    struct Disc
+    {
+        float x, y, vx, vy;
+        int radius;
+        QRgb color;
+    };
+
+    // Без пробелов: это и строка данных теста, и имя файлов эталона
+    QString name;
+    int width, height;
+    int learnFrames, frames;
+    // Равномерный шум каждой компоненты, +-noise
+    int noise;
+    // Серые кадры (Indexed8) вместо RGB32
+    bool gray;
+    quint32 seed;
+    QList<Disc> discs;
+
+    // Кадр обучения: только фон
+    void learningFrame(int index, QImage& frame) const;
+    // Кадр последовательности; truth (Indexed8 0/1) - истинные диски
+    void frame(int index, QImage& frame, QImage* truth = 0) const;
+
+    // Последовательности эталона и последовательность для замеров времени
+    static QList<SyntheticScene> corpus();
+    static SyntheticScene timingScene();
+
+private:
+    void background(quint32 frameSeed, QImage& frame) const;
+};
+
+// Доля совпадения масок: пересечение к объединению ненулевых точек, 1 - обе пусты
+double maskIoU(const QImage& mask, const QImage& truth);
+
+#endif // SYNTHETIC_H
@@ -0,0 +1,43 @@
+# Общее для тестов: модули обработки без GUI собираются в каждый тест заново
+QT       += core gui testlib
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+ROOT = $$PWD/..
+INCLUDEPATH += $$ROOT $$PWD
+DEPENDPATH  += $$ROOT $$PWD
+
+SOURCES += $$PWD/synthetic.cpp \
+    $$ROOT/backgroundmodel.cpp \
+    $$ROOT/changedetector.cpp \
+    $$ROOT/components.cpp \
+    $$ROOT/distancemap.cpp \
+    $$ROOT/framepool.cpp \
+    $$ROOT/gradient.cpp \
+    $$ROOT/luminance.cpp \
+    $$ROOT/maskfilter.cpp \
+    $$ROOT/moments.cpp \
+    $$ROOT/morphology.cpp \
+    $$ROOT/profile.cpp \
+    $$ROOT/pyramid.cpp \
+    $$ROOT/recognizer.cpp \
+    $$ROOT/tracker.cpp \
+    $$ROOT/trackstore.cpp
+
+HEADERS += $$PWD/synthetic.h \
+    $$ROOT/backgroundmodel.h \
+    $$ROOT/changedetector.h \
+    $$ROOT/components.h \
+    $$ROOT/distancemap.h \
+    $$ROOT/framepool.h \
+    $$ROOT/gradient.h \
+    $$ROOT/luminance.h \
+    $$ROOT/maskfilter.h \
+    $$ROOT/moments.h \
+    $$ROOT/morphology.h \
+    $$ROOT/profile.h \
+    $$ROOT/pyramid.h \
+    $$ROOT/recognizer.h \
+    $$ROOT/tracker.h \
+    $$ROOT/trackstore.h
@@ -0,0 +1,3 @@
+# Тесты: qmake tests/tests.pro && make && make check
+TEMPLATE = subdirs
+SUBDIRS = regression allocations pyramid
@@ -0,0 +1,130 @@
+#include <QThread>
+
+#include "thumbnails.h"
+#include "luminance.h"
+#include "pyramid.h"
+#include "videostream.h"
+
+// Пачка изображений или одно видео: буферы Downscaler переиспользуются на всех кадрах задачи
+class LoadTask : public QRunnable
+{
+public:
+    LoadTask(ThumbnailLoader* loader_, const QList<QPair<int, QString> >& files_, bool video_, bool gray_,
+             int generation_) :
+        loader(loader_), files(files_), video(video_), gray(gray_), generation(generation_)
+    {
+    }
+
+    void run()
+    {
+        if (video)
+        {
+            readVideo();
+            return;
+        }
+
+        for (int i = 0; i < files.size(); i++)
+        {
+            if (loader->generation.fetchAndAddOrdered(0) != generation)
+                return;
+
+            // Новые QImage на каждый кадр: прошлые ушли в очередь сигнала
+            QImage image;
+            if (image.load(files.at(i).second))
+                image = image.convertToFormat(QImage::Format_RGB32);
+            emitFrame(files.at(i).first, image);
+        }
+    }
+
+private:
+    void readVideo()
+    {
+        VideoReader reader;
+        int index = files.first().first;
+        QImage frame;
+        if (reader.open(files.first().second))
+        {
+            while (reader.readFrame(frame))
+            {
+                if (loader->generation.fetchAndAddOrdered(0) != generation)
+                    return;
+                emitFrame(index++, frame);
+            }
+        }
+        emit loader->videoLoaded(generation, index - files.first().first);
+    }
+
+    void emitFrame(int index, QImage image)
+    {
+        // В сером режиме хранится только яркость: в 4 раза меньше памяти на кадр
+        QImage thumbnail;
+        if (!image.isNull())
+        {
+            if (gray && !isGrayscale(image))
+            {
+                QImage luma;
+                luminance(image.convertToFormat(QImage::Format_RGB32), luma);
+                image = luma;
+            }
+            downscaler.scale(image, thumbnail, ThumbnailSize, ThumbnailSize);
+        }
+        emit loader->frameLoaded(generation, index, image, thumbnail);
+    }
+
+    ThumbnailLoader* loader;
+    QList<QPair<int, QString> > files;
+    bool video;
+    bool gray;
+    int generation;
+    Downscaler downscaler;
+};
+
+ThumbnailLoader::ThumbnailLoader(QObject *parent) :
+    QObject(parent),
+    pendingGray(false)
+{
+    // Один поток остается GUI
+    threadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    cancel();
+}
+
+void ThumbnailLoader::loadImage(int index, const QString &fileName, bool gray)
+{
+    if (gray != pendingGray)
+        flush();
+    pendingGray = gray;
+    pending << qMakePair(index, fileName);
+    if (pending.size() >= ThumbnailBatch)
+        flush();
+}
+
+void ThumbnailLoader::loadVideo(int first, const QString &fileName, bool gray)
+{
+    QList<QPair<int, QString> > video;
+    video << qMakePair(first, fileName);
+    threadPool.start(new LoadTask(this, video, true, gray, generation.fetchAndAddOrdered(0)));
+}
+
+void ThumbnailLoader::flush()
+{
+    if (pending.isEmpty())
+        return;
+    threadPool.start(new LoadTask(this, pending, false, pendingGray, generation.fetchAndAddOrdered(0)));
+    pending.clear();
+}
+
+void ThumbnailLoader::cancel()
+{
+    pending.clear();
+    generation.fetchAndAddOrdered(1);
+    threadPool.waitForDone();
+}
+
+int ThumbnailLoader::currentGeneration() const
+{
+    return const_cast<QAtomicInt&>(generation).fetchAndAddOrdered(0);
+}
@@ -0,0 +1,56 @@
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+// Кадры списка декодируются из файлов в пуле потоков, там же строятся миниатюры тем же
+// Downscaler (box filter), что и уменьшенные кадры пирамиды. Готовый кадр с миниатюрой
+// приходит сигналом в поток GUI: строки списка появляются сразу, кадры и значки - по готовности.
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QThreadPool>
+
+// Сторона миниатюры, точки
+#define ThumbnailSize 100
+// Файлов в одной задаче пула: на пачку один Downscaler с его буферами
+#define ThumbnailBatch 32
+
+class ThumbnailLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ThumbnailLoader(QObject *parent = 0);
+    ~ThumbnailLoader();
+
+    // Изображение fileName станет кадром index. gray - кадр переводится в яркость
+    void loadImage(int index, const QString& fileName, bool gray);
+    // Кадры видео по порядку становятся кадрами first, first + 1, ...; видео читается одной задачей
+    void loadVideo(int first, const QString& fileName, bool gray);
+    // Отдает в пул накопленные изображения, не дожидаясь полной пачки
+    void flush();
+    // Отменяет еще не прочитанные кадры и ждет задачи пула
+    void cancel();
+    // Текущее поколение: растет при каждом cancel()
+    int currentGeneration() const;
+
+signals:
+    // generation - поколение запроса; сигналы, поставленные в очередь до cancel(), приходят
+    // со старым поколением, и получатель их отбрасывает. image.isNull() - файл не прочитан
+    void frameLoaded(int generation, int index, const QImage& image, const QImage& thumbnail);
+    // Видео прочитано до конца (или не открылось, frames == 0)
+    void videoLoaded(int generation, int frames);
+
+private:
+    friend class LoadTask;
+
+    QThreadPool threadPool;
+    QList<QPair<int, QString> > pending;
+    bool pendingGray;
+    // Задачи прошлых поколений (до cancel()) кадры не отдают
+    QAtomicInt generation;
+};
+
+#endif // THUMBNAILS_H
@@ -0,0 +1,212 @@
+#include <cmath>
+
+#include "tracker.h"
+
+Tracker::Tracker() :
+    nextId(0)
+{
+}
+
+void Tracker::reset()
+{
+    tracks.clear();
+    nextId = 0;
+}
+
+void Tracker::reserve(int count)
+{
+    tracks.reserve(count);
+    blobTrack.reserve(count);
+}
+
+void Tracker::predict()
+{
+    // x' = x + v, P' = F P F^T + Q, Q = q [1/4 1/2; 1/2 1] (ускорение постоянно в пределах кадра).
+    // Десяток умножений и сложений на траекторию
+    const float q = TrackProcessNoise;
+    for (int t = 0; t < tracks.size(); t++)
+    {
+        Track& track = tracks[t];
+        track.x += track.vx;
+        track.y += track.vy;
+        track.p00 += 2 * track.p01 + track.p11 + 0.25f * q;
+        track.p01 += track.p11 + 0.5f * q;
+        track.p11 += q;
+    }
+}
+
+void Tracker::correct(Track &track, const Blob &blob)
+{
+    // Измеряется только положение: K = P H^T / (p00 + r)
+    float s = track.p00 + TrackMeasurementNoise;
+    float k0 = track.p00 / s, k1 = track.p01 / s;
+    float ex = (float)blob.x - track.x, ey = (float)blob.y - track.y;
+
+    track.x += k0 * ex;
+    track.y += k0 * ey;
+    track.vx += k1 * ex;
+    track.vy += k1 * ey;
+
+    track.p11 -= k1 * track.p01;
+    track.p00 *= 1 - k0;
+    track.p01 *= 1 - k0;
+
+    track.width = blob.box.width();
+    track.height = blob.box.height();
+    track.missed = 0;
+}
+
+void Tracker::update(int frame, const QVector<Blob> &blobs, TrackStore &store)
+{
+    predict();
+
+    // Жадное сопоставление: каждой траектории - ближайшая к предсказанию свободная область
+    // в пределах TrackGate. Объектов в кадре единицы, поэтому полный перебор пар дешевле любого индекса
+    blobTrack.fill(-1, blobs.size());
+    const double gate = (double)TrackGate * TrackGate;
+
+    for (int t = 0; t < tracks.size(); t++)
+    {
+        Track& track = tracks[t];
+        int best = -1;
+        double bestDistance = gate;
+        for (int b = 0; b < blobs.size(); b++)
+        {
+            if (blobTrack.at(b) >= 0)
+                continue;
+            double dx = blobs.at(b).x - track.x;
+            double dy = blobs.at(b).y - track.y;
+            double distance = dx * dx + dy * dy;
+            if (distance <= bestDistance)
+            {
+                bestDistance = distance;
+                best = b;
+            }
+        }
+
+        if (best < 0)
+        {
+            track.missed++;
+            continue;
+        }
+        blobTrack[best] = t;
+        correct(track, blobs.at(best));
+    }
+
+    // Новые траектории для несопоставленных областей: скорость неизвестна, ее дисперсия велика
+    for (int b = 0; b < blobs.size(); b++)
+        if (blobTrack.at(b) < 0)
+        {
+            const Blob& blob = blobs.at(b);
+            Track track;
+            track.id = nextId++;
+            track.x = (float)blob.x;
+            track.y = (float)blob.y;
+            track.vx = track.vy = 0;
+            track.p00 = TrackMeasurementNoise;
+            track.p01 = 0;
+            track.p11 = (float)TrackGate * TrackGate / 4;
+            track.width = blob.box.width();
+            track.height = blob.box.height();
+            track.missed = 0;
+            blobTrack[b] = tracks.size();
+            tracks << track;
+        }
+
+    for (int b = 0; b < blobs.size(); b++)
+    {
+        const Blob& blob = blobs.at(b);
+        const Track& track = tracks.at(blobTrack.at(b));
+        store.append(frame, track.id, track.x, track.y, blob.box, blob.area);
+    }
+
+    // Пропущенные траектории продолжаются по предсказанию, потерянные удаляются
+    int kept = 0;
+    for (int t = 0; t < tracks.size(); t++)
+    {
+        const Track& track = tracks.at(t);
+        if (track.missed > TrackMaxMissed)
+            continue;
+        if (track.missed > 0)
+        {
+            QRect box(qRound(track.x - track.width / 2.f), qRound(track.y - track.height / 2.f), track.width, track.height);
+            store.append(frame, track.id, track.x, track.y, box, 0);
+        }
+        tracks[kept++] = track;
+    }
+    tracks.resize(kept);
+}
+
+void Tracker::searchWindows(QVector<QRect> &windows, const QRect &bounds) const
+{
+    // Положение в следующем кадре: x + v с дисперсией p00 + 2 p01 + p11 + q/4
+    windows.clear();
+    for (int t = 0; t < tracks.size(); t++)
+    {
+        const Track& track = tracks.at(t);
+        float variance = track.p00 + 2 * track.p01 + track.p11 + 0.25f * TrackProcessNoise;
+        float margin = TrackWindowSigmas * std::sqrt(variance);
+        float halfWidth = track.width / 2.f + margin, halfHeight = track.height / 2.f + margin;
+        float x = track.x + track.vx, y = track.y + track.vy;
+
+        QRect window((int)std::floor(x - halfWidth), (int)std::floor(y - halfHeight),
+                     (int)std::ceil(2 * halfWidth) + 1, (int)std::ceil(2 * halfHeight) + 1);
+        window = window.intersected(bounds);
+        if (!window.isEmpty())
+            windows << window;
+    }
+}
+
+bool Tracker::primaryPosition(double &x, double &y) const
+{
+    // Траектории добавляются по возрастанию номера и удаляются с сохранением порядка
+    if (tracks.isEmpty())
+        return false;
+    x = tracks.first().x;
+    y = tracks.first().y;
+    return true;
+}
+
+// Траектория в потоке: номер, 7 float (одинарная точность потока), размер и пропуски
+static const int TrackRecordBytes = 4 + 7 * 4 + 3 * 4;
+
+void Tracker::save(QDataStream &stream) const
+{
+    stream << (qint32)nextId << (qint32)tracks.size();
+    foreach (const Track& track, tracks)
+        stream << (qint32)track.id << track.x << track.y << track.vx << track.vy
+               << track.p00 << track.p01 << track.p11
+               << (qint32)track.width << (qint32)track.height << (qint32)track.missed;
+}
+
+bool Tracker::load(QDataStream &stream)
+{
+    qint32 id, count;
+    stream >> id >> count;
+    // Траекторий не больше, чем записей в остатке потока: поврежденное число не выделит память зря
+    if (stream.status() != QDataStream::Ok || count < 0 || !stream.device()
+            || stream.device()->bytesAvailable() < (qint64)count * TrackRecordBytes)
+        return false;
+
+    reset();
+    nextId = id;
+    tracks.resize(count);
+    for (int t = 0; t < count; t++)
+    {
+        Track& track = tracks[t];
+        qint32 trackId, width, height, missed;
+        stream >> trackId >> track.x >> track.y >> track.vx >> track.vy
+               >> track.p00 >> track.p01 >> track.p11 >> width >> height >> missed;
+        track.id = trackId;
+        track.width = width;
+        track.height = height;
+        track.missed = missed;
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        reset();
+        return false;
+    }
+    return true;
+}
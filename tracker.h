@@ -0,0 +1,69 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+// Сопровождение объектов: у каждой траектории фильтр Калмана с постоянной скоростью.
+// Связные области кадра связываются с ближайшим предсказанным положением, траектория
+// без области продолжается по предсказанию. Каждой траектории - свой номер.
+
+#include <QDataStream>
+#include <QRect>
+#include <QVector>
+
+#include "components.h"
+#include "trackstore.h"
+
+// Наибольшее расстояние от предсказанного положения до центра масс области, точки
+#define TrackGate 50
+// Сколько кадров подряд траектория может быть не найдена
+#define TrackMaxMissed 5
+// Дисперсия ускорения между кадрами (шум процесса) и ошибки центра масс, точки^2
+#define TrackProcessNoise 1.0f
+#define TrackMeasurementNoise 4.0f
+// Окно поиска: предсказанный прямоугольник плюс столько стандартных отклонений положения
+#define TrackWindowSigmas 3
+
+class Tracker
+{
+public:
+    Tracker();
+
+    void reset();
+    // Память под count траекторий и областей кадра
+    void reserve(int count);
+    // Предсказание на кадр frame, сопоставление и уточнение. В store - сглаженные
+    // положения найденных траекторий и предсказанные (площадь 0) для пропущенных
+    void update(int frame, const QVector<Blob>& blobs, TrackStore& store);
+
+    int tracksStarted() const { return nextId; }
+    int trackCount() const { return tracks.size(); }
+
+    // Где искать объекты в следующем кадре: по прямоугольнику на траекторию, внутри bounds
+    void searchWindows(QVector<QRect>& windows, const QRect& bounds) const;
+    // Сглаженное положение самой старой траектории; false, если траекторий нет
+    bool primaryPosition(double& x, double& y) const;
+
+    // Состояние фильтров и счетчик номеров для контрольной точки
+    void save(QDataStream& stream) const;
+    bool load(QDataStream& stream);
+
+private:
+    // Оси x и y независимы, с одинаковыми шумами и обновляются вместе, поэтому
+    // ковариация [положение, скорость] у них одна: p00 p01 p11
+    struct Track
+    {
+        int id;
+        float x, y, vx, vy;
+        float p00, p01, p11;
+        // Размер последнего прямоугольника области
+        int width, height;
+        int missed;
+    };
+
+    void predict();
+    static void correct(Track& track, const Blob& blob);
+
+    QVector<Track> tracks;
+    QVector<int> blobTrack;
+    int nextId;
+};
+
+#endif // TRACKER_H
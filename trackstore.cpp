@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cmath>
+
+#include <QFile>
+#include <QDataStream>
+#include <QTextStream>
+
+#include "trackstore.h"
+
+// "PTRK"
+static const quint32 TrackFileMagic = 0x4B525450;
+static const quint32 TrackFileVersion = 1;
+// Заголовок: признак, версия, число точек; точка по столбцам: кадр, номер, x, y, прямоугольник (4 x qint16), площадь
+static const qint64 TrackHeaderBytes = 3 * 4;
+static const qint64 TrackRecordBytes = 4 + 4 + 4 + 4 + 4 * 2 + 4;
+
+template <typename T>
+static void writeColumn(QDataStream& stream, const QVector<T>& column)
+{
+    for (int i = 0; i < column.size(); i++)
+        stream << column.at(i);
+}
+
+template <typename T>
+static void readColumn(QDataStream& stream, QVector<T>& column, int count)
+{
+    column.resize(count);
+    for (int i = 0; i < count; i++)
+        stream >> column[i];
+}
+
+static inline int cellOf(float coordinate)
+{
+    return (int)std::floor(coordinate / TrackGridCell);
+}
+
+TrackStore::TrackStore() :
+    indexValid(false), gridX0(0), gridY0(0), gridWidth(0), gridHeight(0)
+{
+}
+
+void TrackStore::clear()
+{
+    frames.clear();
+    ids.clear();
+    xs.clear();
+    ys.clear();
+    lefts.clear();
+    tops.clear();
+    rights.clear();
+    bottoms.clear();
+    areas.clear();
+    indexValid = false;
+}
+
+void TrackStore::reserve(int count)
+{
+    frames.reserve(count);
+    ids.reserve(count);
+    xs.reserve(count);
+    ys.reserve(count);
+    lefts.reserve(count);
+    tops.reserve(count);
+    rights.reserve(count);
+    bottoms.reserve(count);
+    areas.reserve(count);
+}
+
+void TrackStore::append(int frame, int id, float x, float y, const QRect &box, int area)
+{
+    frames << frame;
+    ids << id;
+    xs << x;
+    ys << y;
+    lefts << box.left();
+    tops << box.top();
+    rights << box.right();
+    bottoms << box.bottom();
+    areas << area;
+    indexValid = false;
+}
+
+TrackPoint TrackStore::at(int i) const
+{
+    TrackPoint point;
+    point.frame = frames.at(i);
+    point.id = ids.at(i);
+    point.x = xs.at(i);
+    point.y = ys.at(i);
+    point.box.setCoords(lefts.at(i), tops.at(i), rights.at(i), bottoms.at(i));
+    point.area = areas.at(i);
+    return point;
+}
+
+void TrackStore::buildIndex() const
+{
+    indexValid = true;
+    cellStart.clear();
+    cellPoints.clear();
+    gridWidth = gridHeight = 0;
+
+    int count = size();
+    if (count == 0)
+        return;
+
+    int x0 = cellOf(xs.at(0)), x1 = x0;
+    int y0 = cellOf(ys.at(0)), y1 = y0;
+    for (int i = 1; i < count; i++)
+    {
+        int cx = cellOf(xs.at(i)), cy = cellOf(ys.at(i));
+        x0 = qMin(x0, cx);
+        x1 = qMax(x1, cx);
+        y0 = qMin(y0, cy);
+        y1 = qMax(y1, cy);
+    }
+    gridX0 = x0;
+    gridY0 = y0;
+    gridWidth = x1 - x0 + 1;
+    gridHeight= y1 - y0 + 1;
+
+    // Сортировка подсчетом: порядок точек внутри ячейки сохраняется
+    QVector<int> cellOfPoint(count);
+    cellStart.fill(0, gridWidth * gridHeight + 1);
+    for (int i = 0; i < count; i++)
+    {
+        int cell = (cellOf(ys.at(i)) - gridY0) * gridWidth + cellOf(xs.at(i)) - gridX0;
+        cellOfPoint[i] = cell;
+        cellStart[cell + 1]++;
+    }
+    for (int c = 0; c < gridWidth * gridHeight; c++)
+        cellStart[c + 1] += cellStart[c];
+
+    QVector<int> position(cellStart);
+    cellPoints.resize(count);
+    for (int i = 0; i < count; i++)
+        cellPoints[position[cellOfPoint.at(i)]++] = i;
+}
+
+QVector<int> TrackStore::query(const QRect &region, int firstFrame, int lastFrame) const
+{
+    QVector<int> result;
+    if (!indexValid)
+        buildIndex();
+    if (gridWidth == 0 || region.isEmpty())
+        return result;
+
+    int cx0 = qMax(cellOf(region.left()) - gridX0, 0);
+    int cx1 = qMin(cellOf(region.right()) - gridX0, gridWidth - 1);
+    int cy0 = qMax(cellOf(region.top()) - gridY0, 0);
+    int cy1 = qMin(cellOf(region.bottom()) - gridY0, gridHeight - 1);
+
+    for (int cy = cy0; cy <= cy1; cy++)
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            int cell = cy * gridWidth + cx;
+            const int* begin = cellPoints.constData() + cellStart.at(cell);
+            const int* end   = cellPoints.constData() + cellStart.at(cell + 1);
+
+            // Точки ячейки идут по кадрам - начало диапазона ищется делением пополам
+            const int* point = std::lower_bound(begin, end, firstFrame,
+                                                [this](int i, int frame) { return frames.at(i) < frame; });
+            for (; point != end && frames.at(*point) <= lastFrame; point++)
+            {
+                float x = xs.at(*point), y = ys.at(*point);
+                if (x >= region.left() && x < region.right() + 1 && y >= region.top() && y < region.bottom() + 1)
+                    result << ids.at(*point);
+            }
+        }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+QVector<int> TrackStore::track(int id) const
+{
+    QVector<int> points;
+    for (int i = 0; i < size(); i++)
+        if (ids.at(i) == id)
+            points << i;
+    return points;
+}
+
+bool TrackStore::exportCsv(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "frame,id,x,y,left,top,right,bottom,area\n";
+    for (int i = 0; i < size(); i++)
+        stream << frames.at(i) << ',' << ids.at(i) << ','
+               << QString::number(xs.at(i), 'f', 2) << ',' << QString::number(ys.at(i), 'f', 2) << ','
+               << lefts.at(i) << ',' << tops.at(i) << ',' << rights.at(i) << ',' << bottoms.at(i) << ','
+               << areas.at(i) << '\n';
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+bool TrackStore::exportBinary(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    // Заголовок и столбцы целиком, little endian
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << TrackFileMagic << TrackFileVersion << (quint32)size();
+
+    writeColumn(stream, frames);
+    writeColumn(stream, ids);
+    writeColumn(stream, xs);
+    writeColumn(stream, ys);
+    writeColumn(stream, lefts);
+    writeColumn(stream, tops);
+    writeColumn(stream, rights);
+    writeColumn(stream, bottoms);
+    writeColumn(stream, areas);
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool TrackStore::importBinary(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != TrackFileMagic || version != TrackFileVersion)
+        return false;
+    // Число точек из заголовка сверяется с размером файла до выделения столбцов
+    if ((qint64)count * TrackRecordBytes > file.size() - TrackHeaderBytes)
+        return false;
+
+    clear();
+    readColumn(stream, frames, count);
+    readColumn(stream, ids, count);
+    readColumn(stream, xs, count);
+    readColumn(stream, ys, count);
+    readColumn(stream, lefts, count);
+    readColumn(stream, tops, count);
+    readColumn(stream, rights, count);
+    readColumn(stream, bottoms, count);
+    readColumn(stream, areas, count);
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        clear();
+        return false;
+    }
+    return true;
+}
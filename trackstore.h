@@ -0,0 +1,65 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+// Хранилище точек траекторий по столбцам: кадр, номер траектории, центр масс,
+// описанный прямоугольник, площадь. Выгрузка в CSV и двоичный файл,
+// пространственный индекс - равномерная сетка по центрам масс.
+
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+// Сторона ячейки сетки индекса, точки
+#define TrackGridCell 32
+
+struct TrackPoint
+{
+    int frame;
+    int id;
+    float x, y;
+    QRect box;
+    // 0 - объект не найден, положение и прямоугольник предсказаны
+    int area;
+};
+
+class TrackStore
+{
+public:
+    TrackStore();
+
+    void clear();
+    void reserve(int count);
+
+    // Точки добавляются в порядке кадров
+    void append(int frame, int id, float x, float y, const QRect& box, int area);
+
+    int size() const { return frames.size(); }
+    TrackPoint at(int i) const;
+
+    // Номера траекторий (по возрастанию), центр масс которых был внутри region
+    // в кадрах firstFrame..lastFrame включительно
+    QVector<int> query(const QRect& region, int firstFrame, int lastFrame) const;
+    // Точки одной траектории, номера точек по порядку кадров
+    QVector<int> track(int id) const;
+
+    bool exportCsv(const QString& fileName) const;
+    bool exportBinary(const QString& fileName) const;
+    bool importBinary(const QString& fileName);
+
+private:
+    void buildIndex() const;
+
+    QVector<qint32> frames;
+    QVector<qint32> ids;
+    QVector<float> xs, ys;
+    QVector<qint16> lefts, tops, rights, bottoms;
+    QVector<qint32> areas;
+
+    // Сетка строится при первом запросе после изменений: точки ячейки c -
+    // cellPoints[cellStart[c] .. cellStart[c + 1]), по возрастанию номера (и кадра)
+    mutable bool indexValid;
+    mutable int gridX0, gridY0, gridWidth, gridHeight;
+    mutable QVector<int> cellStart;
+    mutable QVector<int> cellPoints;
+};
+
+#endif // TRACKSTORE_H
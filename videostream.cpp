@@ -0,0 +1,499 @@
+#include "videostream.h"
+
+#include <climits>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStringList>
+#include <QMutexLocker>
+
+#define EncoderQueueLength 8
+// Заголовок потока или кадра длиннее - поток поврежден
+#define MaxHeaderLength 4096
+
+static bool readFully(QIODevice* device, char* data, qint64 size)
+{
+    qint64 done = 0;
+    while (done < size)
+    {
+        qint64 res = device->read(data + done, size - done);
+        if (res < 0)
+            return false;
+        // Для канала ждем новых данных, у файла это означает конец
+        if (res == 0 && !device->waitForReadyRead(-1))
+            return false;
+        done += res;
+    }
+    return true;
+}
+
+static bool readLineFully(QIODevice* device, QByteArray& line)
+{
+    // resize, а не clear: зарезервированный буфер строки сохраняется
+    line.resize(0);
+    char c;
+    while (true)
+    {
+        if (!device->getChar(&c))
+        {
+            if (!device->waitForReadyRead(-1))
+                return false;
+            continue;
+        }
+        if (c == '\n')
+            return true;
+        if (line.size() >= MaxHeaderLength)
+            return false;
+        line += c;
+    }
+}
+
+static bool writeFully(QIODevice* device, const char* data, qint64 size)
+{
+    qint64 done = 0;
+    while (done < size)
+    {
+        qint64 res = device->write(data + done, size - done);
+        if (res < 0)
+            return false;
+        done += res;
+        // Для канала к ffmpeg не даем буферу QProcess расти бесконечно
+        while (device->bytesToWrite() > 0)
+            if (!device->waitForBytesWritten(-1))
+                break;
+    }
+    return true;
+}
+
+static inline uchar clip(int x)
+{
+    return (x < 0) ? 0 : ((x > 255) ? 255 : x);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// \brief VideoReader::VideoReader
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+VideoReader::VideoReader() :
+    device(0), process(0), frameWidth(0), frameHeight(0), frameRateNum(0), frameRateDen(1),
+    chromaShiftX(1), chromaShiftY(1), mono(false)
+{
+    headerLine.reserve(256);
+}
+
+VideoReader::~VideoReader()
+{
+    close();
+}
+
+bool VideoReader::isVideoFile(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return suffix == "y4m" || suffix == "avi" || suffix == "mp4" || suffix == "mkv"
+        || suffix == "mov" || suffix == "mjpg" || suffix == "mjpeg";
+}
+
+bool VideoReader::open(const QString &fileName)
+{
+    close();
+
+    if (QFileInfo(fileName).suffix().toLower() == "y4m")
+    {
+        QFile* file = new QFile(fileName);
+        if (!file->open(QIODevice::ReadOnly))
+        {
+            delete file;
+            return false;
+        }
+        device = file;
+    }
+    else
+    {
+        // Декодирует ffmpeg, нам он отдает y4m в stdout
+        process = new QProcess;
+        process->setReadChannel(QProcess::StandardOutput);
+        process->setProcessChannelMode(QProcess::SeparateChannels);
+        process->setStandardErrorFile(QProcess::nullDevice());
+        process->start("ffmpeg", QStringList() << "-v" << "error" << "-nostdin"
+                                               << "-i" << fileName
+                                               << "-f" << "yuv4mpegpipe" << "-pix_fmt" << "yuv420p" << "-");
+        if (!process->waitForStarted())
+        {
+            delete process;
+            process = 0;
+            return false;
+        }
+        device = process;
+    }
+
+    if (!readHeader())
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void VideoReader::close()
+{
+    if (process)
+    {
+        process->kill();
+        process->waitForFinished();
+        delete process;
+    }
+    else
+        delete device;
+
+    device = 0;
+    process = 0;
+    frameWidth = frameHeight = 0;
+}
+
+bool VideoReader::readHeader()
+{
+    QByteArray line;
+    if (!readLineFully(device, line))
+        return false;
+
+    QList<QByteArray> tokens = line.split(' ');
+    if (tokens.isEmpty() || tokens.first() != "YUV4MPEG2")
+        return false;
+
+    frameRateNum = 25;
+    frameRateDen = 1;
+    chromaShiftX = chromaShiftY = 1;
+    mono = false;
+
+    for (int i = 1; i < tokens.size(); i++)
+    {
+        const QByteArray& token = tokens.at(i);
+        if (token.isEmpty())
+            continue;
+
+        QByteArray value = token.mid(1);
+        switch (token.at(0))
+        {
+        case 'W':
+            frameWidth = value.toInt();
+            break;
+        case 'H':
+            frameHeight = value.toInt();
+            break;
+        case 'F':
+        {
+            QList<QByteArray> rate = value.split(':');
+            if (rate.size() == 2 && rate.at(1).toInt() > 0)
+            {
+                frameRateNum = rate.at(0).toInt();
+                frameRateDen = rate.at(1).toInt();
+            }
+            break;
+        }
+        case 'C':
+            if (value.startsWith("420"))
+            {
+                chromaShiftX = 1; chromaShiftY = 1;
+            }
+            else if (value.startsWith("422"))
+            {
+                chromaShiftX = 1; chromaShiftY = 0;
+            }
+            else if (value.startsWith("444") && !value.startsWith("444alpha"))
+            {
+                chromaShiftX = 0; chromaShiftY = 0;
+            }
+            else if (value.startsWith("mono"))
+            {
+                mono = true;
+            }
+            else
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return frameWidth > 0 && frameHeight > 0 && frameWidth <= VideoMaxSide && frameHeight <= VideoMaxSide;
+}
+
+bool VideoReader::readFrame(QImage &frame)
+{
+    if (!device)
+        return false;
+
+    if (!readLineFully(device, headerLine) || !headerLine.startsWith("FRAME"))
+        return false;
+
+    // Размеры плоскостей - в qint64: сторона ограничена VideoMaxSide, но произведение
+    // не должно переполниться и при другом ограничении
+    int chromaWidth  = (frameWidth  + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    int chromaHeight = (frameHeight + (1 << chromaShiftY) - 1) >> chromaShiftY;
+    qint64 lumaSize   = (qint64)frameWidth * frameHeight;
+    qint64 chromaSize = mono ? 0 : (qint64)chromaWidth * chromaHeight;
+    qint64 planesSize = lumaSize + 2 * chromaSize;
+    if (planesSize > INT_MAX)
+        return false;
+
+    planes.resize((int)planesSize);
+    if (!readFully(device, planes.data(), planes.size()))
+        return false;
+
+    // Кадр может не выделиться и при допустимом размере
+    if (frame.width() != frameWidth || frame.height() != frameHeight || frame.format() != QImage::Format_RGB32)
+        frame = QImage(frameWidth, frameHeight, QImage::Format_RGB32);
+    if (frame.isNull())
+        return false;
+
+    const uchar* yPlane = (const uchar*)planes.constData();
+    const uchar* uPlane = yPlane + lumaSize;
+    const uchar* vPlane = uPlane + chromaSize;
+
+    // BT.601, ограниченный диапазон
+    for (int y = 0; y < frameHeight; y++)
+    {
+        QRgb* pixel = (QRgb*)frame.scanLine(y);
+        const uchar* yLine = yPlane + y * frameWidth;
+        const uchar* uLine = uPlane + (y >> chromaShiftY) * chromaWidth;
+        const uchar* vLine = vPlane + (y >> chromaShiftY) * chromaWidth;
+
+        for (int x = 0; x < frameWidth; x++, pixel++)
+        {
+            int c = 298 * ((int)yLine[x] - 16);
+            int d = mono ? 0 : (int)uLine[x >> chromaShiftX] - 128;
+            int e = mono ? 0 : (int)vLine[x >> chromaShiftX] - 128;
+
+            *pixel = qRgb(clip((c + 409 * e + 128) >> 8),
+                          clip((c - 100 * d - 208 * e + 128) >> 8),
+                          clip((c + 516 * d + 128) >> 8));
+        }
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// \brief VideoWriter::VideoWriter
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+VideoWriter::VideoWriter() :
+    device(0), process(0), frameWidth(0), frameHeight(0)
+{
+}
+
+VideoWriter::~VideoWriter()
+{
+    close();
+}
+
+bool VideoWriter::open(const QString &fileName, int width, int height, int fpsNum, int fpsDen)
+{
+    close();
+
+    if (QFileInfo(fileName).suffix().toLower() == "y4m")
+    {
+        QFile* file = new QFile(fileName);
+        if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            delete file;
+            return false;
+        }
+        device = file;
+    }
+    else
+    {
+        // Кодирует ffmpeg, формат выбирается по расширению
+        process = new QProcess;
+        process->setStandardOutputFile(QProcess::nullDevice());
+        process->setStandardErrorFile(QProcess::nullDevice());
+        process->start("ffmpeg", QStringList() << "-v" << "error" << "-y"
+                                               << "-f" << "yuv4mpegpipe" << "-i" << "-"
+                                               << fileName);
+        if (!process->waitForStarted())
+        {
+            delete process;
+            process = 0;
+            return false;
+        }
+        device = process;
+    }
+
+    frameWidth  = width;
+    frameHeight = height;
+
+    QByteArray header = QString("YUV4MPEG2 W%1 H%2 F%3:%4 Ip A1:1 C420jpeg\n")
+            .arg(width).arg(height).arg(fpsNum).arg(fpsDen).toLatin1();
+
+    if (!writeFully(device, header.constData(), header.size()))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void VideoWriter::close()
+{
+    if (process)
+    {
+        process->closeWriteChannel();
+        process->waitForFinished(-1);
+        delete process;
+    }
+    else
+        delete device;
+
+    device = 0;
+    process = 0;
+}
+
+bool VideoWriter::writeFrame(const QImage &frame)
+{
+    if (!device)
+        return false;
+
+    QImage image = frame;
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32)
+        image = image.convertToFormat(QImage::Format_RGB32);
+    if (image.width() != frameWidth || image.height() != frameHeight)
+        image = image.scaled(frameWidth, frameHeight);
+
+    int chromaWidth  = (frameWidth  + 1) / 2;
+    int chromaHeight = (frameHeight + 1) / 2;
+    int lumaSize     = frameWidth * frameHeight;
+    int chromaSize   = chromaWidth * chromaHeight;
+
+    planes.resize(lumaSize + 2 * chromaSize);
+    uchar* yPlane = (uchar*)planes.data();
+    uchar* uPlane = yPlane + lumaSize;
+    uchar* vPlane = uPlane + chromaSize;
+
+    for (int y = 0; y < frameHeight; y++)
+    {
+        const QRgb* pixel = (const QRgb*)image.constScanLine(y);
+        uchar* yLine = yPlane + y * frameWidth;
+        for (int x = 0; x < frameWidth; x++, pixel++)
+            yLine[x] = ((66 * qRed(*pixel) + 129 * qGreen(*pixel) + 25 * qBlue(*pixel) + 128) >> 8) + 16;
+    }
+
+    // Цветоразностные составляющие усредняются по блоку 2x2
+    for (int cy = 0; cy < chromaHeight; cy++)
+    {
+        const QRgb* line1 = (const QRgb*)image.constScanLine(2 * cy);
+        const QRgb* line2 = (const QRgb*)image.constScanLine(qMin(2 * cy + 1, frameHeight - 1));
+
+        for (int cx = 0; cx < chromaWidth; cx++)
+        {
+            int x1 = 2 * cx, x2 = qMin(2 * cx + 1, frameWidth - 1);
+            int R = qRed(line1[x1])   + qRed(line1[x2])   + qRed(line2[x1])   + qRed(line2[x2]);
+            int G = qGreen(line1[x1]) + qGreen(line1[x2]) + qGreen(line2[x1]) + qGreen(line2[x2]);
+            int B = qBlue(line1[x1])  + qBlue(line1[x2])  + qBlue(line2[x1])  + qBlue(line2[x2]);
+
+            uPlane[cy * chromaWidth + cx] = clip(((-38 * R - 74 * G + 112 * B + 512) >> 10) + 128);
+            vPlane[cy * chromaWidth + cx] = clip(((112 * R - 94 * G - 18 * B + 512) >> 10) + 128);
+        }
+    }
+
+    static const char frameHeader[] = "FRAME\n";
+    return writeFully(device, frameHeader, sizeof(frameHeader) - 1)
+        && writeFully(device, planes.constData(), planes.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/// \brief VideoEncoder::VideoEncoder
+///
+/////////////////////////////////////////////////////////////////////////////////
+
+VideoEncoder::VideoEncoder(QObject *parent) :
+    QThread(parent), frameWidth(0), frameHeight(0), frameRateNum(1000 / 20), frameRateDen(1),
+    finishing(false), failed(false)
+{
+}
+
+VideoEncoder::~VideoEncoder()
+{
+    finish();
+}
+
+void VideoEncoder::start(const QString &fileName, int width, int height, int fpsNum, int fpsDen)
+{
+    outFileName  = fileName;
+    frameWidth   = width;
+    frameHeight  = height;
+    frameRateNum = fpsNum;
+    frameRateDen = fpsDen;
+    finishing = false;
+    failed    = false;
+
+    QThread::start();
+}
+
+bool VideoEncoder::enqueue(const QImage &frame)
+{
+    QMutexLocker locker(&mutex);
+
+    while (queue.size() >= EncoderQueueLength && !failed)
+        notFull.wait(&mutex);
+
+    if (failed)
+        return false;
+
+    queue.enqueue(frame);
+    notEmpty.wakeOne();
+    return true;
+}
+
+void VideoEncoder::finish()
+{
+    if (!isRunning())
+        return;
+
+    mutex.lock();
+    finishing = true;
+    notEmpty.wakeOne();
+    mutex.unlock();
+
+    wait();
+}
+
+void VideoEncoder::run()
+{
+    // QProcess должен жить в том же потоке, где используется
+    VideoWriter writer;
+    bool opened = writer.open(outFileName, frameWidth, frameHeight, frameRateNum, frameRateDen);
+
+    while (true)
+    {
+        QImage frame;
+        {
+            QMutexLocker locker(&mutex);
+            if (!opened)
+            {
+                failed = true;
+                queue.clear();
+                notFull.wakeAll();
+                return;
+            }
+
+            while (queue.isEmpty() && !finishing)
+                notEmpty.wait(&mutex);
+
+            if (queue.isEmpty())
+                break;
+
+            frame = queue.dequeue();
+            notFull.wakeOne();
+        }
+
+        if (!writer.writeFrame(frame))
+            opened = false;
+    }
+
+    writer.close();
+}
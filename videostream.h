@@ -0,0 +1,105 @@
+#ifndef VIDEOSTREAM_H
+#define VIDEOSTREAM_H
+// Потоковое чтение и запись видео.
+// Встроенно поддерживается YUV4MPEG2 (*.y4m), остальные форматы
+// прогоняются через локальный ffmpeg, который отдает/принимает y4m по каналу.
+
+#include <QImage>
+#include <QString>
+#include <QByteArray>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+class QIODevice;
+class QProcess;
+
+// Наибольшая сторона кадра y4m: заголовок с большим размером считается поврежденным
+#define VideoMaxSide 8192
+
+class VideoReader
+{
+public:
+    VideoReader();
+    ~VideoReader();
+
+    bool open(const QString& fileName);
+    void close();
+
+    // Следующий кадр в формате RGB32. false - конец потока или ошибка
+    bool readFrame(QImage& frame);
+
+    int width() const  { return frameWidth; }
+    int height() const { return frameHeight; }
+    int fpsNum() const { return frameRateNum; }
+    int fpsDen() const { return frameRateDen; }
+
+    static bool isVideoFile(const QString& fileName);
+
+private:
+    bool readHeader();
+
+    QIODevice* device;
+    QProcess*  process;
+
+    int frameWidth, frameHeight;
+    int frameRateNum, frameRateDen;
+    // Сдвиги прореживания цветоразностных плоскостей (420: 1, 1; 444: 0, 0)
+    int chromaShiftX, chromaShiftY;
+    bool mono;
+
+    QByteArray headerLine;
+    QByteArray planes;
+};
+
+class VideoWriter
+{
+public:
+    VideoWriter();
+    ~VideoWriter();
+
+    bool open(const QString& fileName, int width, int height, int fpsNum = 1000 / 20, int fpsDen = 1);
+    void close();
+
+    bool writeFrame(const QImage& frame);
+
+private:
+    QIODevice* device;
+    QProcess*  process;
+
+    int frameWidth, frameHeight;
+
+    QByteArray planes;
+};
+
+// Кодирование в отдельном потоке. Очередь ограничена, чтобы не копить
+// кадры в памяти, если кодер не успевает.
+class VideoEncoder : public QThread
+{
+public:
+    explicit VideoEncoder(QObject *parent = 0);
+    ~VideoEncoder();
+
+    void start(const QString& fileName, int width, int height, int fpsNum, int fpsDen);
+    // false, если кодер не смог открыть выход
+    bool enqueue(const QImage& frame);
+    void finish();
+
+protected:
+    void run();
+
+private:
+    QString outFileName;
+    int frameWidth, frameHeight;
+    int frameRateNum, frameRateDen;
+
+    QQueue<QImage> queue;
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    bool finishing;
+    bool failed;
+};
+
+#endif // VIDEOSTREAM_H
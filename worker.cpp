@@ -0,0 +1,363 @@
+#include <cstring>
+
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "worker.h"
+#include "videostream.h"
+#include "luminance.h"
+#include "maskarchive.h"
+
+Worker::Worker(Recognizer *recognizer_, QObject *parent) :
+    QThread(parent), recognizer(recognizer_), currentTask(Learn)
+{
+    qRegisterMetaType<xy>("xy");
+    qRegisterMetaType<DistanceMap>("DistanceMap");
+    memset(&bestSweep, 0, sizeof(bestSweep));
+}
+
+Worker::~Worker()
+{
+    cancel();
+    wait();
+}
+
+void Worker::learn(const QList<QImage*> &frames_)
+{
+    currentTask = Learn;
+    frames = frames_;
+    canceled.fetchAndStoreOrdered(0);
+    start();
+}
+
+void Worker::recognize(const QList<QImage*> &frames_, const QString &archiveName)
+{
+    currentTask = Recognize;
+    frames = frames_;
+    outName = archiveName;
+    canceled.fetchAndStoreOrdered(0);
+    start();
+}
+
+void Worker::recognizeVideo(const QString &inName_, const QString &outName_)
+{
+    currentTask = RecognizeVideo;
+    frames.clear();
+    inName = inName_;
+    outName = outName_;
+    canceled.fetchAndStoreOrdered(0);
+    start();
+}
+
+void Worker::sweep(const QList<QImage*> &frames_, const QList<QImage> &truths_, const QString &outName_)
+{
+    currentTask = Sweep;
+    frames = frames_;
+    truths = truths_;
+    outName = outName_;
+    canceled.fetchAndStoreOrdered(0);
+    start();
+}
+
+void Worker::cancel()
+{
+    canceled.fetchAndStoreOrdered(1);
+}
+
+bool Worker::isCanceled() const
+{
+    return const_cast<QAtomicInt&>(canceled).fetchAndAddOrdered(0) != 0;
+}
+
+void Worker::run()
+{
+    switch (currentTask)
+    {
+    case Learn:
+        runLearn();
+        break;
+    case Recognize:
+        runRecognize();
+        break;
+    case RecognizeVideo:
+        runRecognizeVideo();
+        break;
+    case Sweep:
+        runSweep();
+        break;
+    }
+    frames.clear();
+    truths.clear();
+}
+
+// Поток обучения: берет следующую пачку еще не взятых кадров, пока кадры не кончатся
+class LearnTask : public QRunnable
+{
+public:
+    LearnTask(const Worker* worker_, Recognizer* recognizer_, const QList<QImage*>& frames_, int count_,
+              int part_, QAtomicInt& next_, QAtomicInt& done_) :
+        worker(worker_), recognizer(recognizer_), frames(frames_), count(count_), part(part_),
+        next(next_), done(done_)
+    {
+    }
+
+    void run()
+    {
+        const QImage* batch[LearningBatch];
+        while (!worker->isCanceled())
+        {
+            int first = next.fetchAndAddOrdered(LearningBatch);
+            if (first >= count)
+                break;
+            int n = qMin(LearningBatch, count - first);
+            for (int i = 0; i < n; i++)
+                batch[i] = frames.at(first + i);
+            recognizer->learnFrames(batch, n, part);
+            done.fetchAndAddOrdered(n);
+        }
+    }
+
+private:
+    const Worker* worker;
+    Recognizer* recognizer;
+    const QList<QImage*>& frames;
+    int count;
+    int part;
+    QAtomicInt& next;
+    QAtomicInt& done;
+};
+
+void Worker::runLearn()
+{
+    if (frames.isEmpty())
+        return;
+
+    int count = qMin(frames.size(), MaxLearningFrames);
+    int batches = (count + LearningBatch - 1) / LearningBatch;
+    int parts = qBound(1, QThread::idealThreadCount(), qMin(batches, MaxLearningThreads));
+    recognizer->beginLearning(*frames.first(), parts);
+
+    // Каждый поток копит суммы в своей части модели, кадры разбираются пачками
+    QAtomicInt next(0), done(0);
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(parts);
+    for (int part = 0; part < parts; part++)
+        threadPool.start(new LearnTask(this, recognizer, frames, count, part, next, done));
+
+    while (!threadPool.waitForDone(100))
+        emit progress(done.fetchAndAddOrdered(0), count);
+
+    // Прерванное обучение все равно завершается по уже добавленным кадрам
+    int learned = done.fetchAndAddOrdered(0);
+    emit progress(learned, count);
+    recognizer->endLearning();
+}
+
+void Worker::runRecognize()
+{
+    if (frames.isEmpty() || !recognizer->hasModel())
+        return;
+
+    QImage* firstFrame = frames.first();
+    int width = firstFrame->width();
+    int height= firstFrame->height();
+
+    // Маски уходят в архив, GUI читает их оттуда по одной
+    MaskArchiveWriter archive;
+    if (!archive.start(outName, width, height))
+    {
+        emit failed("Не удалось создать архив масок");
+        return;
+    }
+
+    recognizer->begin(width, height, frames.size());
+    FramePool& pool = recognizer->pool();
+
+    QList<xy> centres;
+    centres.reserve(QueueLength);
+
+    for (int i = 0; i < frames.size() && !isCanceled(); i++)
+    {
+        const QImage& frame = *frames.at(i);
+        QImage* mask = pool.acquire(QImage::Format_Indexed8, Recognizer::maskColorTable());
+
+        // Карта уходит в GUI, поэтому каждый раз новая; маска строится по ней же
+        DistanceMap map;
+        bool withMap = recognizer->settings.distanceDepth != 0;
+
+        // Первый кадр не распознается
+        if (i == 0)
+        {
+            mask->fill(0);
+            if (withMap)
+                recognizer->distances(frame, map);
+        }
+        else
+            recognizer->classifyFrame(frame, mask, withMap ? &map : 0);
+
+        recognizer->track(i, *mask);
+        if (withMap)
+            emit distancesComputed(i, map);
+        xy centre = recognizer->trackedCentre(*mask);
+        Recognizer::pushCentre(centres, centre);
+
+        QImage overlay = frame.convertToFormat(QImage::Format_RGB32);
+        Recognizer::drawTrajectory(overlay, *mask, centres);
+
+        bool written = archive.append(*mask);
+        pool.release(mask);
+        if (!written)
+        {
+            emit failed("Не удалось записать архив масок");
+            break;
+        }
+
+        emit frameRecognized(i, overlay, centre);
+        emit progress(i + 1, frames.size());
+    }
+
+    if (!archive.finish())
+        emit failed("Не удалось записать архив масок");
+
+    recognizer->report();
+}
+
+void Worker::runRecognizeVideo()
+{
+    if (!recognizer->hasModel())
+        return;
+
+    VideoReader reader;
+    if (!reader.open(inName))
+    {
+        emit failed("Не удалось открыть видео");
+        return;
+    }
+
+    int width = reader.width();
+    int height= reader.height();
+    if (width != recognizer->width() || height != recognizer->height())
+    {
+        emit failed("Размер кадра не совпадает с обучающими изображениями");
+        return;
+    }
+
+    // Маски пишутся рядом с результатом: out.mp4 -> out_mask.mp4
+    QFileInfo outInfo(outName);
+    QString maskName = outInfo.path() + "/" + outInfo.completeBaseName() + "_mask." + outInfo.suffix();
+
+    // Кодирование идет в отдельных потоках, здесь только декодирование и обработка
+    VideoEncoder overlayEncoder, maskEncoder;
+    overlayEncoder.start(outName,  width, height, reader.fpsNum(), reader.fpsDen());
+    maskEncoder.start(maskName, width, height, reader.fpsNum(), reader.fpsDen());
+
+    // Точные маски для просмотра любого кадра: out.mp4 -> out.masks
+    MaskArchiveWriter archive;
+    if (!archive.start(outInfo.path() + "/" + outInfo.completeBaseName() + ".masks", width, height))
+    {
+        overlayEncoder.finish();
+        maskEncoder.finish();
+        emit failed("Не удалось создать архив масок");
+        return;
+    }
+
+    recognizer->begin(width, height);
+    FramePool& pool = recognizer->pool();
+
+    QList<xy> centres;
+    centres.reserve(QueueLength);
+
+    QImage frame;
+    int i = 0;
+    while (!isCanceled() && reader.readFrame(frame))
+    {
+        // Буферы, которые еще в очереди кодера, пул не выдаст
+        QImage* mask    = pool.acquire(QImage::Format_Indexed8, Recognizer::maskColorTable());
+        QImage* overlay = pool.acquire(QImage::Format_RGB32);
+
+        // Серая модель: классифицируется только яркость, результат рисуется по цветному кадру
+        if (recognizer->isGray())
+        {
+            QImage* luma = pool.acquire(QImage::Format_Indexed8);
+            luminance(frame, *luma);
+            recognizer->classifyFrame(*luma, mask);
+            pool.release(luma);
+        }
+        else
+            recognizer->classifyFrame(frame, mask);
+
+        recognizer->track(i, *mask);
+        Recognizer::pushCentre(centres, recognizer->trackedCentre(*mask));
+        memcpy(overlay->bits(), frame.constBits(), frame.byteCount());
+        Recognizer::drawTrajectory(*overlay, *mask, centres);
+
+        bool written = overlayEncoder.enqueue(*overlay) && maskEncoder.enqueue(*mask) && archive.append(*mask);
+        pool.release(mask);
+        pool.release(overlay);
+
+        if (!written)
+        {
+            emit failed("Не удалось записать результат");
+            break;
+        }
+
+        emit progress(++i, 0);
+    }
+
+    overlayEncoder.finish();
+    maskEncoder.finish();
+    if (!archive.finish())
+        emit failed("Не удалось записать архив масок");
+
+    recognizer->report();
+}
+
+void Worker::runSweep()
+{
+    memset(&bestSweep, 0, sizeof(bestSweep));
+    if (frames.isEmpty() || !recognizer->hasModel())
+        return;
+
+    // Подбор оценивает только расстояния, порог и размыкание (см. sweep.h): с остальными
+    // этапами найденные параметры не соответствовали бы распознаванию
+    const RecognizerSettings& settings = recognizer->settings;
+    if (settings.useEdges || (settings.hysteresisK > 0 && settings.hysteresisK < settings.thresholdK)
+            || settings.voteFrames > 1 || settings.reconstruct || settings.fillHoles)
+    {
+        emit failed("Подбор параметров идет без уточнения по краям, гистерезиса, голосования, "
+                    "восстановления и заливки дыр - выключите их");
+        return;
+    }
+
+    BackgroundModel& model = recognizer->backgroundModel();
+    for (int i = 0; i < frames.size() && i < truths.size(); i++)
+    {
+        if (frames.at(i)->width() != recognizer->width() || frames.at(i)->height() != recognizer->height()
+                || truths.at(i).width() != recognizer->width() || truths.at(i).height() != recognizer->height())
+        {
+            emit failed("Размер разметки не совпадает с кадрами");
+            return;
+        }
+        if (!model.acceptsFrame(*frames.at(i)))
+        {
+            emit failed("Кадры и модель разного вида (серые и цветные)");
+            return;
+        }
+    }
+
+    model.setShadowSuppression(settings.suppressShadows);
+    ParameterSweep sweep;
+    sweep.start(&model, frames, truths);
+
+    int done = 0;
+    while (!isCanceled() && sweep.step())
+        emit progress(++done, sweep.stepCount());
+    sweep.finish();
+
+    // При отмене сохраняется то, что успели посчитать
+    if (const SweepResult* best = sweep.best())
+        bestSweep = *best;
+    if (!sweep.saveCsv(outName))
+        emit failed("Не удалось записать результат");
+}
@@ -0,0 +1,72 @@
+#ifndef WORKER_H
+#define WORKER_H
+// Обучение и распознавание в отдельном потоке.
+// Ход работы и готовые кадры передаются сигналами, отмена проверяется на каждом кадре.
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QImage>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+#include "recognizer.h"
+#include "sweep.h"
+
+Q_DECLARE_METATYPE(xy)
+
+class Worker : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Task { Learn, Recognize, RecognizeVideo, Sweep };
+
+    // recognizer принадлежит вызывающему, пока задача идет, трогать его нельзя
+    explicit Worker(Recognizer* recognizer, QObject *parent = 0);
+    ~Worker();
+
+    // Кадры не должны меняться и удаляться до завершения задачи
+    void learn(const QList<QImage*>& frames);
+    // Маски кадров пишутся в архив archiveName (MaskArchiveWriter), прежний архив заменяется
+    void recognize(const QList<QImage*>& frames, const QString& archiveName);
+    void recognizeVideo(const QString& inName, const QString& outName);
+    // Подбор параметров по разметке truths, результаты - в CSV outName
+    void sweep(const QList<QImage*>& frames, const QList<QImage>& truths, const QString& outName);
+    // Лучшая по F1 конфигурация последнего подбора, frames == 0 - нет
+    const SweepResult& sweepBest() const { return bestSweep; }
+
+    Task task() const { return currentTask; }
+    bool isCanceled() const;
+
+public slots:
+    void cancel();
+
+signals:
+    // total == 0 - длина заранее неизвестна
+    void progress(int done, int total);
+    // Готовый кадр: изображение с траекторией и центр масс объекта. Маска - в архиве задачи
+    void frameRecognized(int index, const QImage& overlay, xy centre);
+    // Квантованные расстояния кадра, если включены settings.distanceDepth
+    void distancesComputed(int index, const DistanceMap& map);
+    void failed(const QString& message);
+
+protected:
+    void run();
+
+private:
+    void runLearn();
+    void runRecognize();
+    void runRecognizeVideo();
+    void runSweep();
+
+    Recognizer* recognizer;
+    Task currentTask;
+    QList<QImage*> frames;
+    QList<QImage> truths;
+    QString inName, outName;
+    SweepResult bestSweep;
+    QAtomicInt canceled;
+};
+
+#endif // WORKER_H